@@ -1,9 +1,10 @@
 #include "c4cc/board.h"
 
+#include <algorithm>
+#include <cstdint>
 #include <ios>
 #include <iomanip>
 #include <iostream>
-#include <cstdint>
 
 namespace c4cc {
 
@@ -53,113 +54,86 @@ bool InitializeStartXY() {
 }
 bool dummy = InitializeStartXY();
 
-}  // namespace
+// Bottom cell of every column.
+constexpr uint64_t kBottomRow = 0x40810204081ull;
+// All cells, without the sentinels.
+constexpr uint64_t kBoardMask = kBottomRow * 0x3f;
 
-Board::Board() : is_over_(false) {
-  for (int i = 0; i < 7; ++i) {
-    for (int j = 0; j < 6; ++j) {
-      SetColor(i, j, Color::kEmpty);
-    }
+// Reverses the order of the columns.
+uint64_t Mirror(uint64_t b) {
+  uint64_t m = 0;
+  for (int x = 0; x < 7; ++x) {
+    m |= ((b >> (7 * x)) & 0x7f) << (7 * (6 - x));
   }
-  RedoMoves();
+  return m;
 }
 
+}  // namespace
+
 void Board::MakeMove(int move_x) {
   assert(!is_over());
-  const Color t = turn();
-  int move_y;
-  for (move_y = 0; move_y < 6; ++move_y) {
-    if (color(move_x, move_y) == Color::kEmpty) {
-      SetColor(move_x, move_y, t);
-      break;
-    }
-  }
-  assert(move_y < 6);
-  // Check for wins here
-  // TODO: do bit magic instead if this is slow.
-  for (int d = 0; d < 4; ++d) {
-    int x = kStartX[d][move_x][move_y];
-    int y = kStartY[d][move_x][move_y];
-    int count = 0;
-    while (x < 7 && y >= 0 && y < 6) {
-      if (color(x, y) == t) {
-        ++count;
-        if (count == 4) {
-          is_over_ = true;
-          result_ = t;
-          d = 4;
-          break;
-        }
-      } else {
-        count = 0;
-      }
-      x += kDX[d];
-      y += kDY[d];
-    }
-  }
-  if (move_y == 5) {
-    // Last move for this column, update the list of valid moves.
-    RedoMoves();
-    if (!is_over_ && valid_moves_ == 0) {
-      // Draw, no more moves left.
-      is_over_ = true;
-      result_ = Color::kEmpty;
-    }
+  assert(can_play(move_x));
+  // The opponent's pieces, who is to move next.
+  position_ ^= mask_;
+  mask_ |= mask_ + BottomMask(move_x);
+  if (HasFour(position_ ^ mask_)) {
+    is_over_ = true;
+    result_ = turn_;
+  } else if (mask_ == kBoardMask) {
+    // Draw, no more moves left.
+    is_over_ = true;
+    result_ = Color::kEmpty;
   }
   turn_ = OtherColor(turn_);
   ++ply_;
 }
 
 void Board::UndoMove(int move_x) {
+  const uint64_t column = mask_ & ColumnMask(move_x);
+  assert(column != 0);
+  // Highest piece of the column.
+  mask_ ^= uint64_t{1} << (63 - __builtin_clzll(column));
+  position_ ^= mask_;
   is_over_ = false;
+  result_ = Color::kEmpty;
   turn_ = OtherColor(turn_);
-  for (int move_y = 5; move_y >= 0; --move_y) {
-    if (color(move_x, move_y) != Color::kEmpty) {
-      assert(color(move_x, move_y) == turn_);
-      SetColor(move_x, move_y, Color::kEmpty);
-      if (move_y == 5) {
-        RedoMoves();
-      }
-      return;
-    }
-  }
-  assert(false);
   --ply_;
 }
 
-void Board::RedoMoves() {
-  // Last move for this column, update the list of valid moves.
-  valid_moves_ = 0;
-  for (int x = 0; x < 7; ++x) {
-    if (color(x, 5) == Color::kEmpty) {
-      valid_moves_ |= (1 << x);
+// static
+bool Board::HasFour(uint64_t pieces) {
+  // Vertical, horizontal and the two diagonals.
+  for (int shift : {1, 7, 6, 8}) {
+    const uint64_t pairs = pieces & (pieces >> shift);
+    if ((pairs & (pairs >> (2 * shift))) != 0) {
+      return true;
     }
   }
+  return false;
 }
 
 MoveList Board::valid_moves() const {
   static const int kBestOrder[] = {3, 2, 4, 1, 5, 0, 6};
   MoveList list;
   for (int x : kBestOrder) {
-    if (valid_moves_ & (1 << x)) {
+    if (can_play(x)) {
       list.push_back(x);
     }
   }
   return list;
 }
 
+uint64_t Board::canonical_key() const {
+  return std::min(key(), Mirror(position_) + Mirror(mask_));
+}
+
 Board Board::GetFlipped() const {
   Board o = *this;
-  for (int x = 0; x < 7; ++x) {
-    for (int y = 0; y < 6; ++y) {
-      o.SetColor(x, y, color(6 - x, y));
-    }
-  }
-  o.RedoMoves();
+  o.position_ = Mirror(position_);
+  o.mask_ = Mirror(mask_);
   return o;
 }
 
-
 // static
 int Board::dx(int dir) { return kDX[dir]; }
 // static
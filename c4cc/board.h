@@ -65,15 +65,25 @@ inline Color OtherColor(Color c) {
   return c == Color::kOne ? Color::kTwo : Color::kOne;
 }
 
+// Two bitboards, as in Pascal Pons' Connect 4 solver. Cell (x, y) is bit
+// 7 * x + y: each column takes 6 bits and a sentinel bit above its top cell,
+// which keeps shifted lines from wrapping to the next column. 'mask_' has all
+// pieces, and 'position_' has those of the player to move.
 class Board {
  public:
-  Board();
+  static constexpr int kWidth = 7;
+  static constexpr int kHeight = 6;
+
+  Board() {}
   Board(const Board& b) = default;
   Board& operator=(const Board& b) = default;
 
   Color turn() const { return turn_; }
 
   MoveList valid_moves() const;
+  bool can_play(int x) const { return (mask_ & TopMask(x)) == 0; }
+  // Number of pieces in column 'x'.
+  int height(int x) const { return __builtin_popcountll(mask_ & ColumnMask(x)); }
 
   bool is_over() const { return is_over_; }
   // 1 if kOne wins, -1 if kTwo wins, 0 for draw.
@@ -87,24 +97,35 @@ class Board {
   }
 
   void MakeMove(int move_x);
+  // Takes back the last move, which was in column 'move_x'.
   void UndoMove(int move_x);
 
   Color color(int x, int y) const {
-    unsigned i = x * 6 + y;
-    int byte = i / 4;
-    int offset = 2 * (i % 4);
-    const int val = (data_[byte] >> offset) & 3;
-#ifndef NDEBUG
-    if (val == 3 || byte > 10) {
-      std::cerr << "Invalid bytes: i=" << i << " val=" << val << "\n";
-      abort();
+    const uint64_t bit = Bit(x, y);
+    if ((mask_ & bit) == 0) {
+      return Color::kEmpty;
     }
-#endif
-    return static_cast<Color>(val);
+    return (position_ & bit) != 0 ? turn_ : OtherColor(turn_);
   }
 
+  // Pieces of the player to move, and all pieces.
+  uint64_t position() const { return position_; }
+  uint64_t mask() const { return mask_; }
+  // Unique for each position, turn included.
+  uint64_t key() const { return position_ + mask_; }
+  // The same for a position and its mirror image.
+  uint64_t canonical_key() const;
+
   Board GetFlipped() const;
 
+  // Whether 'pieces' has four in a row.
+  static bool HasFour(uint64_t pieces);
+
+  static uint64_t Bit(int x, int y) { return uint64_t{1} << (7 * x + y); }
+  static uint64_t ColumnMask(int x) { return uint64_t{0x3f} << (7 * x); }
+  static uint64_t BottomMask(int x) { return Bit(x, 0); }
+  static uint64_t TopMask(int x) { return Bit(x, kHeight - 1); }
+
   static constexpr int kNumDirs = 4;
   static int dx(int dir);
   static int dy(int dir);
@@ -112,38 +133,20 @@ class Board {
   static const std::vector<std::pair<int, int>>& start_pos_list(int dir);
 
   friend bool operator==(const Board& a, const Board& b) {
-    // Turn, result, and valid moves are functions of board data.
-    return memcmp(a.data_, b.data_, sizeof(a.data_)) == 0;
+    // Turn, result, and valid moves are functions of the pieces.
+    return a.position_ == b.position_ && a.mask_ == b.mask_;
   }
   friend bool operator!=(const Board& a, const Board& b) { return !(a == b); }
 
  private:
-  template <typename H>
-  friend H AbslHashValue(H h, const Board& b);
-
-  void RedoMoves();
-
-  void SetColor(int x, int y, Color c) {
-    unsigned i = x * 6 + y;
-    int byte = i / 4;
-    int offset = 2 * (i % 4);
-    assert(byte < 11);
-    // Clear:
-    data_[byte] &= ~(3 << offset);
-    // Set:
-    data_[byte] |= (static_cast<uint8_t>(c) << offset);
-  }
-
-  // 2 * 42 = 84 / 8 = 10.5.
-  uint8_t data_[11] = {};
+  uint64_t position_ = 0;
+  uint64_t mask_ = 0;
   uint8_t ply_ = 0;
   bool is_over_ = false;
-  uint8_t valid_moves_;
   Color turn_ = Color::kOne;
   Color result_ = Color::kEmpty;
 };
-static_assert(sizeof(Board) == 16);
-static_assert(alignof(Board) == 1);
+static_assert(sizeof(Board) == 24);
 
 void PrintBoard(std::ostream& out, const Board& b, const char* one,
                 const char* two);
@@ -162,8 +165,8 @@ std::ostream& operator<<(std::ostream& out, const Prediction& p);
 
 template <typename H>
 H AbslHashValue(H h, const Board& b) {
-  // Turn, result, and valid moves are functions of board data.
-  return H::combine_contiguous(std::move(h), b.data_, 11);
+  // Turn, result, and valid moves are functions of the pieces.
+  return H::combine(std::move(h), b.key());
 }
 
 }  // namespace c4cc
@@ -0,0 +1,147 @@
+#include "c4cc/board.h"
+
+#include <random>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+namespace c4cc {
+namespace {
+
+Board Play(const std::vector<int>& moves) {
+  Board b;
+  for (int m : moves) {
+    b.MakeMove(m);
+  }
+  return b;
+}
+
+// Four in a row for 'c' anywhere, by walking the cells.
+bool SlowHasFour(const Board& b, Color c) {
+  const int kDX[4] = {0, 1, 1, 1};
+  const int kDY[4] = {1, 0, 1, -1};
+  for (int x = 0; x < 7; ++x) {
+    for (int y = 0; y < 6; ++y) {
+      for (int d = 0; d < 4; ++d) {
+        int n = 0;
+        while (n < 4) {
+          const int xx = x + n * kDX[d];
+          const int yy = y + n * kDY[d];
+          if (xx >= 7 || yy < 0 || yy >= 6 || b.color(xx, yy) != c) {
+            break;
+          }
+          ++n;
+        }
+        if (n == 4) {
+          return true;
+        }
+      }
+    }
+  }
+  return false;
+}
+
+TEST(BoardTest, Wins) {
+  // Vertical.
+  Board b = Play({0, 1, 0, 1, 0, 1, 0});
+  EXPECT_TRUE(b.is_over());
+  EXPECT_EQ(b.result(), Color::kOne);
+  // Horizontal.
+  b = Play({0, 0, 1, 1, 2, 2, 3});
+  EXPECT_TRUE(b.is_over());
+  EXPECT_EQ(b.result(), Color::kOne);
+  // Diagonal up, won by the second player.
+  b = Play({6, 0, 1, 1, 2, 3, 2, 2, 3, 3, 6, 3});
+  EXPECT_TRUE(b.is_over());
+  EXPECT_EQ(b.result(), Color::kTwo);
+  // Diagonal down.
+  b = Play({6, 3, 2, 2, 1, 1, 0, 1, 0, 0, 6, 0});
+  EXPECT_TRUE(b.is_over());
+  EXPECT_EQ(b.result(), Color::kTwo);
+  // Three in a row.
+  b = Play({0, 6, 1, 6, 2, 5});
+  EXPECT_FALSE(b.is_over());
+}
+
+TEST(BoardTest, Draw) {
+  const std::vector<int> moves = {0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 1, 1, 2, 2,
+                                  2, 2, 2, 2, 4, 3, 3, 3, 3, 3, 3, 4, 4, 4,
+                                  4, 4, 5, 5, 5, 5, 5, 5, 6, 6, 6, 6, 6, 6};
+  Board b;
+  for (int m : moves) {
+    ASSERT_FALSE(b.is_over());
+    b.MakeMove(m);
+  }
+  EXPECT_TRUE(b.is_over());
+  EXPECT_EQ(b.result(), Color::kEmpty);
+  EXPECT_EQ(b.ply(), 42);
+  EXPECT_EQ(b.valid_moves().size(), 0);
+}
+
+TEST(BoardTest, ColorsAndHeights) {
+  const Board b = Play({3, 3, 4});
+  EXPECT_EQ(b.turn(), Color::kTwo);
+  EXPECT_EQ(b.color(3, 0), Color::kOne);
+  EXPECT_EQ(b.color(3, 1), Color::kTwo);
+  EXPECT_EQ(b.color(4, 0), Color::kOne);
+  EXPECT_EQ(b.color(3, 2), Color::kEmpty);
+  EXPECT_EQ(b.height(3), 2);
+  EXPECT_EQ(b.height(0), 0);
+  EXPECT_EQ(b.ply(), 3);
+}
+
+TEST(BoardTest, FullColumnIsNotValid) {
+  const Board b = Play({3, 3, 3, 3, 3, 3});
+  EXPECT_FALSE(b.can_play(3));
+  const MoveList moves = b.valid_moves();
+  EXPECT_EQ(moves.size(), 6);
+  for (int m : moves) {
+    EXPECT_NE(m, 3);
+  }
+}
+
+TEST(BoardTest, FlippedAndKeys) {
+  const Board b = Play({0, 1, 1});
+  const Board f = b.GetFlipped();
+  EXPECT_EQ(f, Play({6, 5, 5}));
+  EXPECT_EQ(f.GetFlipped(), b);
+  EXPECT_EQ(f.turn(), b.turn());
+  EXPECT_NE(b.key(), f.key());
+  EXPECT_EQ(b.canonical_key(), f.canonical_key());
+  // The same pieces with the other player to move.
+  EXPECT_NE(Play({0, 1}).key(), Play({1, 0}).key());
+  EXPECT_EQ(Play({0, 1, 2}).key(), Play({2, 1, 0}).key());
+}
+
+TEST(BoardTest, RandomGames) {
+  std::mt19937 rand(1);
+  for (int game = 0; game < 1000; ++game) {
+    Board b;
+    std::vector<int> moves;
+    std::vector<Board> history;
+    while (!b.is_over()) {
+      const MoveList valid = b.valid_moves();
+      ASSERT_GT(valid.size(), 0);
+      const int m = valid[rand() % valid.size()];
+      history.push_back(b);
+      moves.push_back(m);
+      const Color mover = b.turn();
+      b.MakeMove(m);
+      ASSERT_EQ(b.is_over() && b.result() == mover, SlowHasFour(b, mover))
+          << b;
+    }
+    // Take all moves back.
+    while (!moves.empty()) {
+      b.UndoMove(moves.back());
+      moves.pop_back();
+      ASSERT_EQ(b, history.back());
+      ASSERT_EQ(b.turn(), history.back().turn());
+      ASSERT_EQ(b.ply(), history.back().ply());
+      ASSERT_FALSE(b.is_over());
+      history.pop_back();
+    }
+  }
+}
+
+}  // namespace
+}  // namespace c4cc
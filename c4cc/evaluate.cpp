@@ -8,6 +8,7 @@
 
 #include "c4cc/mcts_player.h"
 #include "c4cc/model.h"
+#include "c4cc/opening_book.h"
 #include "c4cc/play_game.h"
 #include "tensorflow/core/platform/env.h"
 #include "tensorflow/core/platform/init_main.h"
@@ -20,7 +21,11 @@ namespace {
 
 const int games = 400;
 
-int GetScore(Model* m1, Model* m2, PredictionCache* c1, PredictionCache* c2) {
+// Written by opening_book_gen. Openings in it are played without searching.
+constexpr char kOpeningBookPath[] = "/mnt/tensor-data/c4cc/opening_book";
+
+int GetScore(Model* m1, Model* m2, PredictionCache* c1, PredictionCache* c2,
+             const OpeningBook* book) {
   const int iters = 400;
   PredictionQueue q1(m1);
   PredictionQueue q2(m2);
@@ -31,6 +36,8 @@ int GetScore(Model* m1, Model* m2, PredictionCache* c1, PredictionCache* c2) {
   const auto play_game = [&](int g) {
     MCTSPlayer p1(&q1, iters, nullptr);
     MCTSPlayer p2(&q2, iters, nullptr);
+    p1.set_book(book);
+    p2.set_book(book);
 
     Color p1_color;
     Board board;
@@ -78,6 +85,12 @@ void Go(int argc, char** argv) {
   }
   LOG(INFO) << "next gen: " << next_gen;
 
+  const std::unique_ptr<OpeningBook> book =
+      OpeningBook::Open(kOpeningBookPath);
+  if (book == nullptr) {
+    LOG(WARNING) << "No opening book at " << kOpeningBookPath;
+  }
+
   auto last = CreateDefaultModel(false, next_gen - 1);
   PredictionCache last_cache;
   PredictionCache current_cache;
@@ -86,7 +99,8 @@ void Go(int argc, char** argv) {
   const int promo_score = 0.55 * 2 * games;
   while (true) {
     const int score =
-        GetScore(current.get(), last.get(), &current_cache, &last_cache);
+        GetScore(current.get(), last.get(), &current_cache, &last_cache,
+                 book.get());
     LOG(INFO) << "Score: " << score;
     if (score > promo_score) {
       LOG(INFO) << "PROMO";
@@ -16,7 +16,8 @@ MCTSPlayer::MCTSPlayer(generic::PredictionQueue* queue, int iters, bool hard)
     : queue_(queue),
       hard_(hard),
       iters_per_move_(iters),
-      mcts_(std::make_unique<generic::MCTS>(MakeGenericBoard(Board()))) {
+      mcts_(std::make_unique<generic::MCTS>(MakeGenericBoard(Board()),
+                                            /*transpositions=*/true)) {
   rand_.seed(time(0) ^ reinterpret_cast<intptr_t>(this));
 }
 
@@ -43,6 +44,10 @@ void MCTSPlayer::RunIterations(int n) {
   };
 
   for (int iter = 0; iter < n; ++iter) {
+    if (mcts_->root_proof() != generic::MCTS::Proof::kUnknown) {
+      // Solved, more iterations would not change anything.
+      break;
+    }
     auto pred_req = mcts_->StartIteration();
     if (pred_req != nullptr) {
       pred_reqs.emplace_back();
@@ -112,6 +117,10 @@ Prediction MCTSPlayer::GetPrediction() {
   if (pred_ready_) {
     return current_pred_;
   }
+  if (SetBookPrediction()) {
+    pred_ready_ = true;
+    return current_pred_;
+  }
   RunIterations(iters_per_move_);
   generic::PredictionResult gen_pred = mcts_->GetPrediction();
   current_pred_.value = gen_pred.value;
@@ -125,6 +134,28 @@ Prediction MCTSPlayer::GetPrediction() {
   return current_pred_;
 }
 
+bool MCTSPlayer::SetBookPrediction() {
+  if (book_ == nullptr) {
+    return false;
+  }
+  const std::vector<int> best = book_->BestMoves(board_);
+  if (best.empty()) {
+    return false;
+  }
+  // The result of the best moves, for the player making them.
+  Board child = board_;
+  child.MakeMove(best.front());
+  const int result = -*book_->Probe(child);
+  current_pred_.value = result > 0 ? 1.0 : (result < 0 ? -1.0 : 0.0);
+  for (int i = 0; i < 7; ++i) {
+    current_pred_.move_p[i] = 0;
+  }
+  for (const int move : best) {
+    current_pred_.move_p[move] = 1.0 / best.size();
+  }
+  return true;
+}
+
 void MCTSPlayer::MakeMove(int move) {
   mcts_->MakeMove(move);
   board_.MakeMove(move);
@@ -4,6 +4,7 @@
 #include <random>
 
 #include "c4cc/board.h"
+#include "c4cc/opening_book.h"
 #include "c4cc/play_game.h"
 #include "generic/mcts.h"
 #include "generic/prediction_queue.h"
@@ -22,15 +23,24 @@ class MCTSPlayer : public Player {
   int GetMove() override;
   void MakeMove(int move) override;
 
+  // Positions covered by 'book' aren't searched: their prediction is the
+  // book's result, with the policy split evenly over its best moves. May be
+  // null; 'book' must outlive this.
+  void set_book(const OpeningBook* book) { book_ = book; }
+
   Prediction GetPrediction();
 
   void LogStats();
 
  private:
   void RunIterations(int n);
+  // Sets current_pred_ from the book. Returns false if the board isn't
+  // covered.
+  bool SetBookPrediction();
 
   generic::PredictionQueue* const queue_;
   const bool hard_;
+  const OpeningBook* book_ = nullptr;
 
   Board board_;
   const int iters_per_move_;
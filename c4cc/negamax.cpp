@@ -110,4 +110,14 @@ NegamaxResult Negamax(const Board& b, int depth) {
   return NRec(copy, depth, -kWinScore - 100, kWinScore + 100);
 }
 
+int NegamaxPlayer::GetMove() {
+  if (book_ != nullptr) {
+    const std::vector<int> best = book_->BestMoves(current_board_);
+    if (!best.empty()) {
+      return best.front();
+    }
+  }
+  return Negamax(current_board_, depth_).best_move;
+}
+
 }  // namespace c4cc
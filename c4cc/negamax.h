@@ -2,6 +2,7 @@
 #define _C4CC_NEGAMAX_H_
 
 #include "c4cc/board.h"
+#include "c4cc/opening_book.h"
 #include "c4cc/play_game.h"
 
 namespace c4cc {
@@ -23,11 +24,17 @@ class NegamaxPlayer : public Player {
   const Board& board() const override { return current_board_; }
   void SetBoard(const Board& b) override { current_board_ = b; }
   void MakeMove(int move) override { current_board_.MakeMove(move); }
-  int GetMove() override { return Negamax(current_board_, depth_).best_move; }
+  int GetMove() override;
+
+  // Positions covered by 'book' are played from it, with the most central of
+  // the best moves, instead of searched. May be null; 'book' must outlive
+  // this.
+  void set_book(const OpeningBook* book) { book_ = book; }
 
  private:
   // TODO: Implement caching and stuff.
   int depth_;
+  const OpeningBook* book_ = nullptr;
   Board current_board_;
 };
 
@@ -0,0 +1,180 @@
+#include "c4cc/opening_book.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <thread>
+
+#include "absl/container/flat_hash_set.h"
+#include "c4cc/perfect_negamax.h"
+
+namespace c4cc {
+
+namespace {
+
+// Book files start with this header, followed by the entries: the canonical
+// key of a position shifted left by 8, with its result as an int8 below.
+// Sorting entries thus sorts the keys.
+struct Header {
+  char magic[8];
+  uint32_t version;
+  uint32_t max_ply;
+  uint64_t num_positions;
+};
+static_assert(sizeof(Header) == 24);
+
+constexpr char kMagic[8] = "C4CBOOK";
+// Version 2 scores wins as 43 minus the winning ply, not 42.
+constexpr uint32_t kVersion = 2;
+
+constexpr int kNumCells = Board::kWidth * Board::kHeight;
+constexpr int kColumnOrder[Board::kWidth] = {3, 2, 4, 1, 5, 0, 6};
+
+uint64_t MakeEntry(uint64_t key, int result) {
+  return (key << 8) | static_cast<uint8_t>(static_cast<int8_t>(result));
+}
+
+int EntryResult(uint64_t entry) {
+  return static_cast<int8_t>(static_cast<uint8_t>(entry));
+}
+
+// Adds the unfinished positions reachable from 'b' with at most 'max_ply'
+// pieces, which are not in 'seen' yet.
+void AddPositions(Board& b, int max_ply, absl::flat_hash_set<uint64_t>* seen,
+                  std::vector<Board>* positions) {
+  if (b.is_over() || b.ply() > max_ply ||
+      !seen->insert(b.canonical_key()).second) {
+    return;
+  }
+  positions->push_back(b);
+  for (int m : b.valid_moves()) {
+    b.MakeMove(m);
+    AddPositions(b, max_ply, seen, positions);
+    b.UndoMove(m);
+  }
+}
+
+}  // namespace
+
+OpeningBook::OpeningBook(std::unique_ptr<util::MappedFile> file, int max_ply)
+    : file_(std::move(file)),
+      max_ply_(max_ply),
+      entries_(reinterpret_cast<const uint64_t*>(file_->data() +
+                                                 sizeof(Header))),
+      num_entries_((file_->size() - sizeof(Header)) / sizeof(uint64_t)) {}
+
+std::unique_ptr<OpeningBook> OpeningBook::Open(const std::string& path) {
+  auto file = util::MappedFile::Open(path);
+  if (file == nullptr || file->size() < sizeof(Header)) {
+    return nullptr;
+  }
+  Header header;
+  std::memcpy(&header, file->data(), sizeof(header));
+  if (std::memcmp(header.magic, kMagic, sizeof(kMagic)) != 0 ||
+      header.version != kVersion ||
+      header.max_ply > kNumCells ||
+      file->size() !=
+          sizeof(Header) + header.num_positions * sizeof(uint64_t)) {
+    return nullptr;
+  }
+  return std::unique_ptr<OpeningBook>(
+      new OpeningBook(std::move(file), header.max_ply));
+}
+
+absl::optional<int> OpeningBook::Probe(const Board& b) const {
+  if (b.is_over()) {
+    // The previous player won, if anyone.
+    return b.result() == Color::kEmpty ? 0 : b.ply() - (kNumCells + 1);
+  }
+  if (b.ply() > max_ply_) {
+    return absl::nullopt;
+  }
+  const uint64_t key = b.canonical_key();
+  const uint64_t* const end = entries_ + num_entries_;
+  const uint64_t* it = std::lower_bound(entries_, end, key << 8);
+  if (it == end || (*it >> 8) != key) {
+    return absl::nullopt;
+  }
+  return EntryResult(*it);
+}
+
+std::vector<int> OpeningBook::BestMoves(const Board& b) const {
+  std::vector<int> best;
+  if (b.is_over() || b.ply() >= max_ply_) {
+    return best;
+  }
+  int best_result = 0;
+  for (int x : kColumnOrder) {
+    if (!b.can_play(x)) {
+      continue;
+    }
+    Board child = b;
+    child.MakeMove(x);
+    const absl::optional<int> r = Probe(child);
+    if (!r.has_value()) {
+      return {};
+    }
+    if (best.empty() || -*r > best_result) {
+      best.clear();
+      best_result = -*r;
+    }
+    if (-*r == best_result) {
+      best.push_back(x);
+    }
+  }
+  return best;
+}
+
+bool GenerateOpeningBook(const Board& start, int max_ply, int num_threads,
+                         const std::string& path) {
+  std::vector<Board> positions;
+  {
+    absl::flat_hash_set<uint64_t> seen;
+    Board b = start;
+    AddPositions(b, max_ply, &seen, &positions);
+  }
+  std::cerr << "Solving " << positions.size() << " positions\n";
+
+  std::vector<uint64_t> entries(positions.size());
+  std::atomic<size_t> next{0};
+  std::atomic<size_t> num_done{0};
+  const auto solve = [&] {
+    PerfectCache cache;
+    for (size_t i = next++; i < positions.size(); i = next++) {
+      const Board& b = positions[i];
+      entries[i] = MakeEntry(b.canonical_key(), Solve(b, &cache));
+      if (++num_done % 10000 == 0) {
+        std::cerr << "Solved " << num_done << "/" << positions.size()
+                  << " positions\n";
+      }
+    }
+  };
+  std::vector<std::thread> threads;
+  for (int i = 0; i < num_threads; ++i) {
+    threads.emplace_back(solve);
+  }
+  for (auto& t : threads) {
+    t.join();
+  }
+  std::sort(entries.begin(), entries.end());
+
+  Header header = {};
+  std::memcpy(header.magic, kMagic, sizeof(kMagic));
+  header.version = kVersion;
+  header.max_ply = max_ply;
+  header.num_positions = entries.size();
+  std::ofstream out(path, std::ios::binary);
+  out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+  out.write(reinterpret_cast<const char*>(entries.data()),
+            entries.size() * sizeof(uint64_t));
+  out.close();
+  if (!out) {
+    std::cerr << "Failed to write " << path << "\n";
+    return false;
+  }
+  return true;
+}
+
+}  // namespace c4cc
@@ -0,0 +1,55 @@
+#ifndef _C4CC_OPENING_BOOK_H_
+#define _C4CC_OPENING_BOOK_H_
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "absl/types/optional.h"
+#include "c4cc/board.h"
+#include "util/mapped_file.h"
+
+namespace c4cc {
+
+// Exact results of all positions up to some ply, as found by Solve(). The
+// book is a file of entries sorted by canonical key, memory mapped and binary
+// searched, so opening one is instant and processes share its pages.
+//
+// This class is thread-safe.
+class OpeningBook {
+ public:
+  // Returns null if 'path' is not a valid book.
+  static std::unique_ptr<OpeningBook> Open(const std::string& path);
+
+  // Positions with at most this many pieces are covered.
+  int max_ply() const { return max_ply_; }
+  int64_t num_positions() const { return num_entries_; }
+
+  // Result of 'b' in the scale of Solve(), or nullopt if it's not covered.
+  // Finished games are always covered.
+  absl::optional<int> Probe(const Board& b) const;
+
+  // The moves of 'b' with the best result, from the center outwards. Empty
+  // if 'b' is over, or if its moves are not all covered.
+  std::vector<int> BestMoves(const Board& b) const;
+
+ private:
+  OpeningBook(std::unique_ptr<util::MappedFile> file, int max_ply);
+
+  const std::unique_ptr<util::MappedFile> file_;
+  const int max_ply_;
+  const uint64_t* entries_;
+  int64_t num_entries_;
+};
+
+// Solves all positions reachable from 'start' with at most 'max_ply' pieces,
+// mirror images only once, on 'num_threads' threads, and writes them as a
+// book to 'path'. Returns false on failure. From the empty board, takes hours
+// for max_ply above 8.
+bool GenerateOpeningBook(const Board& start, int max_ply, int num_threads,
+                         const std::string& path);
+
+}  // namespace c4cc
+
+#endif
@@ -0,0 +1,36 @@
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "absl/flags/flag.h"
+#include "absl/flags/parse.h"
+#include "absl/time/clock.h"
+#include "absl/time/time.h"
+#include "c4cc/opening_book.h"
+
+ABSL_FLAG(int, max_ply, 8,
+          "Positions with at most this many pieces are solved.");
+ABSL_FLAG(int, threads, std::thread::hardware_concurrency(),
+          "Number of solver threads. Each takes about 40 MB.");
+
+int main(int argc, char** argv) {
+  const std::vector<char*> args = absl::ParseCommandLine(argc, argv);
+  if (args.size() != 2) {
+    std::cerr << "Usage: " << args[0]
+              << " [--max_ply=N] [--threads=N] output_file\n";
+    return 1;
+  }
+  const int max_ply = absl::GetFlag(FLAGS_max_ply);
+  const int threads = absl::GetFlag(FLAGS_threads);
+  if (max_ply < 0 || max_ply > 42 || threads < 1) {
+    std::cerr << "Invalid --max_ply or --threads\n";
+    return 1;
+  }
+  const absl::Time start = absl::Now();
+  if (!c4cc::GenerateOpeningBook(c4cc::Board(), max_ply, threads, args[1])) {
+    return 1;
+  }
+  std::cout << "Wrote " << args[1] << " in " << absl::Now() - start << "\n";
+  return 0;
+}
@@ -0,0 +1,144 @@
+#include "c4cc/opening_book.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <random>
+#include <string>
+
+#include "c4cc/perfect_negamax.h"
+#include "gtest/gtest.h"
+
+namespace c4cc {
+namespace {
+
+std::string TempPath(const std::string& name) {
+  const char* dir = getenv("TEST_TMPDIR");
+  return std::string(dir != nullptr ? dir : "/tmp") + "/" + name;
+}
+
+// Plays random moves until 'ply' pieces are on the board.
+Board RandomBoard(std::mt19937& rand, int ply) {
+  while (true) {
+    Board b;
+    while (!b.is_over() && b.ply() < ply) {
+      const MoveList moves = b.valid_moves();
+      b.MakeMove(moves[rand() % moves.size()]);
+    }
+    if (!b.is_over()) {
+      return b;
+    }
+  }
+}
+
+class OpeningBookTest : public testing::Test {
+ protected:
+  // Positions from a late start, so that they are quick to solve.
+  static constexpr int kStartPly = 20;
+  static constexpr int kMaxPly = 26;
+
+  static void SetUpTestSuite() {
+    std::mt19937 rand(1);
+    start_ = new Board(RandomBoard(rand, kStartPly));
+    path_ = new std::string(TempPath("opening_book_test"));
+    ASSERT_TRUE(GenerateOpeningBook(*start_, kMaxPly, 2, *path_));
+    cache_ = new PerfectCache();
+  }
+  static void TearDownTestSuite() {
+    std::remove(path_->c_str());
+    delete start_;
+    delete path_;
+    delete cache_;
+  }
+
+  static Board* start_;
+  static std::string* path_;
+  static PerfectCache* cache_;
+};
+
+Board* OpeningBookTest::start_ = nullptr;
+std::string* OpeningBookTest::path_ = nullptr;
+PerfectCache* OpeningBookTest::cache_ = nullptr;
+
+TEST_F(OpeningBookTest, MatchesSolver) {
+  auto book = OpeningBook::Open(*path_);
+  ASSERT_NE(book, nullptr);
+  EXPECT_EQ(book->max_ply(), kMaxPly);
+  EXPECT_GT(book->num_positions(), 0);
+  std::mt19937 rand(2);
+  for (int i = 0; i < 200; ++i) {
+    Board b = *start_;
+    const int ply = kStartPly + rand() % (kMaxPly - kStartPly + 1);
+    while (!b.is_over() && b.ply() < ply) {
+      const MoveList moves = b.valid_moves();
+      b.MakeMove(moves[rand() % moves.size()]);
+    }
+    const absl::optional<int> result = book->Probe(b);
+    ASSERT_TRUE(result.has_value()) << b;
+    EXPECT_EQ(*result, Solve(b, cache_)) << b;
+    // Mirror images are covered too.
+    EXPECT_EQ(book->Probe(b.GetFlipped()), result) << b;
+
+    if (b.is_over() || b.ply() == kMaxPly) {
+      continue;
+    }
+    int scores[7];
+    SolveMoves(b, cache_, scores);
+    const int best = *std::max_element(scores, scores + 7);
+    const std::vector<int> best_moves = book->BestMoves(b);
+    ASSERT_FALSE(best_moves.empty()) << b;
+    for (int x = 0; x < 7; ++x) {
+      const bool is_best = scores[x] == best;
+      EXPECT_EQ(is_best, std::find(best_moves.begin(), best_moves.end(), x) !=
+                             best_moves.end())
+          << b;
+    }
+  }
+}
+
+TEST_F(OpeningBookTest, NotCovered) {
+  auto book = OpeningBook::Open(*path_);
+  ASSERT_NE(book, nullptr);
+  // Too many pieces.
+  std::mt19937 rand(3);
+  Board b = *start_;
+  while (b.ply() <= kMaxPly) {
+    const MoveList moves = b.valid_moves();
+    b.MakeMove(moves[rand() % moves.size()]);
+    if (b.is_over()) {
+      b = *start_;
+    }
+  }
+  EXPECT_FALSE(book->Probe(b).has_value());
+  // Not reachable from the start.
+  EXPECT_FALSE(book->Probe(Board()).has_value());
+  EXPECT_TRUE(book->BestMoves(Board()).empty());
+}
+
+TEST_F(OpeningBookTest, WinWithLastPiece) {
+  auto book = OpeningBook::Open(*path_);
+  ASSERT_NE(book, nullptr);
+  // The second player completes the top row with the 42nd piece. Finished
+  // games are covered at any ply, and the win doesn't score as a draw.
+  Board b;
+  for (int x : {0, 3, 2, 2, 2, 5, 5, 6, 4, 3, 1, 2, 4, 4, 3, 4, 2, 5, 5, 0, 6,
+                3, 4, 5, 3, 5, 2, 3, 6, 0, 0, 4, 1, 1, 6, 0, 1, 1, 0, 6, 1,
+                6}) {
+    b.MakeMove(x);
+  }
+  ASSERT_EQ(b.result(), Color::kTwo);
+  EXPECT_EQ(book->Probe(b), -1);
+  EXPECT_EQ(book->Probe(b), Solve(b, cache_));
+}
+
+TEST(OpeningBookFileTest, InvalidFiles) {
+  EXPECT_EQ(OpeningBook::Open(TempPath("opening_book_missing")), nullptr);
+  const std::string path = TempPath("opening_book_invalid");
+  std::ofstream(path, std::ios::binary) << "not a book at all, no";
+  EXPECT_EQ(OpeningBook::Open(path), nullptr);
+  std::remove(path.c_str());
+}
+
+}  // namespace
+}  // namespace c4cc
@@ -1,55 +1,293 @@
-
 #include "c4cc/perfect_negamax.h"
 
+#include <algorithm>
+#include <cassert>
+#include <cstdlib>
+
 namespace c4cc {
 
 namespace {
 
-int NRec(Board& b, int depth, int32_t alpha, int32_t beta) {
-  if (b.is_over()) {
-    const Color r = b.result();
-    if (r == Color::kEmpty) {
-      return 0;
+constexpr int kNumCells = Board::kWidth * Board::kHeight;
+// Results are 'kWinPly' minus the ply of the winning move, so that even a win
+// with the last piece is non-zero.
+constexpr int kWinPly = kNumCells + 1;
+// Scores in the search are counted in moves of the player to move: 1 if they
+// win with their last piece, 2 with the one before, and negative if the
+// opponent wins. They are converted to plies only in Solve().
+constexpr int kMinScore = -kNumCells / 2 + 3;
+constexpr int kMaxScore = (kNumCells + 1) / 2 - 3;
+
+// Bottom cell of every column.
+constexpr uint64_t kBottomRow = 0x40810204081ull;
+// All cells, without the sentinels.
+constexpr uint64_t kBoardMask = kBottomRow * 0x3f;
+
+constexpr int kColumnOrder[Board::kWidth] = {3, 2, 4, 1, 5, 0, 6};
+
+// Empty cells which would complete four in a row of 'pieces'.
+uint64_t WinningCells(uint64_t pieces, uint64_t mask) {
+  // Vertical.
+  uint64_t r = (pieces << 1) & (pieces << 2) & (pieces << 3);
+  // Horizontal and the two diagonals.
+  for (int shift : {7, 6, 8}) {
+    uint64_t p = (pieces << shift) & (pieces << (2 * shift));
+    r |= p & (pieces << (3 * shift));
+    r |= p & (pieces >> shift);
+    p = (pieces >> shift) & (pieces >> (2 * shift));
+    r |= p & (pieces << shift);
+    r |= p & (pieces >> (3 * shift));
+  }
+  return r & (kBoardMask ^ mask);
+}
+
+uint64_t Mirror(uint64_t b) {
+  uint64_t m = 0;
+  for (int x = 0; x < Board::kWidth; ++x) {
+    m |= ((b >> (7 * x)) & 0x7f) << (7 * (Board::kWidth - 1 - x));
+  }
+  return m;
+}
+
+// The part of Board needed by the search. Moves are single bits: the cell
+// where the piece lands.
+struct Position {
+  explicit Position(const Board& b)
+      : current(b.position()), mask(b.mask()), moves(b.ply()) {}
+
+  // Cells where a piece can be played.
+  uint64_t Possible() const { return (mask + kBottomRow) & kBoardMask; }
+  bool CanWinNext() const {
+    return (WinningCells(current, mask) & Possible()) != 0;
+  }
+  // Moves which don't let the opponent win on their next move: those
+  // blocking their immediate threat, if any, and not under their threats.
+  // Must not be called if CanWinNext().
+  uint64_t NonLosingMoves() const {
+    uint64_t possible = Possible();
+    const uint64_t opponent_wins = WinningCells(current ^ mask, mask);
+    const uint64_t forced = possible & opponent_wins;
+    if (forced != 0) {
+      if ((forced & (forced - 1)) != 0) {
+        // Two threats, can't block both.
+        return 0;
+      }
+      possible = forced;
     }
-    if (b.result() == b.turn()) {
-      return 42 - b.ply();
-    } else {
-      return -42 + b.ply();
+    return possible & ~(opponent_wins >> 1);
+  }
+  // Number of threats after 'move', for ordering moves.
+  int MoveScore(uint64_t move) const {
+    return __builtin_popcountll(WinningCells(current | move, mask));
+  }
+  void Play(uint64_t move) {
+    current ^= mask;
+    mask |= move;
+    ++moves;
+  }
+  uint64_t Key() const {
+    return std::min(current + mask, Mirror(current) + Mirror(mask));
+  }
+
+  uint64_t current;
+  uint64_t mask;
+  int moves;
+};
+
+// Moves sorted by score, highest first. Among equal scores, the last added
+// comes first.
+class MoveSorter {
+ public:
+  void Add(uint64_t move, int score) {
+    int pos = size_++;
+    for (; pos > 0 && entries_[pos - 1].score > score; --pos) {
+      entries_[pos] = entries_[pos - 1];
     }
+    entries_[pos] = {move, score};
   }
-  if (depth == 0) {
-    return kNoPerfectResult;
+  // Returns 0 when there are no more moves.
+  uint64_t Next() { return size_ > 0 ? entries_[--size_].move : 0; }
+
+ private:
+  struct Entry {
+    uint64_t move;
+    int score;
+  };
+  int size_ = 0;
+  Entry entries_[Board::kWidth];
+};
+
+// Table values: upper bounds are stored as 1 + score - kMinScore, lower
+// bounds above them.
+constexpr int kLowerBoundOffset = kMaxScore - 2 * kMinScore + 2;
+
+// Score of 'p' if it's in [alpha, beta], otherwise a bound beyond the window.
+// The player to move can't win right away.
+int Negamax(const Position& p, int alpha, int beta, PerfectCache* cache) {
+  assert(alpha < beta);
+  const uint64_t next = p.NonLosingMoves();
+  if (next == 0) {
+    // The opponent wins with their next piece.
+    return -(kNumCells - p.moves) / 2;
   }
-  int32_t best = -42;
-  // std::cout << "num moves: " << b.valid_moves().size() << "\n";
-  const MoveList moves = b.valid_moves();
-  for (int m : moves) {
-    b.MakeMove(m);
-    const int r = NRec(b, depth - 1, -beta, -alpha);
-    if (r == kNoPerfectResult) {
-      // Bail out, not enough depth to get a perfect result.
-      return kNoPerfectResult;
-    }
-    const int32_t eval_for_me = -r;
-    //     std::cout << "depth=" << depth << " score for " << m << ": " <<
-    //     eval_for_me
-    //               << "\n";
-    b.UndoMove(m);
-    if (eval_for_me > best) {
-      best = eval_for_me;
-    }
-    alpha = std::max(alpha, best);
+  if (p.moves >= kNumCells - 2) {
+    // Neither can win with the last two pieces.
+    return 0;
+  }
+  // The opponent can't win with their next piece.
+  const int min = -(kNumCells - 2 - p.moves) / 2;
+  if (alpha < min) {
+    alpha = min;
     if (alpha >= beta) {
-      break;
+      return alpha;
     }
   }
-  return best;
+  // We can't win with our next piece.
+  int max = (kNumCells - 1 - p.moves) / 2;
+  const uint64_t key = p.Key();
+  if (const int value = cache->Get(key)) {
+    if (value >= kLowerBoundOffset + kMinScore) {
+      const int lower = value - kLowerBoundOffset;
+      if (alpha < lower) {
+        alpha = lower;
+        if (alpha >= beta) {
+          return alpha;
+        }
+      }
+    } else {
+      max = value + kMinScore - 1;
+    }
+  }
+  if (beta > max) {
+    beta = max;
+    if (alpha >= beta) {
+      return beta;
+    }
+  }
+
+  MoveSorter moves;
+  for (int i = Board::kWidth - 1; i >= 0; --i) {
+    if (const uint64_t move = next & Board::ColumnMask(kColumnOrder[i])) {
+      moves.Add(move, p.MoveScore(move));
+    }
+  }
+  while (const uint64_t move = moves.Next()) {
+    Position child = p;
+    child.Play(move);
+    const int score = -Negamax(child, -beta, -alpha, cache);
+    if (score >= beta) {
+      // Bounds are clamped to the possible scores, to fit the encoding.
+      cache->Put(key, std::min(score, kMaxScore) + kLowerBoundOffset);
+      return score;
+    }
+    alpha = std::max(alpha, score);
+  }
+  cache->Put(key, std::max(alpha, kMinScore) - kMinScore + 1);
+  return alpha;
+}
+
+// Exact score of 'p', found with null-window searches.
+int SolveScore(const Position& p, PerfectCache* cache) {
+  if (p.CanWinNext()) {
+    return (kNumCells + 1 - p.moves) / 2;
+  }
+  int min = -(kNumCells - p.moves) / 2;
+  int max = (kNumCells + 1 - p.moves) / 2;
+  while (min < max) {
+    int med = min + (max - min) / 2;
+    // Prefer testing scores close to zero first: most positions are near
+    // it, and those searches are faster.
+    if (med <= 0 && min / 2 < med) {
+      med = min / 2;
+    } else if (med >= 0 && max / 2 > med) {
+      med = max / 2;
+    }
+    const int r = Negamax(p, med, med + 1, cache);
+    if (r <= med) {
+      max = r;
+    } else {
+      min = r;
+    }
+  }
+  return min;
+}
+
+// Converts a score in moves of the player to move at 'ply' to plies.
+int ScoreToPlies(int score, int ply) {
+  if (score == 0) {
+    return 0;
+  }
+  // The winner's pieces go at odd plies for the first player, even for the
+  // second. Their n-th last piece is at ply 43 - 2n or 44 - 2n.
+  const bool first_player_wins = (ply % 2 == 0) == (score > 0);
+  const int n = std::abs(score);
+  const int win_ply = first_player_wins ? 43 - 2 * n : 44 - 2 * n;
+  return score > 0 ? kWinPly - win_ply : win_ply - kWinPly;
 }
 
 }  // namespace
 
+PerfectCache::PerfectCache()
+    : keys_(new uint32_t[kSize]), values_(new uint8_t[kSize]) {
+  Clear();
+}
+
+void PerfectCache::Clear() {
+  std::fill_n(keys_.get(), kSize, 0);
+  std::fill_n(values_.get(), kSize, 0);
+}
+
+uint8_t PerfectCache::Get(uint64_t key) const {
+  const size_t i = Index(key);
+  return keys_[i] == static_cast<uint32_t>(key) ? values_[i] : 0;
+}
+
+void PerfectCache::Put(uint64_t key, uint8_t value) {
+  const size_t i = Index(key);
+  keys_[i] = key;
+  values_[i] = value;
+}
+
 int PerfectEval(Board b, int max_depth, PerfectCache* cache) {
-  return NRec(b, max_depth, -50, 50);
+  if (kNumCells - b.ply() > max_depth && !b.is_over()) {
+    return kNoPerfectResult;
+  }
+  return Solve(b, cache);
+}
+
+int Solve(const Board& b, PerfectCache* cache) {
+  if (b.is_over()) {
+    if (b.result() == Color::kEmpty) {
+      return 0;
+    }
+    // The previous player won.
+    return b.ply() - kWinPly;
+  }
+  return ScoreToPlies(SolveScore(Position(b), cache), b.ply());
+}
+
+void SolveMoves(const Board& b, PerfectCache* cache, int scores[7]) {
+  for (int x = 0; x < Board::kWidth; ++x) {
+    if (b.is_over() || !b.can_play(x)) {
+      scores[x] = kNoPerfectResult;
+      continue;
+    }
+    Board child = b;
+    child.MakeMove(x);
+    scores[x] = -Solve(child, cache);
+  }
+}
+
+int PerfectPlayer::GetMove() {
+  int scores[7];
+  SolveMoves(current_board_, &cache_, scores);
+  int best = -1;
+  for (int x : current_board_.valid_moves()) {
+    if (best < 0 || scores[x] > scores[best]) {
+      best = x;
+    }
+  }
+  return best;
 }
 
 }  // namespace c4cc
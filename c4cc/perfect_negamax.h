@@ -1,27 +1,79 @@
 #ifndef _C4CC_PERFECT_NEGAMAX_H_
 #define _C4CC_PERFECT_NEGAMAX_H_
 
+#include <cstdint>
+#include <memory>
+
 #include "c4cc/board.h"
+#include "c4cc/play_game.h"
 
 namespace c4cc {
 
+// Transposition table for Solve(), shared by all searches using it. It's
+// lossy: each position has a single slot, and newer positions overwrite older
+// ones. Mirror images share their entry. Takes about 40 MB.
+//
+// This class is thread-compatible.
 class PerfectCache {
  public:
-  PerfectCache() {}
+  PerfectCache();
+
+  void Clear();
+
+  // Stored value of position 'key', or 0 if none.
+  uint8_t Get(uint64_t key) const;
+  // 'value' must not be 0.
+  void Put(uint64_t key, uint8_t value);
 
  private:
-  // XXX
-  struct HashElem {};
+  // A prime, so that the index and the low 32 bits of a key (of 49 bits)
+  // together identify it.
+  static constexpr uint64_t kSize = (1 << 23) + 9;
+
+  size_t Index(uint64_t key) const { return key % kSize; }
+
+  std::unique_ptr<uint32_t[]> keys_;
+  std::unique_ptr<uint8_t[]> values_;
 };
 
 inline constexpr int kNoPerfectResult = -100;
 
-// Returns 0 if `b` is a draw, 1 if the current player wins with their last
-// piece, -1 if the current player loses on last turn, and so on.
+// Returns 0 if `b` is a draw, 1 if the current player wins with the last
+// piece of the board, -1 if they lose to it, and so on.
 //
-// Returns kNoPerfectResult if no conclusive result is reached in `max_depth`.
+// Returns kNoPerfectResult if the game can last more than `max_depth` more
+// plies.
 int PerfectEval(Board b, int max_depth, PerfectCache* cache);
 
+// The result of 'b' with perfect play, in the same scale as PerfectEval():
+// 43 minus the ply of the winning move, positive if the player to move wins.
+// A win with the 42nd piece is thus 1, not 0 like a draw.
+//
+// The search is alpha-beta negamax with null windows, ordering moves by the
+// threats they make and skipping those which let the opponent win right
+// away. Solving the empty board takes a few minutes.
+int Solve(const Board& b, PerfectCache* cache);
+
+// Sets 'scores' to the result after each move, for the player making it, or
+// to kNoPerfectResult for full columns.
+void SolveMoves(const Board& b, PerfectCache* cache, int scores[7]);
+
+// Plays one of the moves with the best result, preferring central columns.
+class PerfectPlayer : public Player {
+ public:
+  PerfectPlayer() {}
+  ~PerfectPlayer() override {}
+
+  const Board& board() const override { return current_board_; }
+  void SetBoard(const Board& b) override { current_board_ = b; }
+  void MakeMove(int move) override { current_board_.MakeMove(move); }
+  int GetMove() override;
+
+ private:
+  PerfectCache cache_;
+  Board current_board_;
+};
+
 }  // namespace c4cc
 
 #endif
@@ -0,0 +1,134 @@
+#include "c4cc/perfect_negamax.h"
+
+#include <algorithm>
+#include <memory>
+#include <random>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+namespace c4cc {
+namespace {
+
+// Full minimax without pruning, in the scale of Solve().
+int SlowSolve(Board& b) {
+  if (b.is_over()) {
+    return b.result() == Color::kEmpty ? 0 : b.ply() - 43;
+  }
+  int best = -100;
+  for (int m : b.valid_moves()) {
+    b.MakeMove(m);
+    best = std::max(best, -SlowSolve(b));
+    b.UndoMove(m);
+  }
+  return best;
+}
+
+Board Play(const std::vector<int>& moves) {
+  Board b;
+  for (int m : moves) {
+    b.MakeMove(m);
+  }
+  return b;
+}
+
+class PerfectNegamaxTest : public testing::Test {
+ protected:
+  // Shared, as it takes a while to allocate.
+  static void SetUpTestSuite() { cache_ = new PerfectCache(); }
+  static void TearDownTestSuite() { delete cache_; }
+
+  static PerfectCache* cache_;
+};
+
+PerfectCache* PerfectNegamaxTest::cache_ = nullptr;
+
+TEST_F(PerfectNegamaxTest, GameOver) {
+  // The first player won with their fourth piece.
+  const Board b = Play({0, 1, 0, 1, 0, 1, 0});
+  EXPECT_EQ(Solve(b, cache_), 7 - 43);
+}
+
+TEST_F(PerfectNegamaxTest, ImmediateWinAndLoss) {
+  // The first player wins with their next piece, at ply 7.
+  EXPECT_EQ(Solve(Play({0, 1, 0, 1, 0, 1}), cache_), 43 - 7);
+  // Two threats at the bottom row, the second player can't block both.
+  EXPECT_EQ(Solve(Play({1, 6, 2, 6, 3}), cache_), 7 - 43);
+}
+
+TEST_F(PerfectNegamaxTest, WinWithLastPiece) {
+  // The second player completes the top row with the 42nd piece.
+  Board b = Play({0, 3, 2, 2, 2, 5, 5, 6, 4, 3, 1, 2, 4, 4, 3, 4, 2, 5, 5, 0, 6,
+                 3, 4, 5, 3, 5, 2, 3, 6, 0, 0, 4, 1, 1, 6, 0, 1, 1, 0, 6, 1});
+  ASSERT_FALSE(b.is_over());
+  EXPECT_EQ(Solve(b, cache_), 1);
+  b.MakeMove(6);
+  ASSERT_EQ(b.result(), Color::kTwo);
+  EXPECT_EQ(Solve(b, cache_), -1);
+}
+
+TEST_F(PerfectNegamaxTest, SolveMoves) {
+  // Columns 0 to 4 are full.
+  Board b;
+  for (int x : {0, 1, 2}) {
+    for (int i = 0; i < 6; ++i) {
+      b.MakeMove(x);
+    }
+  }
+  for (int x : {4, 3, 3, 3, 3, 3, 3, 4, 4, 4, 4, 4}) {
+    b.MakeMove(x);
+  }
+  ASSERT_FALSE(b.is_over());
+  int scores[7];
+  SolveMoves(b, cache_, scores);
+  for (int x = 0; x < 5; ++x) {
+    EXPECT_EQ(scores[x], kNoPerfectResult);
+  }
+  Board copy = b;
+  EXPECT_EQ(std::max(scores[5], scores[6]), SlowSolve(copy));
+}
+
+TEST_F(PerfectNegamaxTest, MatchesMinimax) {
+  std::mt19937 rand(1);
+  int num_checked = 0;
+  while (num_checked < 200) {
+    // Random positions with 12 or fewer empty cells.
+    Board b;
+    while (!b.is_over() && b.ply() < 30) {
+      const MoveList moves = b.valid_moves();
+      b.MakeMove(moves[rand() % moves.size()]);
+    }
+    if (b.is_over()) {
+      continue;
+    }
+    Board copy = b;
+    ASSERT_EQ(Solve(b, cache_), SlowSolve(copy)) << b;
+    ++num_checked;
+  }
+}
+
+TEST_F(PerfectNegamaxTest, MovesAgreeWithPosition) {
+  std::mt19937 rand(2);
+  for (int i = 0; i < 20; ++i) {
+    Board b;
+    while (!b.is_over() && b.ply() < 16) {
+      const MoveList moves = b.valid_moves();
+      b.MakeMove(moves[rand() % moves.size()]);
+    }
+    if (b.is_over()) {
+      continue;
+    }
+    int scores[7];
+    SolveMoves(b, cache_, scores);
+    EXPECT_EQ(*std::max_element(scores, scores + 7), Solve(b, cache_)) << b;
+  }
+}
+
+TEST_F(PerfectNegamaxTest, PerfectEvalDepth) {
+  const Board b = Play({0, 1, 0, 1, 0, 1});
+  EXPECT_EQ(PerfectEval(b, 10, cache_), kNoPerfectResult);
+  EXPECT_EQ(PerfectEval(b, 36, cache_), 43 - 7);
+}
+
+}  // namespace
+}  // namespace c4cc
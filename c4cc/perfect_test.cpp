@@ -0,0 +1,45 @@
+// Solves the positions given on standard input, one per line as the columns
+// played (numbered from 1), like "4453". An empty line or "-" is the empty
+// board, which takes long to solve. Anything after the moves on a line is
+// ignored.
+
+#include <iostream>
+#include <sstream>
+#include <string>
+
+#include "absl/time/clock.h"
+#include "absl/time/time.h"
+#include "c4cc/board.h"
+#include "c4cc/perfect_negamax.h"
+
+int main(int argc, char** argv) {
+  c4cc::PerfectCache cache;
+  std::string line;
+  while (std::getline(std::cin, line)) {
+    std::istringstream in(line);
+    std::string moves;
+    in >> moves;
+    if (moves.empty()) {
+      moves = "-";
+    }
+    c4cc::Board b;
+    bool valid = true;
+    for (char c : moves == "-" ? std::string() : moves) {
+      const int x = c - '1';
+      if (x < 0 || x >= c4cc::Board::kWidth || b.is_over() || !b.can_play(x)) {
+        valid = false;
+        break;
+      }
+      b.MakeMove(x);
+    }
+    if (!valid) {
+      std::cout << moves << " invalid\n";
+      continue;
+    }
+    const absl::Time start = absl::Now();
+    const int score = c4cc::Solve(b, &cache);
+    std::cout << moves << " " << score << " "
+              << absl::ToDoubleSeconds(absl::Now() - start) << "s" << std::endl;
+  }
+  return 0;
+}
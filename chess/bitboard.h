@@ -78,6 +78,23 @@ inline int GetFirstBit(uint64_t x) {
 inline bool BitIsSet(uint64_t x, int p) { return (x >> p) & 1; }
 
 inline int PopCount(uint64_t x) { return __builtin_popcountll(x); }
+
+// Gathers the bits of 'x' selected by 'mask' into the low bits of the result.
+inline uint64_t ParallelExtract(uint64_t x, uint64_t mask) {
+#ifdef __BMI2__
+  return _pext_u64(x, mask);
+#else
+  // Slow fallback, only for tools and tests that run on any CPU.
+  uint64_t res = 0;
+  for (uint64_t bit = 1; mask != 0; bit += bit) {
+    if (x & mask & -mask) {
+      res |= bit;
+    }
+    mask &= mask - 1;
+  }
+  return res;
+#endif
+}
 // Returns the index of bit with 'rank'. Requires PopCount(x) > rank.
 
 #if 0
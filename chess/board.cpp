@@ -13,8 +13,14 @@
 
 namespace chess {
 
+namespace {
+
+// XORed into the hash when it's black's turn.
+constexpr uint64_t kMoveXor = kAllBits / M_SQRT2;
+
+}  // namespace
+
 void Board::Init() {
-  InitMagic();
   InitHashing();
 }
 
@@ -68,7 +74,7 @@ Board::Board(absl::string_view fen) {
           std::cerr << "Invalid piece '" << c << "'\n";
           abort();
       }
-      bitboards_[int(col)][int(p)] |= OneHot(MakeSquare(r, f));
+      AddPiece(col, p, MakeSquare(r, f));
       ++f;
     }
   }
@@ -79,20 +85,20 @@ Board::Board(absl::string_view fen) {
     half_move_count_ = 1;
   }
 
-  castling_rights_ = 0;
+  uint64_t castling_rights = 0;
   for (char c : parts[2]) {
     switch (c) {
       case 'K':
-        castling_rights_ |= OneHot(Square::H1);
+        castling_rights |= OneHot(Square::H1);
         break;
       case 'Q':
-        castling_rights_ |= OneHot(Square::A1);
+        castling_rights |= OneHot(Square::A1);
         break;
       case 'k':
-        castling_rights_ |= OneHot(Square::H8);
+        castling_rights |= OneHot(Square::H8);
         break;
       case 'q':
-        castling_rights_ |= OneHot(Square::A8);
+        castling_rights |= OneHot(Square::A8);
         break;
       case '-':
         break;
@@ -101,13 +107,14 @@ Board::Board(absl::string_view fen) {
         abort();
     }
   }
+  castling_ = CompressCastling(castling_rights);
   if (parts[3] != "-") {
     for (int s = 0; s < 64; ++s) {
       if (Square::ToString(s) == parts[3]) {
-        en_passant_ = OneHot(s);
+        en_passant_square_ = s;
       }
     }
-    if (en_passant_ == 0) {
+    if (en_passant_square_ == 0) {
       std::cerr << "Invalid en passant square \"" << parts[3] << "\"";
       abort();
     }
@@ -133,164 +140,168 @@ Board::Board(const BoardProto& p) {
   assert(p.bitboards_size() == 12);
   for (int c = 0; c < 2; ++c) {
     for (int i = 0; i < 6; ++i) {
-      bitboards_[c][i] = p.bitboards(c * 6 + i);
+      for (int sq : BitRange(p.bitboards(c * 6 + i))) {
+        AddPiece(Color(c), Piece(i), sq);
+      }
     }
   }
-  en_passant_ = p.en_passant();
-  castling_rights_ = p.castling_rights();
+  en_passant_square_ = p.en_passant() == 0 ? 0 : GetFirstBit(p.en_passant());
+  castling_ = CompressCastling(p.castling_rights());
   half_move_count_ = p.half_move_count();
   board_hash_ = ComputeBoardHash();
 }
 
-Board::Board(PieceColor arr[64]) {
+Board::Board(PieceColor arr[64], Color turn) {
   Init();
-  memset(&bitboards_, 0, sizeof(bitboards_));
   for (int i = 0; i < 64; ++i) {
     auto p = arr[i];
     if (p.c != Color::kEmpty) {
-      bitboards_[int(p.c)][int(p.p)] |= 1ull << i;
+      AddPiece(p.c, p.p, i);
     }
   }
-  en_passant_ = 0;
-  castling_rights_ = 0;
-  half_move_count_ = 0;
-  no_progress_count_ = 0;
+  half_move_count_ = turn == Color::kBlack ? 1 : 0;
   board_hash_ = ComputeBoardHash();
 }
 
 Board::Board(const Board& o, const Move& m) : Board(o) {
   // Init() call is not required here, at least one board must have already been
   // constructed with another constructor.
-  const uint64_t from_o = OneHot(m.from);
-  const uint64_t to_o = OneHot(m.to);
-  const int ti = half_move_count_ & 1;
+  UndoInfo undo;
+  MakeMove(m, &undo);
+}
+
+uint64_t Board::bitboard(Color c, Piece p) const {
+  uint64_t bb = 0;
+  switch (p) {
+    case Piece::kPawn:
+      bb = pawns_;
+      break;
+    case Piece::kKnight:
+      bb = knights_;
+      break;
+    case Piece::kBishop:
+      bb = diagonal_ & ~orthogonal_;
+      break;
+    case Piece::kRook:
+      bb = orthogonal_ & ~diagonal_;
+      break;
+    case Piece::kQueen:
+      bb = diagonal_ & orthogonal_;
+      break;
+    case Piece::kKing:
+      bb = kings_;
+      break;
+    default:
+      break;
+  }
+  return bb & pieces(c);
+}
+
+void Board::MakeMove(const Move& m, UndoInfo* undo) {
+  const Color us = turn();
+  const Color them = OtherColor(us);
+  const int ti = int(us);
+
+  const Move::Type type = GetMoveType(m);
+  undo->board_hash = board_hash_;
+  undo->no_progress_count = no_progress_count_;
+  undo->en_passant_square = en_passant_square_;
+  undo->castling = castling_;
+  undo->move = m;
+  undo->move.type = type;
+  undo->moved = Piece::kNone;
+  undo->captured = Piece::kNone;
 
-  const Move::Type type = o.GetMoveType(m);
   // Remove en passant and castling from hash. They are added back later after
   // they've been (potentially) modified.
-  board_hash_ ^= en_passant_;
-  board_hash_ ^= castling_rights_;
-  en_passant_ = 0;
+  board_hash_ ^= en_passant();
+  board_hash_ ^= castling_rights();
+  en_passant_square_ = 0;
 
   switch (type) {
-    case Move::Type::kReversible: {
-      ++no_progress_count_;
-      for (int i = 0; i < kNumPieces; ++i) {
-        if (bitboards_[ti][i] & from_o) {
-          // Swap these two bits.
-          bitboards_[ti][i] ^= from_o | to_o;
-          board_hash_ ^= zobrist[ti][i][m.from] ^ zobrist[ti][i][m.to];
-        }
-      }
-      // If this was a rook, castle rights are lost.
-      castling_rights_ &= ~from_o;
-      // Or if we took an opponent rook:
-      castling_rights_ &= ~to_o;
-      // Or if king was moved:
-      if (bitboards_[0][5] & to_o) {
-        castling_rights_ &= ~RankMask(0);
-      } else if (bitboards_[1][5] & to_o) {
-        castling_rights_ &= ~RankMask(7);
-      }
-      break;
-    }
-    case Move::Type::kRegular:
-      no_progress_count_ = 0;
-      // Before changing bitmaps, set en passant if needed:
-
-      // Check if this is a pawn move first.
-      if (bitboards_[ti][0] & from_o) {
-        if (m.to - m.from == 16) {
-          // White two-step pawn move.
-          en_passant_ = OneHot(m.to - 8);
-        }
-        if (m.from - m.to == 16) {
-          // Black two-step pawn move.
-          en_passant_ = OneHot(m.to + 8);
-        }
-        board_hash_ ^= en_passant_;
-      }
-      // Swap the pieces as above.
-      for (int i = 0; i < kNumPieces; ++i) {
-        if (bitboards_[ti][i] & from_o) {
-          bitboards_[ti][i] ^= from_o | to_o;
-          board_hash_ ^= zobrist[ti][i][m.from] ^ zobrist[ti][i][m.to];
+    case Move::Type::kReversible:
+    case Move::Type::kRegular: {
+      const Piece moved = square(m.from).p;
+      undo->moved = moved;
+      if (type == Move::Type::kRegular) {
+        no_progress_count_ = 0;
+        // Perform potential captures.
+        const PieceColor captured = square(m.to);
+        if (captured.c == them) {
+          RemovePiece(them, captured.p, m.to);
+          board_hash_ ^= zobrist[ti ^ 1][int(captured.p)][m.to];
+          undo->captured = captured.p;
         }
-      }
-      // Perform potential captures.
-      for (int i = 0; i < kNumPieces; ++i) {
-        if (bitboards_[ti ^ 1][i] & to_o) {
-          bitboards_[ti ^ 1][i] &= ~to_o;
-          board_hash_ ^= zobrist[ti ^ 1][i][m.to];
+        if (moved == Piece::kPawn) {
+          if (m.to - m.from == 16) {
+            // White two-step pawn move.
+            en_passant_square_ = m.to - 8;
+          } else if (m.from - m.to == 16) {
+            // Black two-step pawn move.
+            en_passant_square_ = m.to + 8;
+          }
         }
+      } else {
+        ++no_progress_count_;
       }
-      // If this was a rook, castle rights are lost.
-      castling_rights_ &= ~from_o;
-      // Or if we took an opponent rook:
-      castling_rights_ &= ~to_o;
+      MovePiece(us, moved, m.from, m.to);
+      board_hash_ ^=
+          zobrist[ti][int(moved)][m.from] ^ zobrist[ti][int(moved)][m.to];
+      // If this was a rook, castle rights are lost. Or if we took an opponent
+      // rook.
+      castling_ &= ~CompressCastling(OneHot(m.from) | OneHot(m.to));
       // Or if king was moved:
-      if (bitboards_[0][5] & to_o) {
-        castling_rights_ &= ~RankMask(0);
-      } else if (bitboards_[1][5] & to_o) {
-        castling_rights_ &= ~RankMask(7);
+      if (moved == Piece::kKing) {
+        castling_ &= ~(3 << (2 * ti));
       }
       break;
-    case Move::Type::kCastling:
+    }
+    case Move::Type::kCastling: {
       ++no_progress_count_;
-      // This doesn't have to be super fast, castling is not frequent.
-      castling_rights_ &= ~RankMask(ti * 7);
-      if (m.to == Square::C1) {
-        bitboards_[0][5] = OneHot(Square::C1);
-        bitboards_[0][3] ^= OneHot(Square::A1) | OneHot(Square::D1);
-        board_hash_ ^= zobrist[0][5][Square::E1] ^ zobrist[0][5][Square::C1] ^
-                       zobrist[0][3][Square::A1] ^ zobrist[0][3][Square::D1];
-      } else if (m.to == Square::G1) {
-        bitboards_[0][5] = OneHot(Square::G1);
-        bitboards_[0][3] ^= OneHot(Square::H1) | OneHot(Square::F1);
-        board_hash_ ^= zobrist[0][5][Square::E1] ^ zobrist[0][5][Square::G1] ^
-                       zobrist[0][3][Square::H1] ^ zobrist[0][3][Square::F1];
-      } else if (m.to == Square::C8) {
-        bitboards_[1][5] = OneHot(Square::C8);
-        bitboards_[1][3] ^= OneHot(Square::A8) | OneHot(Square::D8);
-        board_hash_ ^= zobrist[1][5][Square::E8] ^ zobrist[1][5][Square::C8] ^
-                       zobrist[1][3][Square::A8] ^ zobrist[1][3][Square::D8];
-      } else if (m.to == Square::G8) {
-        bitboards_[1][5] = OneHot(Square::G8);
-        bitboards_[1][3] ^= OneHot(Square::H8) | OneHot(Square::F8);
-        board_hash_ ^= zobrist[1][5][Square::E8] ^ zobrist[1][5][Square::G8] ^
-                       zobrist[1][3][Square::H8] ^ zobrist[1][3][Square::F8];
-      } else {
+      undo->moved = Piece::kKing;
+      const int rank = SquareRank(m.to);
+      const bool long_castle = SquareFile(m.to) == 2;
+      if (m.from != MakeSquare(rank, 4) ||
+          (m.to != MakeSquare(rank, 2) && m.to != MakeSquare(rank, 6))) {
         std::cerr << "bad castle move: " << m.ToString() << "\n";
         abort();
       }
+      const int rook_from = MakeSquare(rank, long_castle ? 0 : 7);
+      const int rook_to = MakeSquare(rank, long_castle ? 3 : 5);
+      castling_ &= ~(3 << (2 * ti));
+      MovePiece(us, Piece::kKing, m.from, m.to);
+      MovePiece(us, Piece::kRook, rook_from, rook_to);
+      board_hash_ ^= zobrist[ti][5][m.from] ^ zobrist[ti][5][m.to] ^
+                     zobrist[ti][3][rook_from] ^ zobrist[ti][3][rook_to];
       break;
-    case Move::Type::kPromotion:
+    }
+    case Move::Type::kPromotion: {
       // Pawn move, so this counter resets.
       no_progress_count_ = 0;
-      // Remove pawn.
-      bitboards_[ti][0] &= ~from_o;
-      // Insert new piece:
-      bitboards_[ti][int(m.promotion)] |= to_o;
-
-      board_hash_ ^= zobrist[ti][0][m.from];
-      board_hash_ ^= zobrist[ti][int(m.promotion)][m.to];
+      undo->moved = Piece::kPawn;
       // Perform potential captures.
-      for (int i = 0; i < kNumPieces; ++i) {
-        if (bitboards_[ti ^ 1][i] & to_o) {
-          bitboards_[ti ^ 1][i] &= ~to_o;
-          board_hash_ ^= zobrist[ti ^ 1][i][m.to];
-        }
+      const PieceColor captured = square(m.to);
+      if (captured.c == them) {
+        RemovePiece(them, captured.p, m.to);
+        board_hash_ ^= zobrist[ti ^ 1][int(captured.p)][m.to];
+        undo->captured = captured.p;
       }
+      RemovePiece(us, Piece::kPawn, m.from);
+      AddPiece(us, m.promotion, m.to);
+      board_hash_ ^= zobrist[ti][0][m.from];
+      board_hash_ ^= zobrist[ti][int(m.promotion)][m.to];
       // We might have captured a rook with castling rights.
-      castling_rights_ &= ~to_o;
+      castling_ &= ~CompressCastling(OneHot(m.to));
       break;
+    }
     case Move::Type::kEnPassant: {
-      // This must be a pawn move.
-      bitboards_[ti][0] ^= from_o | to_o;
+      undo->moved = Piece::kPawn;
+      undo->captured = Piece::kPawn;
       // We're capturing pawn on the same rank as 'from', same file as 'to'.
       const int captured_square =
           MakeSquare(SquareRank(m.from), SquareFile(m.to));
-      bitboards_[ti ^ 1][0] &= ~OneHot(captured_square);
+      MovePiece(us, Piece::kPawn, m.from, m.to);
+      RemovePiece(them, Piece::kPawn, captured_square);
       board_hash_ ^= zobrist[ti][0][m.from];
       board_hash_ ^= zobrist[ti][0][m.to];
       board_hash_ ^= zobrist[ti ^ 1][0][captured_square];
@@ -300,25 +311,59 @@ Board::Board(const Board& o, const Move& m) : Board(o) {
       std::cerr << "broken move type: " << int(type) << "\n";
       abort();
   }
-  board_hash_ ^= castling_rights_;
+  board_hash_ ^= en_passant();
+  board_hash_ ^= castling_rights();
 
   // Different turn, XOR with a constant.
-  constexpr uint64_t kMoveXor = kAllBits / M_SQRT2;
   board_hash_ ^= kMoveXor;
   ++half_move_count_;
   assert(board_hash_ == ComputeBoardHash());
 }
 
-PieceColor Board::square(int sq) const {
-  const uint64_t mask = OneHot(sq);
-  for (int c = 0; c < 2; ++c) {
-    for (int p = 0; p < kNumPieces; ++p) {
-      if (bitboards_[c][p] & mask) {
-        return PieceColor{Piece(p), Color(c)};
+void Board::UnmakeMove(const UndoInfo& undo) {
+  --half_move_count_;
+  const Color us = turn();
+  const Color them = OtherColor(us);
+  const Move& m = undo.move;
+
+  switch (m.type) {
+    case Move::Type::kReversible:
+    case Move::Type::kRegular:
+      MovePiece(us, undo.moved, m.to, m.from);
+      if (undo.captured != Piece::kNone) {
+        AddPiece(them, undo.captured, m.to);
       }
+      break;
+    case Move::Type::kCastling: {
+      const int rank = SquareRank(m.to);
+      const bool long_castle = SquareFile(m.to) == 2;
+      const int rook_from = MakeSquare(rank, long_castle ? 0 : 7);
+      const int rook_to = MakeSquare(rank, long_castle ? 3 : 5);
+      MovePiece(us, Piece::kKing, m.to, m.from);
+      MovePiece(us, Piece::kRook, rook_to, rook_from);
+      break;
     }
+    case Move::Type::kPromotion:
+      RemovePiece(us, m.promotion, m.to);
+      AddPiece(us, Piece::kPawn, m.from);
+      if (undo.captured != Piece::kNone) {
+        AddPiece(them, undo.captured, m.to);
+      }
+      break;
+    case Move::Type::kEnPassant:
+      MovePiece(us, Piece::kPawn, m.to, m.from);
+      AddPiece(them, Piece::kPawn,
+               MakeSquare(SquareRank(m.from), SquareFile(m.to)));
+      break;
+    default:
+      std::cerr << "broken move type: " << int(m.type) << "\n";
+      abort();
   }
-  return PieceColor{Piece::kNone, Color::kEmpty};
+  en_passant_square_ = undo.en_passant_square;
+  castling_ = undo.castling;
+  board_hash_ = undo.board_hash;
+  no_progress_count_ = undo.no_progress_count;
+  assert(board_hash_ == ComputeBoardHash());
 }
 
 std::string Board::ToPrintString() const {
@@ -339,17 +384,15 @@ std::string Board::ToPrintString() const {
 }
 
 bool Board::operator==(const Board& o) const {
-  for (int i = 0; i < 2; ++i) {
-    for (int j = 0; j < kNumPieces; ++j) {
-      if (bitboards_[i][j] != o.bitboards_[i][j]) {
-        return false;
-      }
-    }
+  if (white_ != o.white_ || pawns_ != o.pawns_ || knights_ != o.knights_ ||
+      diagonal_ != o.diagonal_ || orthogonal_ != o.orthogonal_ ||
+      kings_ != o.kings_) {
+    return false;
   }
-  if (en_passant_ != o.en_passant_) {
+  if (en_passant_square_ != o.en_passant_square_) {
     return false;
   }
-  if (castling_rights_ != o.castling_rights_) {
+  if (castling_ != o.castling_) {
     return false;
   }
   // Different turn.
@@ -386,24 +429,25 @@ std::string Board::ToFEN() const {
   fen.push_back(' ');
   fen.push_back(turn() == Color::kWhite ? 'w' : 'b');
   fen.push_back(' ');
-  if (castling_rights_ & OneHot(Square::H1)) {
+  const uint64_t castling_rights = this->castling_rights();
+  if (castling_rights & OneHot(Square::H1)) {
     fen.push_back('K');
   }
-  if (castling_rights_ & OneHot(Square::A1)) {
+  if (castling_rights & OneHot(Square::A1)) {
     fen.push_back('Q');
   }
-  if (castling_rights_ & OneHot(Square::H8)) {
+  if (castling_rights & OneHot(Square::H8)) {
     fen.push_back('k');
   }
-  if (castling_rights_ & OneHot(Square::A8)) {
+  if (castling_rights & OneHot(Square::A8)) {
     fen.push_back('q');
   }
-  if (castling_rights_ == 0) {
+  if (castling_ == 0) {
     fen.push_back('-');
   }
   fen.push_back(' ');
-  if (en_passant_) {
-    fen += Square::ToString(GetFirstBit(en_passant_));
+  if (en_passant_square_ != 0) {
+    fen += Square::ToString(en_passant_square_);
   } else {
     fen.push_back('-');
   }
@@ -421,16 +465,12 @@ Move::Type Board::GetMoveType(const Move& m) const {
   // Rest of the code only occurs when input move is not generated by
   // valid_moves(). Thus the code below doesn't need to be fast: just make
   // sure it's correct.
-  const uint64_t to_o = OneHot(m.to);
-  const uint64_t from_o = OneHot(m.from);
-  const uint64_t occ = ComputeOcc();
-
-  const uint64_t pawns = (bitboards_[0][0] | bitboards_[1][0]);
+  const Piece moved = square(m.from).p;
   // Ok, let's see if this is an en-passant capture:
-  if (to_o == en_passant_) {
+  if (en_passant_square_ != 0 && m.to == en_passant_square_) {
     // Could be, but not necessarily. Check if the piece being moved was a
     // pawn:
-    if (pawns & from_o) {
+    if (moved == Piece::kPawn) {
       return Move::Type::kEnPassant;
     }
   }
@@ -438,8 +478,7 @@ Move::Type Board::GetMoveType(const Move& m) const {
     return Move::Type::kPromotion;
   }
   // Could be castling:
-  const uint64_t kings = bitboards_[0][5] | bitboards_[1][5];
-  if (from_o & kings) {
+  if (moved == Piece::kKing) {
     // We're moving a king. It's a castling if there is exactly 2 difference
     // in position.
     if (abs(m.to - m.from) == 2) {
@@ -447,7 +486,7 @@ Move::Type Board::GetMoveType(const Move& m) const {
     }
   }
   // Is this a pawn move or a capture:
-  if ((pawns & from_o) || (to_o & occ)) {
+  if (moved == Piece::kPawn || square(m.to).c != Color::kEmpty) {
     return Move::Type::kRegular;
   }
   return Move::Type::kReversible;
@@ -455,8 +494,11 @@ Move::Type Board::GetMoveType(const Move& m) const {
 
 uint64_t Board::ComputeBoardHash() const {
   uint64_t h = 0;
-  h ^= en_passant_;
-  h ^= castling_rights_;
+  h ^= en_passant();
+  h ^= castling_rights();
+  if (turn() == Color::kBlack) {
+    h ^= kMoveXor;
+  }
 
   // This is not the fastest, but this codepath is only used when constructing
   // from proto or FEN.
@@ -484,10 +526,10 @@ BoardFP BoardFingerprint(const Board& b) {
   // Construct another hash. This can be cheaper, since collisions with the
   // primary hash are so unlikely.
   // TODO: Consider making this stable so we can store it to disk.
-  uint64_t other_h = HashCombine(b.bitboard(Color::kWhite, Piece::kPawn) |
-                                     b.bitboard(Color::kWhite, Piece::kKing),
-                                 b.bitboard(Color::kBlack, Piece::kPawn) |
-                                     b.bitboard(Color::kBlack, Piece::kKing));
+  const uint64_t pawns_and_kings = b.pawns() | b.kings();
+  uint64_t other_h =
+      HashCombine(pawns_and_kings & b.pieces(Color::kWhite),
+                  pawns_and_kings & b.pieces(Color::kBlack));
   return absl::MakeUint128(other_h, b.board_hash());
 }
 
@@ -1,6 +1,7 @@
 #ifndef _CHESS_BOARD_H_
 #define _CHESS_BOARD_H_
 
+#include <array>
 #include <cstdint>
 #include <ostream>
 #include <string>
@@ -8,11 +9,11 @@
 
 #include "absl/strings/string_view.h"
 #include "absl/numeric/int128.h"
+#include "chess/bitboard.h"
 #include "chess/game.pb.h"
 #include "chess/hashing.h"
 #include "chess/square.h"
 #include "chess/types.h"
-#include "chess/types.h"
 #include "util/int-set.h"
 
 namespace chess {
@@ -35,7 +36,8 @@ class Board {
 
   explicit Board(const BoardProto& p);
 
-  explicit Board(PieceColor arr[64]);
+  // No castling rights or en passant square.
+  explicit Board(PieceColor arr[64], Color turn = Color::kWhite);
 
   // crashes on failure
   explicit Board(absl::string_view fen);
@@ -43,6 +45,27 @@ class Board {
   // Construct a board from given existing board + a move.
   Board(const Board& o, const Move& m);
 
+  // State needed to undo a move made with MakeMove().
+  struct UndoInfo {
+    uint64_t board_hash;
+    int16_t no_progress_count;
+    uint8_t en_passant_square;
+    uint8_t castling;
+    // Always has the type set.
+    Move move;
+    Piece moved;
+    // kNone if the move was not a capture.
+    Piece captured;
+  };
+
+  // Performs move 'm' in place, and stores what is needed to undo it in
+  // 'undo'. Cheaper than copying the board in tree searches.
+  void MakeMove(const Move& m, UndoInfo* undo);
+
+  // Undoes the last move made with MakeMove(). Moves must be undone in
+  // reverse order.
+  void UnmakeMove(const UndoInfo& undo);
+
   Color turn() const {
     return (half_move_count_ % 2) == 0 ? Color::kWhite : Color::kBlack;
   }
@@ -50,14 +73,34 @@ class Board {
   // Hash value for the board, to be used for detecting repetitions.
   uint64_t board_hash() const { return board_hash_; }
 
-  uint64_t bitboard(Color c, Piece p) const {
-    return bitboards_[int(c)][int(p)];
+  // Piece type bitboards, for both colors. Queens are included in both
+  // diagonal_sliders() and orthogonal_sliders().
+  uint64_t pawns() const { return pawns_; }
+  uint64_t knights() const { return knights_; }
+  uint64_t diagonal_sliders() const { return diagonal_; }
+  uint64_t orthogonal_sliders() const { return orthogonal_; }
+  uint64_t kings() const { return kings_; }
+
+  uint64_t occupied() const {
+    return pawns_ | knights_ | diagonal_ | orthogonal_ | kings_;
   }
 
-  uint64_t en_passant() const { return en_passant_; }
+  // All pieces of color 'c'.
+  uint64_t pieces(Color c) const {
+    return c == Color::kWhite ? white_ : occupied() & ~white_;
+  }
+
+  // Slower than the accessors above, since bishops, rooks and queens have to
+  // be separated.
+  uint64_t bitboard(Color c, Piece p) const;
+
+  uint64_t en_passant() const {
+    return en_passant_square_ == 0 ? 0 : OneHot(en_passant_square_);
+  }
   int ply() const { return half_move_count_; }
 
-  uint64_t castling_rights() const { return castling_rights_; }
+  // Rook squares which still have castling rights.
+  uint64_t castling_rights() const { return ExpandCastling(castling_); }
 
   bool operator==(const Board& o) const;
 
@@ -72,16 +115,6 @@ class Board {
   // Convenience function for getting valid moves,
   MoveList valid_moves() const;
 
-  uint64_t ComputeOcc() const {
-    uint64_t o = 0;
-    for (int i = 0; i < 2; ++i) {
-      for (int j = 0; j < kNumPieces; ++j) {
-        o |= bitboards_[i][j];
-      }
-    }
-    return o;
-  }
-
   // "half-move clock", for purposes of 50-move rule. Draw occurs at 100.
   int no_progress_count() const { return no_progress_count_; }
 
@@ -89,28 +122,135 @@ class Board {
   template <typename H>
   friend H AbslHashValue(H h, const Board& b);
 
-  // Initialize movegen and hashing.
+  // Initialize hashing. Movegen tables are generated at build time.
   static void Init();
 
+  // Castling rights are stored as 4 bits, one for each corner: A1, H1, A8 and
+  // H8 (lowest first).
+  static uint8_t CompressCastling(uint64_t rights) {
+    return (rights & 1) | ((rights >> 6) & 2) | ((rights >> 54) & 4) |
+           ((rights >> 60) & 8);
+  }
+  static uint64_t ExpandCastling(uint8_t c) {
+    return (uint64_t(c) & 1) | ((uint64_t(c) & 2) << 6) |
+           ((uint64_t(c) & 4) << 54) | ((uint64_t(c) & 8) << 60);
+  }
+
+  // These only update the bitboards (and the mailbox), not the hash.
+  void AddPiece(Color c, Piece p, int sq) {
+    TogglePiece(c, p, OneHot(sq));
+#ifdef CHESS_BOARD_MAILBOX
+    mailbox_[sq] = MailboxCode(c, p);
+#endif
+  }
+  void RemovePiece(Color c, Piece p, int sq) {
+    TogglePiece(c, p, OneHot(sq));
+#ifdef CHESS_BOARD_MAILBOX
+    mailbox_[sq] = kEmptyCode;
+#endif
+  }
+  void MovePiece(Color c, Piece p, int from, int to) {
+    TogglePiece(c, p, OneHot(from) | OneHot(to));
+#ifdef CHESS_BOARD_MAILBOX
+    mailbox_[from] = kEmptyCode;
+    mailbox_[to] = MailboxCode(c, p);
+#endif
+  }
+  void TogglePiece(Color c, Piece p, uint64_t mask) {
+    switch (p) {
+      case Piece::kPawn:
+        pawns_ ^= mask;
+        break;
+      case Piece::kKnight:
+        knights_ ^= mask;
+        break;
+      case Piece::kBishop:
+        diagonal_ ^= mask;
+        break;
+      case Piece::kRook:
+        orthogonal_ ^= mask;
+        break;
+      case Piece::kQueen:
+        diagonal_ ^= mask;
+        orthogonal_ ^= mask;
+        break;
+      default:
+        kings_ ^= mask;
+        break;
+    }
+    if (c == Color::kWhite) {
+      white_ ^= mask;
+    }
+  }
+
   uint64_t ComputeBoardHash() const;
 
-  uint64_t bitboards_[2][kNumPieces] = {};
-  // Squares where en-passant capture is possible for the current player.
-  uint64_t en_passant_ = 0;
-  uint64_t castling_rights_ = 0;
-  int16_t no_progress_count_ = 0;
-  int32_t half_move_count_ = 0;
+  // One bitboard per piece type plus one for the side, rather than one per
+  // (color, piece). See bitboard() for recovering the latter.
+  uint64_t white_ = 0;
+  uint64_t pawns_ = 0;
+  uint64_t knights_ = 0;
+  // Bishops and queens.
+  uint64_t diagonal_ = 0;
+  // Rooks and queens.
+  uint64_t orthogonal_ = 0;
+  uint64_t kings_ = 0;
   uint64_t board_hash_ = 0;
+  int32_t half_move_count_ = 0;
+  int16_t no_progress_count_ = 0;
+  // Square where en-passant capture is possible for the current player, or 0
+  // if none (A1 can never be an en passant square).
+  uint8_t en_passant_square_ = 0;
+  uint8_t castling_ = 0;
 
-  // TODO: Maybe change bitboards to the following:
-  // * side
-  // * pawns
-  // * knights
-  // * bishop (including queens)
-  // * rooks (including queens)
-  // * kings
+#ifdef CHESS_BOARD_MAILBOX
+  // Piece on each square, for O(1) square(). Doubles the size of the board.
+  static constexpr uint8_t kEmptyCode =
+      int(Piece::kNone) | (int(Color::kEmpty) << 3);
+  static constexpr uint8_t MailboxCode(Color c, Piece p) {
+    return int(p) | (int(c) << 3);
+  }
+  static constexpr std::array<uint8_t, 64> EmptyMailbox() {
+    std::array<uint8_t, 64> m = {};
+    for (int i = 0; i < 64; ++i) {
+      m[i] = kEmptyCode;
+    }
+    return m;
+  }
+  std::array<uint8_t, 64> mailbox_ = EmptyMailbox();
+#endif
 };
-static_assert(sizeof(Board) == 16 * 8);
+#ifdef CHESS_BOARD_MAILBOX
+static_assert(sizeof(Board) == 2 * 64);
+#else
+// Exactly one cache line.
+static_assert(sizeof(Board) == 64);
+#endif
+
+inline PieceColor Board::square(int sq) const {
+#ifdef CHESS_BOARD_MAILBOX
+  const uint8_t code = mailbox_[sq];
+  return PieceColor{Piece(code & 7), Color(code >> 3)};
+#else
+  const uint64_t mask = OneHot(sq);
+  if ((occupied() & mask) == 0) {
+    return PieceColor{Piece::kNone, Color::kEmpty};
+  }
+  const Color c = (white_ & mask) ? Color::kWhite : Color::kBlack;
+  if (pawns_ & mask) {
+    return PieceColor{Piece::kPawn, c};
+  } else if (knights_ & mask) {
+    return PieceColor{Piece::kKnight, c};
+  } else if (kings_ & mask) {
+    return PieceColor{Piece::kKing, c};
+  } else if ((diagonal_ & orthogonal_) & mask) {
+    return PieceColor{Piece::kQueen, c};
+  } else if (diagonal_ & mask) {
+    return PieceColor{Piece::kBishop, c};
+  }
+  return PieceColor{Piece::kRook, c};
+#endif
+}
 
 template <typename H>
 H AbslHashValue(H h, const Board& b) {
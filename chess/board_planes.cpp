@@ -0,0 +1,92 @@
+#include "chess/board_planes.h"
+
+#include <immintrin.h>
+
+namespace chess {
+
+void BoardToPlanes(const Board& b, uint64_t planes[kBoardTensorNumLayers]) {
+  const Color turn = b.turn();
+  const uint64_t mine = b.pieces(turn);
+  const uint64_t theirs = b.pieces(OtherColor(turn));
+  const uint64_t diagonal = b.diagonal_sliders();
+  const uint64_t orthogonal = b.orthogonal_sliders();
+  const uint64_t types[kNumPieces] = {
+      b.pawns(),
+      b.knights(),
+      diagonal & ~orthogonal,
+      orthogonal & ~diagonal,
+      diagonal & orthogonal,
+      b.kings(),
+  };
+  for (int p = 0; p < kNumPieces; ++p) {
+    planes[p] = types[p] & mine;
+    planes[kNumPieces + p] = types[p] & theirs;
+  }
+  planes[12] = b.en_passant();
+  planes[13] = b.castling_rights();
+  if (turn == Color::kBlack) {
+    // One byte per rank, so swapping bytes mirrors the board.
+    for (int i = 0; i < kBoardTensorNumLayers; ++i) {
+      planes[i] = __builtin_bswap64(planes[i]);
+    }
+  }
+}
+
+void ExpandPlanes(const uint64_t* planes, int n, float* out) {
+#if defined(__AVX512F__)
+  const __m512 ones = _mm512_set1_ps(1.0f);
+  for (int i = 0; i < n; ++i) {
+    const uint64_t bb = planes[i];
+    for (int k = 0; k < 4; ++k) {
+      const __mmask16 mask = bb >> (16 * k);
+      _mm512_storeu_ps(out + 16 * k, _mm512_maskz_mov_ps(mask, ones));
+    }
+    out += 64;
+  }
+#elif defined(__AVX2__)
+  const __m256 ones = _mm256_set1_ps(1.0f);
+  const __m256i bits = _mm256_setr_epi32(1, 2, 4, 8, 16, 32, 64, 128);
+  for (int i = 0; i < n; ++i) {
+    const uint64_t bb = planes[i];
+    for (int k = 0; k < 8; ++k) {
+      const __m256i rank = _mm256_set1_epi32((bb >> (8 * k)) & 0xff);
+      const __m256i set =
+          _mm256_cmpeq_epi32(_mm256_and_si256(rank, bits), bits);
+      _mm256_storeu_ps(out + 8 * k,
+                       _mm256_and_ps(_mm256_castsi256_ps(set), ones));
+    }
+    out += 64;
+  }
+#elif defined(__SSE2__)
+  const __m128 ones = _mm_set1_ps(1.0f);
+  const __m128i bits = _mm_setr_epi32(1, 2, 4, 8);
+  for (int i = 0; i < n; ++i) {
+    const uint64_t bb = planes[i];
+    for (int k = 0; k < 16; ++k) {
+      const __m128i nibble = _mm_set1_epi32((bb >> (4 * k)) & 0xf);
+      const __m128i set = _mm_cmpeq_epi32(_mm_and_si128(nibble, bits), bits);
+      _mm_storeu_ps(out + 4 * k, _mm_and_ps(_mm_castsi128_ps(set), ones));
+    }
+    out += 64;
+  }
+#else
+  for (int i = 0; i < n; ++i) {
+    const uint64_t bb = planes[i];
+    for (int s = 0; s < 64; ++s) {
+      out[s] = (bb >> s) & 1;
+    }
+    out += 64;
+  }
+#endif
+}
+
+void EncodeBoards(const Board* const* boards, int n, float* out) {
+  uint64_t planes[kBoardTensorNumLayers];
+  for (int i = 0; i < n; ++i) {
+    BoardToPlanes(*boards[i], planes);
+    ExpandPlanes(planes, kBoardTensorNumLayers, out);
+    out += kBoardTensorNumLayers * 64;
+  }
+}
+
+}  // namespace chess
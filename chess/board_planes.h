@@ -0,0 +1,30 @@
+// Encoding boards as input planes for the network, without depending on
+// tensorflow.
+#ifndef _CHESS_BOARD_PLANES_H_
+#define _CHESS_BOARD_PLANES_H_
+
+#include <cstdint>
+
+#include "chess/board.h"
+
+namespace chess {
+
+inline constexpr int kBoardTensorNumLayers = 14;
+
+// Bitboards for each input layer of 'b', from the point of view of the player
+// whose turn it is: the board is mirrored vertically when black is to move.
+// Layers are my pieces (pawns, knights, bishops, rooks, queens, king), then
+// opponent pieces in the same order, then en passant and castling rights.
+void BoardToPlanes(const Board& b, uint64_t planes[kBoardTensorNumLayers]);
+
+// Expands 'n' bitboards into n * 64 floats, 1.0 for set bits and 0.0 for the
+// rest. Uses AVX-512 or AVX2 when compiled with them, SSE2 otherwise.
+void ExpandPlanes(const uint64_t* planes, int n, float* out);
+
+// Writes 'n' boards to 'out', laid out as [board][layer][square]. 'out' must
+// have room for n * kBoardTensorNumLayers * 64 floats.
+void EncodeBoards(const Board* const* boards, int n, float* out);
+
+}  // namespace chess
+
+#endif
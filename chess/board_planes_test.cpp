@@ -0,0 +1,86 @@
+#include "chess/board_planes.h"
+
+#include <vector>
+
+#include "chess/movegen.h"
+#include "chess/square.h"
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+namespace chess {
+namespace {
+
+// Bit-by-bit encoding of a single board.
+std::vector<float> SlowEncode(const Board& b) {
+  const Color turn = b.turn();
+  std::vector<float> out;
+  auto add_layer = [&](uint64_t bb) {
+    for (int s = 0; s < 64; ++s) {
+      const int sq = turn == Color::kWhite
+                         ? s
+                         : MakeSquare(7 - SquareRank(s), SquareFile(s));
+      out.push_back(BitIsSet(bb, sq) ? 1.0 : 0.0);
+    }
+  };
+  for (Color c : {turn, OtherColor(turn)}) {
+    for (int p = 0; p < kNumPieces; ++p) {
+      add_layer(b.bitboard(c, Piece(p)));
+    }
+  }
+  add_layer(b.en_passant());
+  add_layer(b.castling_rights());
+  return out;
+}
+
+TEST(BoardPlanesTest, ExpandPlanes) {
+  const uint64_t planes[] = {0, kAllBits, 0x8000000000000001,
+                             0x0123456789abcdef};
+  std::vector<float> out(4 * 64, -1.0);
+  ExpandPlanes(planes, 4, out.data());
+  for (int i = 0; i < 4; ++i) {
+    for (int s = 0; s < 64; ++s) {
+      EXPECT_EQ(out[i * 64 + s], BitIsSet(planes[i], s) ? 1.0 : 0.0)
+          << "plane " << i << " square " << s;
+    }
+  }
+}
+
+TEST(BoardPlanesTest, MatchesSlowEncoding) {
+  std::vector<Board> boards;
+  for (const char* fen : {
+           "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1",
+           "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - "
+           "0 1",
+       }) {
+    const Board b(fen);
+    boards.push_back(b);
+    // Also check black to move, with en passant squares.
+    IterateLegalMoves(b, [&](const Move& m) { boards.emplace_back(b, m); });
+  }
+  std::vector<const Board*> ptrs;
+  std::vector<float> expected;
+  for (const Board& b : boards) {
+    ptrs.push_back(&b);
+    const std::vector<float> e = SlowEncode(b);
+    expected.insert(expected.end(), e.begin(), e.end());
+  }
+  std::vector<float> out(expected.size(), -1.0);
+  EncodeBoards(ptrs.data(), ptrs.size(), out.data());
+  EXPECT_EQ(out, expected);
+}
+
+TEST(BoardPlanesTest, StartingPosition) {
+  const Board b;
+  std::vector<float> out(kBoardTensorNumLayers * 64);
+  const Board* ptr = &b;
+  EncodeBoards(&ptr, 1, out.data());
+  // Layer 0 is pawns for the player whose turn it is.
+  EXPECT_EQ(out[0 * 64 + Square::A2], 1.0);
+  EXPECT_EQ(out[0 * 64 + Square::D3], 0.0);
+  // Layer 11 is for opponent's king.
+  EXPECT_EQ(out[11 * 64 + Square::E8], 1.0);
+  EXPECT_EQ(out[11 * 64 + Square::D8], 0.0);
+}
+
+}  // namespace
+}  // namespace chess
@@ -0,0 +1,78 @@
+#include "chess/board.h"
+
+#include "chess/movegen.h"
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+namespace chess {
+namespace {
+
+void ExpectSameBoard(const Board& a, const Board& b) {
+  EXPECT_EQ(a, b);
+  EXPECT_EQ(a.board_hash(), b.board_hash());
+  EXPECT_EQ(a.ply(), b.ply());
+  EXPECT_EQ(a.no_progress_count(), b.no_progress_count());
+  EXPECT_EQ(a.ToFEN(), b.ToFEN());
+}
+
+// Walks the whole tree to depth 'd' with MakeMove() and UnmakeMove(), checking
+// against boards constructed by copying.
+void CheckMakeUnmake(Board* b, int d) {
+  if (d == 0) {
+    return;
+  }
+  const Board before = *b;
+  Board::UndoInfo undo;
+  IterateLegalMoves(*b, [&](const Move& m) {
+    b->MakeMove(m, &undo);
+    ExpectSameBoard(*b, Board(before, m));
+    CheckMakeUnmake(b, d - 1);
+    b->UnmakeMove(undo);
+    ExpectSameBoard(*b, before);
+  });
+}
+
+TEST(BoardTest, MakeUnmake) {
+  for (const char* fen : {
+           "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1",
+           // Castling, en passant and promotions.
+           "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - "
+           "0 1",
+           "r3k2r/Pppp1ppp/1b3nbN/nP6/BBP1P3/q4N2/Pp1P2PP/R2Q1RK1 w kq - 0 1",
+           "8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - - 0 1",
+       }) {
+    Board b(fen);
+    CheckMakeUnmake(&b, 3);
+  }
+}
+
+TEST(BoardTest, PieceBitboards) {
+  const Board b(
+      "r3k2r/Pppp1ppp/1b3nbN/nP6/BBP1P3/q4N2/Pp1P2PP/R2Q1RK1 w kq - 0 1");
+  uint64_t occupied = 0;
+  for (Color c : {Color::kWhite, Color::kBlack}) {
+    for (int p = 0; p < kNumPieces; ++p) {
+      for (int sq = 0; sq < 64; ++sq) {
+        const PieceColor pc = b.square(sq);
+        EXPECT_EQ(BitIsSet(b.bitboard(c, Piece(p)), sq),
+                  pc.c == c && pc.p == Piece(p))
+            << Square::ToString(sq);
+      }
+      occupied |= b.bitboard(c, Piece(p));
+    }
+  }
+  EXPECT_EQ(b.occupied(), occupied);
+  EXPECT_EQ(b.castling_rights(), OneHot(Square::A8) | OneHot(Square::H8));
+}
+
+TEST(BoardTest, HashIncludesTurn) {
+  // Same position reached by moves and parsed from FEN must hash the same.
+  Board b;
+  b = Board(b, *Move::FromString("g1f3"));
+  EXPECT_EQ(b.board_hash(),
+            Board("rnbqkbnr/pppppppp/8/8/8/5N2/PPPPPPPP/RNBQKB1R b KQkq - 1 1")
+                .board_hash());
+}
+
+}  // namespace
+}  // namespace chess
@@ -6,14 +6,34 @@
 
 namespace chess {
 
-Game::Game(const std::vector<Player*>& players, Board start)
-    : players_(players), board_(start) {
+Game::Game(const std::vector<Player*>& players, Board start,
+           const Tablebase* tablebase)
+    : players_(players), tablebase_(tablebase), board_(start) {
   ++visit_count_[board_.board_hash()];
   for (Player* p : players_) {
     p->Reset(board_);
   }
 }
 
+bool Game::Adjudicate() {
+  if (tablebase_ == nullptr) {
+    return false;
+  }
+  const absl::optional<TablebaseResult> r = tablebase_->Probe(board_);
+  if (!r.has_value()) {
+    return false;
+  }
+  is_over_ = true;
+  if (r->wdl > 0) {
+    winner_ = board_.turn();
+  } else if (r->wdl < 0) {
+    winner_ = OtherColor(board_.turn());
+  } else {
+    winner_ = Color::kEmpty;
+  }
+  return true;
+}
+
 void Game::Advance(const Move& m) {
   if (is_over_) {
     std::cerr << "Game already over: '" << board_.ToFEN()
@@ -21,7 +41,8 @@ void Game::Advance(const Move& m) {
     abort();
   }
   assert(!is_over_);
-  board_ = Board(board_, m);
+  Board::UndoInfo undo;
+  board_.MakeMove(m, &undo);
   int& rep = visit_count_[board_.board_hash()];
   ++rep;
   if (rep >= 3) {
@@ -31,7 +52,8 @@ void Game::Advance(const Move& m) {
   }
 
   // Check for mate / stalemate.
-  const MovegenResult res = IterateLegalMoves(board_, [](const Move& m) {});
+  MovegenResult res;
+  CountLegalMoves(board_, &res);
   if (res == MovegenResult::kCheckmate) {
     is_over_ = true;
     // Player with the previous turn won.
@@ -69,6 +91,9 @@ void Game::Work() {
   } else {
     abort();
   }
+  if (Adjudicate()) {
+    return;
+  }
   Advance(m);
 }
 
@@ -5,12 +5,18 @@
 
 #include "chess/board.h"
 #include "chess/player.h"
+#include "chess/tablebase.h"
 
 namespace chess {
 
 class Game {
  public:
-  explicit Game(const std::vector<Player*>& players, Board start = Board());
+  // Positions covered by 'tablebase' end the game with the tablebase
+  // result, as if it was played out perfectly. The game ends in Work(), after
+  // the player to move has picked its move there, so players still see the
+  // covered position. 'tablebase' may be null, and must outlive this.
+  explicit Game(const std::vector<Player*>& players, Board start = Board(),
+                const Tablebase* tablebase = nullptr);
 
   //
   const Board& board() const { return board_; }
@@ -22,13 +28,19 @@ class Game {
   // Must not be called if this game is already over.
   void Advance(const Move& m);
 
-  // Selects the best move for the current player and performs it.
+  // Selects the best move for the current player and performs it, or ends
+  // the game if the tablebase covers the current board.
   // Must not be called if this game is already over.
   void Work();
 
  private:
+  // Ends the game if the tablebase covers the current board. Returns
+  // whether it did.
+  bool Adjudicate();
+
   // Has either 1 or 2.
   const std::vector<Player*> players_;
+  const Tablebase* const tablebase_;
 
   Board board_;
   // Already visited nodes, for detecting threefold repetition.
@@ -1,6 +1,7 @@
 #include "chess/generic_board.h"
 
 #include "absl/hash/hash.h"
+#include "absl/types/optional.h"
 #include "chess/movegen.h"
 #include "chess/tensors.h"
 #include "tensorflow/core/framework/tensor.h"
@@ -11,20 +12,31 @@ namespace {
 
 class GenericBoard : public generic::Board {
  public:
-  GenericBoard(chess::Board b) : b_(b) {
-    game_state_ = IterateLegalMoves(b, [](const chess::Move& m) {});
+  GenericBoard(chess::Board b, const Tablebase* tablebase)
+      : b_(b), tablebase_(tablebase) {
+    CountLegalMoves(b, &game_state_);
   }
 
-  GenericBoard(chess::Board b, MovegenResult state)
-      : b_(b), game_state_(state) {}
+  GenericBoard(chess::Board b, MovegenResult state,
+               const Tablebase* tablebase,
+               absl::optional<TablebaseResult> tablebase_result)
+      : b_(b),
+        game_state_(state),
+        tablebase_(tablebase),
+        tablebase_result_(tablebase_result) {}
 
   std::unique_ptr<Board> Move(int move) const override {
-    return std::make_unique<GenericBoard>(
-        chess::Board(b_, DecodeMove(b_, move)));
+    auto next = std::make_unique<GenericBoard>(
+        chess::Board(b_, DecodeMove(b_, move)), tablebase_);
+    if (tablebase_ != nullptr && next->game_state_ == MovegenResult::kNotOver) {
+      next->tablebase_result_ = tablebase_->Probe(next->b_);
+    }
+    return next;
   }
 
   std::unique_ptr<Board> Clone() const override {
-    return std::make_unique<GenericBoard>(b_, game_state_);
+    return std::make_unique<GenericBoard>(b_, game_state_, tablebase_,
+                                          tablebase_result_);
   }
 
   generic::BoardFP fingerprint() const override { return BoardFingerprint(b_); }
@@ -38,10 +50,14 @@ class GenericBoard : public generic::Board {
   }
 
   bool is_over() const override {
-    return game_state_ != MovegenResult::kNotOver;
+    return game_state_ != MovegenResult::kNotOver ||
+           tablebase_result_.has_value();
   }
 
   int result() const override {
+    if (tablebase_result_.has_value()) {
+      return tablebase_result_->wdl;
+    }
     switch (game_state_) {
       case MovegenResult::kCheckmate:
         return -1;
@@ -77,12 +93,16 @@ class GenericBoard : public generic::Board {
  private:
   chess::Board b_;
   MovegenResult game_state_;
+  const Tablebase* tablebase_;
+  // Set if the game is over by the tablebase.
+  absl::optional<TablebaseResult> tablebase_result_;
 };
 
 }  // namespace
 
-std::unique_ptr<generic::Board> MakeGenericBoard(const Board& b) {
-  return std::make_unique<GenericBoard>(b);
+std::unique_ptr<generic::Board> MakeGenericBoard(const Board& b,
+                                                 const Tablebase* tablebase) {
+  return std::make_unique<GenericBoard>(b, tablebase);
 }
 
 }  // namespace chess
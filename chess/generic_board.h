@@ -4,11 +4,17 @@
 #include <memory>
 
 #include "chess/board.h"
+#include "chess/tablebase.h"
 #include "generic/board.h"
 
 namespace chess {
 
-std::unique_ptr<generic::Board> MakeGenericBoard(const Board& b);
+// Positions reached by moves from 'b' which are covered by 'tablebase' are
+// over, with the tablebase result, so that searches stop there. 'b' itself
+// is never adjudicated, as it's to be searched. 'tablebase' may be null, and
+// must outlive the boards.
+std::unique_ptr<generic::Board> MakeGenericBoard(
+    const Board& b, const Tablebase* tablebase = nullptr);
 
 }  // namespace chess
 
@@ -16,14 +16,10 @@ namespace chess {
 
 namespace magic {
 
-#ifdef NDEBUG
-// Faster and smaller, but takes longer to generate (about 1s).
+// The generator and the library must agree on these, so they don't depend on
+// NDEBUG.
 constexpr int kBishopLogSize = 9;
 constexpr int kRookLogSize = 12;
-#else
-constexpr int kBishopLogSize = 9;
-constexpr int kRookLogSize = 12;
-#endif
 
 template <int LogSize>
 struct SliderMagic {
@@ -45,6 +41,31 @@ struct SliderMagic {
   uint64_t mask[64][kSize];
 };
 
+// Slider masks indexed with PEXT instead of magic multiplication. Every square
+// uses exactly 2^PopCount(rel_occ) entries, so all squares share one compact
+// table.
+template <int TableSize>
+struct SliderPext {
+  static constexpr int kTableSize = TableSize;
+
+  uint64_t GetMask(int sq, uint64_t occ) const {
+    return mask[offset[sq] + ParallelExtract(occ, rel_occ[sq])];
+  }
+
+  uint64_t rel_occ[64];
+  uint32_t offset[64];
+  uint64_t mask[kTableSize];
+};
+
+// Sums of 2^PopCount(rel_occ) over all squares.
+constexpr int kBishopPextSize = 5248;
+constexpr int kRookPextSize = 102400;
+
+struct PextMagic {
+  SliderPext<kBishopPextSize> bishop;
+  SliderPext<kRookPextSize> rook;
+};
+
 struct Magic {
   uint64_t knight_masks[64];
   uint64_t king_masks[64];
@@ -57,7 +78,12 @@ struct Magic {
   SliderMagic<kBishopLogSize> bishop_magics;
   SliderMagic<kRookLogSize> rook_magics;
 };
-extern Magic m;
+// Generated at build time (see magic_gen.h), so this is read-only data that
+// needs no initialization at startup, and can be shared between processes.
+extern const Magic m;
+// Generated together with 'm'. Only used with CHESS_USE_PEXT (see .bazelrc),
+// otherwise the pages are never touched.
+extern const PextMagic pext;
 
 }  // namespace magic
 
@@ -65,6 +91,18 @@ inline uint64_t KnightMoveMask(int square) {
   return magic::m.knight_masks[square];
 }
 inline uint64_t KingMoveMask(int square) { return magic::m.king_masks[square]; }
+#ifdef CHESS_USE_PEXT
+#ifndef __BMI2__
+#error "CHESS_USE_PEXT requires BMI2, build with --config=pext"
+#endif
+inline uint64_t BishopMoveMask(int square, uint64_t occ) {
+  return magic::pext.bishop.GetMask(square, occ);
+}
+
+inline uint64_t RookMoveMask(int square, uint64_t occ) {
+  return magic::pext.rook.GetMask(square, occ);
+}
+#else
 inline uint64_t BishopMoveMask(int square, uint64_t occ) {
   return magic::m.bishop_magics.GetMask(square, occ);
 }
@@ -72,6 +110,7 @@ inline uint64_t BishopMoveMask(int square, uint64_t occ) {
 inline uint64_t RookMoveMask(int square, uint64_t occ) {
   return magic::m.rook_magics.GetMask(square, occ);
 }
+#endif
 
 inline uint64_t PushMask(int from, int to) {
   return magic::m.push_masks[from][to];
@@ -89,9 +128,6 @@ inline bool SameDirection(int king, int from, int to) {
   return (pt & pf) != 0;
 }
 
-// Must be called for above functions to work.
-void InitMagic();
-
 }  // namespace chess
 
 #endif
@@ -0,0 +1,71 @@
+// Compares slider lookups through magic multiplication and PEXT. Build with
+// --config=pext for a meaningful PEXT number, otherwise the PEXT lookups use
+// the slow portable fallback.
+#include <cstdint>
+#include <iostream>
+#include <random>
+#include <vector>
+
+#include "absl/time/clock.h"
+#include "absl/time/time.h"
+#include "chess/magic.h"
+
+namespace chess {
+namespace {
+
+constexpr int kNumOccs = 4096;
+constexpr int kRounds = 1000;
+
+template <typename F>
+void Benchmark(const char* name, const std::vector<uint64_t>& occs,
+               const F& get_mask) {
+  absl::Time start = absl::Now();
+  uint64_t sum = 0;
+  for (int round = 0; round < kRounds; ++round) {
+    for (uint64_t occ : occs) {
+      // Depend on the previous result, like move generation does, so the
+      // loads can't be overlapped arbitrarily.
+      const int sq = (occ ^ sum) & 63;
+      sum += get_mask(sq, occ);
+    }
+  }
+  absl::Time end = absl::Now();
+  const double ns = absl::ToDoubleNanoseconds(end - start) /
+                    (double(kRounds) * occs.size());
+  std::cout << name << ": " << ns << " ns/lookup (checksum " << sum << ")\n";
+}
+
+void Go() {
+#ifndef __BMI2__
+  std::cout << "Warning: built without BMI2, PEXT uses the slow fallback.\n";
+#endif
+  std::mt19937_64 rand;
+  std::vector<uint64_t> occs(kNumOccs);
+  for (uint64_t& occ : occs) {
+    occ = rand() & rand();
+  }
+  Benchmark("magic rook", occs, [](int sq, uint64_t occ) {
+    return magic::m.rook_magics.GetMask(sq, occ);
+  });
+  Benchmark("pext rook", occs, [](int sq, uint64_t occ) {
+    return magic::pext.rook.GetMask(sq, occ);
+  });
+  Benchmark("magic bishop", occs, [](int sq, uint64_t occ) {
+    return magic::m.bishop_magics.GetMask(sq, occ);
+  });
+  Benchmark("pext bishop", occs, [](int sq, uint64_t occ) {
+    return magic::pext.bishop.GetMask(sq, occ);
+  });
+  std::cout << "Table sizes: magic " << sizeof(magic::m.rook_magics) << " + "
+            << sizeof(magic::m.bishop_magics) << ", pext "
+            << sizeof(magic::pext.rook) << " + " << sizeof(magic::pext.bishop)
+            << " bytes\n";
+}
+
+}  // namespace
+}  // namespace chess
+
+int main(int argc, char** argv) {
+  chess::Go();
+  return 0;
+}
@@ -1,11 +1,12 @@
-#include "chess/magic.h"
+#include "chess/magic_gen.h"
 
+#include <cassert>
+#include <cinttypes>
+#include <cstdio>
 #include <iostream>
-#include <mutex>
 #include <random>
+#include <vector>
 
-#include "absl/time/clock.h"
-#include "absl/time/time.h"
 #include "chess/bitboard.h"
 #include "chess/square.h"
 
@@ -13,12 +14,8 @@ namespace chess {
 
 namespace magic {
 
-Magic m;
-
 namespace {
 
-std::once_flag generated;
-
 constexpr uint64_t kUnsetSentinel = kAllBits;
 
 std::vector<uint64_t> AllSubsets(uint64_t set) {
@@ -68,7 +65,7 @@ uint64_t GeneratePieceMoves(const int dr[4], const int df[4], int square,
 }
 
 // TODO: Make this take SliderMagic pointer instead of all these ones.
-void GenerateMagic(const int dr[4], const int df[4], int square,
+void GenerateSliderMagic(const int dr[4], const int df[4], int square,
                    uint64_t* out_rel_occ, uint64_t* out_mul, uint64_t* output,
                    int output_logsize) {
   uint64_t rel_occ = 0;
@@ -125,6 +122,32 @@ void GenerateMagic(const int dr[4], const int df[4], int square,
   *out_mul = mul;
 }
 
+const int kBishopDr[4] = {1, -1, 1, -1};
+const int kBishopDf[4] = {1, 1, -1, -1};
+const int kRookDr[4] = {1, -1, 0, 0};
+const int kRookDf[4] = {0, 0, 1, -1};
+
+template <int TableSize>
+void GenerateSliderPext(const int dr[4], const int df[4],
+                        const uint64_t rel_occ[64],
+                        SliderPext<TableSize>* out) {
+  uint32_t offset = 0;
+  for (int s = 0; s < 64; ++s) {
+    out->rel_occ[s] = rel_occ[s];
+    out->offset[s] = offset;
+    // AllSubsets() enumerates the subsets in PEXT index order.
+    for (uint64_t occ : AllSubsets(rel_occ[s])) {
+      assert(ParallelExtract(occ, rel_occ[s]) == offset - out->offset[s]);
+      out->mask[offset++] = GeneratePieceMoves(dr, df, s, occ);
+    }
+  }
+  if (offset != TableSize) {
+    std::cerr << "PEXT table size mismatch: " << offset << " vs " << TableSize
+              << "\n";
+    abort();
+  }
+}
+
 int OnlySign(int x) {
   if (x == 0) {
     return 0;
@@ -217,7 +240,50 @@ uint64_t GenRayMask(int f, int t) {
   return mask;
 }
 
-void InitializeMagicInternal() {
+// Writes 'n' values as a brace-enclosed initializer list.
+template <typename T>
+void WriteArray(const T* values, int n, std::ostream& out) {
+  char buf[32];
+  out << "{";
+  for (int i = 0; i < n; ++i) {
+    snprintf(buf, sizeof(buf), "0x%" PRIx64 ",", uint64_t{values[i]});
+    out << buf;
+    if (i % 8 == 7) {
+      out << "\n";
+    }
+  }
+  out << "}";
+}
+
+template <int LogSize>
+void WriteSliderMagic(const SliderMagic<LogSize>& s, std::ostream& out) {
+  out << "{\n";
+  WriteArray(s.mul, 64, out);
+  out << ",\n";
+  WriteArray(s.rel_occ, 64, out);
+  out << ",\n{";
+  for (int sq = 0; sq < 64; ++sq) {
+    WriteArray(s.mask[sq], s.kSize, out);
+    out << ",\n";
+  }
+  out << "}}";
+}
+
+template <int TableSize>
+void WriteSliderPext(const SliderPext<TableSize>& s, std::ostream& out) {
+  out << "{\n";
+  WriteArray(s.rel_occ, 64, out);
+  out << ",\n";
+  WriteArray(s.offset, 64, out);
+  out << ",\n";
+  WriteArray(s.mask, s.kTableSize, out);
+  out << "}";
+}
+
+}  // namespace
+
+void GenerateMagic(Magic* out) {
+  Magic& m = *out;
   // Push masks.
   for (int f = 0; f < 64; ++f) {
     for (int t = 0; t < 64; ++t) {
@@ -293,32 +359,65 @@ void InitializeMagicInternal() {
   // Bishops.
   {
     std::cerr << "Generating bishops\n";
-    const int dr[4] = {1, -1, 1, -1};
-    const int df[4] = {1, 1, -1, -1};
     for (int s = 0; s < 64; ++s) {
-      GenerateMagic(dr, df, s, &m.bishop_magics.rel_occ[s],
-                    &m.bishop_magics.mul[s], m.bishop_magics.mask[s],
-                    m.bishop_magics.log_size());
+      GenerateSliderMagic(kBishopDr, kBishopDf, s, &m.bishop_magics.rel_occ[s],
+                          &m.bishop_magics.mul[s], m.bishop_magics.mask[s],
+                          m.bishop_magics.log_size());
     }
   }
   {
     std::cerr << "Generating rooks\n";
-    const int dr[4] = {1, -1, 0, 0};
-    const int df[4] = {0, 0, 1, -1};
     for (int s = 0; s < 64; ++s) {
-      GenerateMagic(dr, df, s, &m.rook_magics.rel_occ[s], &m.rook_magics.mul[s],
-                    m.rook_magics.mask[s], m.rook_magics.log_size());
+      GenerateSliderMagic(kRookDr, kRookDf, s, &m.rook_magics.rel_occ[s],
+                          &m.rook_magics.mul[s], m.rook_magics.mask[s],
+                          m.rook_magics.log_size());
     }
   }
   std::cerr << "SliderMagic ready: " << sizeof(m.bishop_magics) << ", "
             << sizeof(m.rook_magics) << "\n";
 }
 
-}  // namespace
-}  // namespace magic
+void GeneratePextMagic(const Magic& m, PextMagic* out) {
+  GenerateSliderPext(kBishopDr, kBishopDf, m.bishop_magics.rel_occ,
+                     &out->bishop);
+  GenerateSliderPext(kRookDr, kRookDf, m.rook_magics.rel_occ, &out->rook);
+}
 
-void InitMagic() {
-  std::call_once(magic::generated, &magic::InitializeMagicInternal);
+void WriteMagicSource(const Magic& m, const PextMagic& pext,
+                      std::ostream& out) {
+  out << "// Generated by chess/magic_gen_main.cpp, do not edit.\n"
+      << "#include \"chess/magic.h\"\n\n"
+      << "namespace chess {\n"
+      << "namespace magic {\n\n"
+      << "extern const Magic m = {\n";
+  WriteArray(m.knight_masks, 64, out);
+  out << ",\n";
+  WriteArray(m.king_masks, 64, out);
+  out << ",\n{";
+  for (int sq = 0; sq < 64; ++sq) {
+    WriteArray(m.push_masks[sq], 64, out);
+    out << ",\n";
+  }
+  out << "},\n{";
+  for (int sq = 0; sq < 64; ++sq) {
+    WriteArray(m.ray_masks[sq], 64, out);
+    out << ",\n";
+  }
+  out << "},\n";
+  WriteArray(m.king_pawn_danger, 64, out);
+  out << ",\n";
+  WriteSliderMagic(m.bishop_magics, out);
+  out << ",\n";
+  WriteSliderMagic(m.rook_magics, out);
+  out << "};\n\n"
+      << "extern const PextMagic pext = {\n";
+  WriteSliderPext(pext.bishop, out);
+  out << ",\n";
+  WriteSliderPext(pext.rook, out);
+  out << "};\n\n"
+      << "}  // namespace magic\n"
+      << "}  // namespace chess\n";
 }
 
+}  // namespace magic
 }  // namespace chess
@@ -0,0 +1,26 @@
+// Build-time generation of the tables in magic.h.
+#ifndef _CHESS_MAGIC_GEN_H_
+#define _CHESS_MAGIC_GEN_H_
+
+#include <ostream>
+
+#include "chess/magic.h"
+
+namespace chess {
+namespace magic {
+
+// Searches for magic multipliers and fills in all the tables. Deterministic,
+// takes about 1s.
+void GenerateMagic(Magic* out);
+
+// Fills in the PEXT tables, using the relevant occupancy masks from 'm'.
+void GeneratePextMagic(const Magic& m, PextMagic* out);
+
+// Writes a C++ source file defining magic::m and magic::pext.
+void WriteMagicSource(const Magic& m, const PextMagic& pext,
+                      std::ostream& out);
+
+}  // namespace magic
+}  // namespace chess
+
+#endif
@@ -0,0 +1,16 @@
+// Generates magic_table.cpp, see the "magic_table" genrule.
+#include <iostream>
+#include <memory>
+
+#include "chess/magic.h"
+#include "chess/magic_gen.h"
+
+int main(int argc, char** argv) {
+  // Too large for the stack.
+  auto m = std::make_unique<chess::magic::Magic>();
+  auto pext = std::make_unique<chess::magic::PextMagic>();
+  chess::magic::GenerateMagic(m.get());
+  chess::magic::GeneratePextMagic(*m, pext.get());
+  chess::magic::WriteMagicSource(*m, *pext, std::cout);
+  return 0;
+}
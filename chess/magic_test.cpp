@@ -1,9 +1,14 @@
 #include "chess/magic.h"
 
 #include <cstdint>
+#include <cstring>
+#include <memory>
+#include <random>
 #include <vector>
 
 #include "chess/bitboard.h"
+#include "chess/magic_gen.h"
+#include "chess/square.h"
 #include "gmock/gmock.h"
 #include "gtest/gtest.h"
 
@@ -43,7 +48,29 @@ MATCHER_P(MatchesBitboard, str, "") {
   return true;
 }
 
-TEST(MagicTest, Initialize) { InitializeMagic(); }
+TEST(MagicTest, MatchesGenerator) {
+  // The build-time table must be what the generator currently produces.
+  auto generated = std::make_unique<magic::Magic>();
+  magic::GenerateMagic(generated.get());
+  EXPECT_EQ(memcmp(generated.get(), &magic::m, sizeof(magic::Magic)), 0);
+  auto pext = std::make_unique<magic::PextMagic>();
+  magic::GeneratePextMagic(*generated, pext.get());
+  EXPECT_EQ(memcmp(pext.get(), &magic::pext, sizeof(magic::PextMagic)), 0);
+}
+
+TEST(MagicTest, PextMatchesMagic) {
+  std::mt19937_64 rand;
+  for (int i = 0; i < 1000; ++i) {
+    // Sparse random occupancy, like in real positions.
+    const uint64_t occ = rand() & rand();
+    for (int sq = 0; sq < 64; ++sq) {
+      ASSERT_EQ(magic::pext.bishop.GetMask(sq, occ),
+                magic::m.bishop_magics.GetMask(sq, occ));
+      ASSERT_EQ(magic::pext.rook.GetMask(sq, occ),
+                magic::m.rook_magics.GetMask(sq, occ));
+    }
+  }
+}
 
 TEST(MagicTest, TestutilSanity) {
   EXPECT_THAT(kOpp, MatchesBitboard(kOppStr));
@@ -51,8 +78,6 @@ TEST(MagicTest, TestutilSanity) {
 }
 
 TEST(MagicTest, Knight) {
-  InitializeMagic();
-
   EXPECT_THAT(KnightMoveMask(MakeSquare(2, 2)), MatchesBitboard("01010000\n"
                                                                 "10001000\n"
                                                                 "00000000\n"
@@ -73,7 +98,6 @@ TEST(MagicTest, Knight) {
 }
 
 TEST(MagicTest, BishopMoves) {
-  InitializeMagic();
   EXPECT_THAT(
       BishopMoveMask(MakeSquare(2, 2), BitboardFromString("00111010\n"
                                                           "01000000\n"
@@ -112,7 +136,6 @@ TEST(MagicTest, BishopMoves) {
 }
 
 TEST(MagicTest, RookMoves) {
-  InitializeMagic();
   EXPECT_THAT(RookMoveMask(MakeSquare(2, 2), BitboardFromString("00111010\n"
                                                                 "01000000\n"
                                                                 "00100100\n"
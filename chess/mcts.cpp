@@ -1,52 +1,96 @@
 #include "chess/mcts.h"
 
+#include <algorithm>
+#include <atomic>
 #include <cmath>
+#include <functional>
+#include <limits>
+#include <queue>
+#include <utility>
+#include <vector>
 
-#include "absl/container/flat_hash_set.h"
 #include "chess/movegen.h"
 #include "chess/types.h"
+#include "generic/puct.h"
 #include "tensorflow/core/platform/logging.h"
 
 namespace chess {
 
 namespace mcts {
 
-struct Action {
-  Move move;
-  // Prior doesn't change after construction.
-  double prior = 0.0;
+namespace {
 
-  int num_virtual = 0;
-  int num_taken = 0;
-  double total_value = 0;
-  State* state = nullptr;
+// Moves are stored in 16 bits. The move type is recomputed by the board when
+// the move is made.
+uint16_t PackMove(const Move& m) {
+  return m.from | m.to << 6 | static_cast<int>(m.promotion) << 12;
+}
 
-  void AddResult(double v);
-};
+Move UnpackMove(uint16_t m) {
+  return Move(m & 63, (m >> 6) & 63, static_cast<Piece>(m >> 12));
+}
+
+}  // namespace
+
+// Action statistics are stored as parallel arrays, so that PickAction() can
+// score all actions at once with SIMD. They are packed to 16 bytes per
+// action: the move and prior take 16 bits each, the visit counts are packed
+// as in generic::CompactPuctStats, and children are 32-bit indices into
+// MCTS::nodes_.
+//
+// Search threads update the statistics concurrently. All accesses are
+// relaxed: PickAction() only needs approximately current values, and reads
+// them with plain vector loads. Children are published with release stores.
+static_assert(sizeof(std::atomic<uint16_t>) == sizeof(uint16_t) &&
+              std::atomic<uint16_t>::is_always_lock_free);
+static_assert(sizeof(std::atomic<uint32_t>) == sizeof(uint32_t) &&
+              std::atomic<uint32_t>::is_always_lock_free);
+static_assert(sizeof(std::atomic<float>) == sizeof(float) &&
+              std::atomic<float>::is_always_lock_free);
 
 struct State {
-  State(const Board& b, const PredictionResult& p)
-      : turn(b.turn()),
-        is_terminal(false),
-        winner(Color::kEmpty) {
+  State(util::Arena* arena, const Board& b, const PredictionResult& p)
+      : State(arena, b.turn(), false, Color::kEmpty, p.policy.size()) {
     CHECK_GT(p.policy.size(), 0);
     // Give a positive prior to all moves, so that we still sometimes explore
     // them in case the prediction network gives a zero weight for the move.
     const double add = 0.05 / p.policy.size();
     const double new_total = 1.0 + p.policy.size() * add;
-    actions.reserve(p.policy.size());
-    for (auto& move : p.policy) {
-      actions.emplace_back();
-      Action& a = actions.back();
-      a.move = move.first;
-      a.prior = (move.second + add) / new_total;
+    for (int i = 0; i < num_actions; ++i) {
+      moves[i] = PackMove(p.policy[i].first);
+      priors[i].store(
+          generic::FloatToHalf((p.policy[i].second + add) / new_total),
+          std::memory_order_relaxed);
     }
   }
 
-  State(const Board& b, Color winner)
-      : turn(b.turn()),
-        is_terminal(true),
-        winner(winner) {}
+  State(util::Arena* arena, const Board& b, Color winner)
+      : State(arena, b.turn(), true, winner, 0) {
+    proof = winner == Color::kEmpty ? MCTS::Proof::kDraw : MCTS::Proof::kLoss;
+  }
+
+  // A position proven by the tablebase. It has no actions until it becomes
+  // the root, see MCTS::SetRoot().
+  State(util::Arena* arena, const Board& b, MCTS::Proof p)
+      : State(arena, b.turn(), false, Color::kEmpty, 0) {
+    proof = p;
+  }
+
+  // Copies 'other' to 'arena'. Children still refer to the old states.
+  State(util::Arena* arena, const State& other)
+      : State(arena, other.turn, other.is_terminal, other.winner,
+              other.num_actions) {
+    std::copy_n(other.moves, num_actions, moves);
+    for (int a = 0; a < num_actions; ++a) {
+      priors[a].store(other.priors[a].load(std::memory_order_relaxed),
+                      std::memory_order_relaxed);
+      visits[a].store(other.visits[a].load(std::memory_order_relaxed),
+                      std::memory_order_relaxed);
+      total_value[a].store(other.total(a), std::memory_order_relaxed);
+      children[a].store(other.child(a), std::memory_order_relaxed);
+    }
+    proof.store(other.GetProof(), std::memory_order_relaxed);
+  }
 
   State(const State&) = delete;
   State& operator=(const State&) = delete;
@@ -61,23 +105,110 @@ struct State {
       return -1;
     }
   }
+
+  Move move(int a) const { return UnpackMove(moves[a]); }
+  float prior(int a) const {
+    return generic::HalfToFloat(priors[a].load(std::memory_order_relaxed));
+  }
+  int num_taken(int a) const {
+    return visits[a].load(std::memory_order_relaxed) & generic::kTakenMask;
+  }
+  int num_virtual(int a) const {
+    return visits[a].load(std::memory_order_relaxed) >> generic::kTakenBits;
+  }
+  float total(int a) const {
+    return total_value[a].load(std::memory_order_relaxed);
+  }
+  uint32_t child(int a) const {
+    return children[a].load(std::memory_order_acquire);
+  }
+  MCTS::Proof GetProof() const { return proof.load(std::memory_order_relaxed); }
+
+  void AddResult(int a, double v) {
+    const uint32_t old = visits[a].fetch_add(1, std::memory_order_relaxed);
+    CHECK_LT(old & generic::kTakenMask, generic::kTakenMask);
+    float t = total(a);
+    while (!total_value[a].compare_exchange_weak(
+        t, static_cast<float>(t + v), std::memory_order_relaxed)) {
+    }
+  }
+  void AddVirtual(int a) {
+    const uint32_t old =
+        visits[a].fetch_add(generic::kOneVirtual, std::memory_order_relaxed);
+    CHECK_LT(old >> generic::kTakenBits, generic::kMaxVirtual);
+  }
+  void RemoveVirtual(int a) {
+    const uint32_t old =
+        visits[a].fetch_sub(generic::kOneVirtual, std::memory_order_relaxed);
+    CHECK_GT(old >> generic::kTakenBits, 0);
+  }
+
+  generic::CompactPuctStats puct_stats() const {
+    return {reinterpret_cast<const uint16_t*>(priors),
+            reinterpret_cast<const uint32_t*>(visits),
+            reinterpret_cast<const float*>(total_value), num_actions};
+  }
+
+  bool is_tablebase_leaf() const { return !is_terminal && num_actions == 0; }
+
   // const BoardFP fp;
   const Color turn;
   const bool is_terminal;
   const Color winner;
-  std::vector<Action> actions;
+  // Only ever changes from kUnknown to a proven value.
+  std::atomic<MCTS::Proof> proof{MCTS::Proof::kUnknown};
+  const int num_actions;
+  // Contiguous in the arena. Moves don't change after construction. Priors
+  // only change when the action is excluded.
+  uint16_t* const moves;
+  std::atomic<uint16_t>* const priors;
+  std::atomic<uint32_t>* const visits;
+  std::atomic<float>* const total_value;
+  // Zero for actions not yet expanded. Set only once, see
+  // MCTS::LinkChild().
+  std::atomic<uint32_t>* const children;
+
+ private:
+  State(util::Arena* arena, Color turn, bool is_terminal, Color winner, int n)
+      : turn(turn),
+        is_terminal(is_terminal),
+        winner(winner),
+        num_actions(n),
+        moves(arena->NewArray<uint16_t>(n)),
+        priors(arena->NewArray<std::atomic<uint16_t>>(n)),
+        visits(arena->NewArray<std::atomic<uint32_t>>(n)),
+        total_value(arena->NewArray<std::atomic<float>>(n)),
+        children(arena->NewArray<std::atomic<uint32_t>>(n)) {}
 };
 
-void Action::AddResult(double v) {
-  num_taken += 1;
-  total_value += v;
-  // mean_value = total_value / num_taken;
-  // CHECK(state != nullptr);
-  if (state != nullptr) {
-    if (state->is_terminal) {
-      CHECK_EQ(v, -state->terminal_value());
-    }
+uint32_t StateTable::Add(State* s) {
+  CHECK_LT(size_, uint64_t{1} << 32);
+  const uint64_t j = size_ + kFirstChunkSize;
+  const int chunk = 63 - __builtin_clzll(j) - kFirstChunkBits;
+  if (chunks_[chunk] == nullptr) {
+    chunks_[chunk].reset(new State*[kFirstChunkSize << chunk]);
   }
+  chunks_[chunk][j - (kFirstChunkSize << chunk)] = s;
+  return size_++;
+}
+
+void StateTable::Set(uint32_t i, State* s) {
+  CHECK_LT(i, size_);
+  const uint64_t j = uint64_t{i} + kFirstChunkSize;
+  const int chunk = 63 - __builtin_clzll(j) - kFirstChunkBits;
+  chunks_[chunk][j - (kFirstChunkSize << chunk)] = s;
+}
+
+void StateTable::Clear() {
+  size_ = 0;
+  Add(nullptr);
+}
+
+void StateTable::Swap(StateTable* other) {
+  for (int k = 0; k < kNumChunks; ++k) {
+    chunks_[k].swap(other->chunks_[k]);
+  }
+  std::swap(size_, other->size_);
 }
 
 // Important points from AlphaGo paper:
@@ -92,62 +223,52 @@ void Action::AddResult(double v) {
 
 namespace {
 
-using mcts::Action;
 using mcts::ActionRef;
 using mcts::State;
+using Proof = MCTS::Proof;
+
+const float kPUCT = 1.0;
+
+// Value of a proven state for the player to move.
+double ProofValue(Proof p) {
+  switch (p) {
+    case Proof::kWin:
+      return 1.0;
+    case Proof::kLoss:
+      return -1.0;
+    default:
+      return 0.0;
+  }
+}
 
-const double kPUCT = 1.0;
-const double kDirichletA = 0.3;
-const double kDirichletMul = 0.2;
-
-
-Action* PickAction(std::mt19937& rand, State& s, bool dirichlet) {
-  std::vector<double> dir;
-  if (dirichlet) {
-    dir.resize(s.actions.size());
-    std::gamma_distribution<double> gamma(kDirichletA, 1.0);
-    double gamma_sum = 0;
-    for (double& g : dir) {
-      g = gamma(rand);
-      gamma_sum += g;
-    }
-    for (double& g : dir) {
-      g /= gamma_sum;
-    }
+Proof TablebaseProof(const TablebaseResult& r) {
+  if (r.wdl > 0) {
+    return Proof::kWin;
   }
+  return r.wdl < 0 ? Proof::kLoss : Proof::kDraw;
+}
 
-  int num_sum = 0;
-  for (auto& action : s.actions) {
-    num_sum += action.num_taken + action.num_virtual;
+// Proof of a child state which gives 'p' to its parent.
+Proof ChildProofFor(Proof p) {
+  switch (p) {
+    case Proof::kWin:
+      return Proof::kLoss;
+    case Proof::kLoss:
+      return Proof::kWin;
+    default:
+      return p;
   }
-  double best_score = -10000;
-  const double num_sum_sqrt = sqrt(num_sum);
-  const auto score_move = [num_sum, num_sum_sqrt, &dir](const Action& action,
-                                                        int i) -> double {
-    const double prior = dir.empty() ? action.prior
-                                     : action.prior * (1 - kDirichletMul) +
-                                           kDirichletMul * dir[i];
-    if (num_sum == 0) {
-      return prior;
-    } else {
-      const int num = action.num_taken + action.num_virtual;
-      // Reminder: virtual moves are counted as losses for both players.
-      double mean_value =
-          num == 0 ? 0 : (action.total_value - action.num_virtual) / num;
-      return mean_value + kPUCT * prior * num_sum_sqrt / (1.0 + num);
-    }
-  };
-  Action* best_action = nullptr;
-  for (int i = 0; i < s.actions.size(); ++i) {
-    Action& action = s.actions[i];
-    const double score = score_move(action, i);
-    if (score > best_score) {
-      best_score = score;
-      best_action = &action;
-    }
+}
+
+
+// Uses 'priors' instead of the state's own priors, if given.
+int PickAction(const State& s, const uint16_t* priors) {
+  CHECK_GT(s.num_actions, 0);
+  generic::CompactPuctStats stats = s.puct_stats();
+  if (priors != nullptr) {
+    stats.prior = priors;
   }
-  CHECK_NE(best_action, nullptr);
-  return best_action;
+  return generic::PuctArgmax(stats, kPUCT);
 }
 
 }  // namespace
@@ -158,48 +279,118 @@ MCTS::~MCTS() {}
 
 const Board& MCTS::current_board() const { return current_; }
 
+uint32_t MCTS::AddState(State* s) { return nodes_.Add(s); }
+
+uint32_t MCTS::FindState(BoardFP fp) {
+  absl::MutexLock lock(&mu_);
+  const auto it = visited_states_.find(fp);
+  return it == visited_states_.end() ? 0 : it->second;
+}
+
+template <typename... Args>
+uint32_t MCTS::FindOrAddState(BoardFP fp, Args&&... args) {
+  absl::MutexLock lock(&mu_);
+  uint32_t& index = visited_states_[fp];
+  if (index == 0) {
+    index = AddState(arena_.New<State>(&arena_, std::forward<Args>(args)...));
+    if (visited_states_.size() > max_states_) {
+      gc_wanted_.store(true, std::memory_order_relaxed);
+    }
+  }
+  return index;
+}
+
+uint32_t MCTS::LinkChild(State* s, int a, uint32_t index) {
+  uint32_t linked = 0;
+  if (s->children[a].compare_exchange_strong(linked, index,
+                                             std::memory_order_acq_rel)) {
+    return index;
+  }
+  // Another thread linked the same position first.
+  return linked;
+}
+
 std::unique_ptr<MCTS::PredictionRequest> MCTS::StartIteration() {
   CHECK(root_ != nullptr);
-  absl::flat_hash_set<uint64_t> path_visit;
-  path_visit.reserve(16);
+  if (gc_wanted_.load(std::memory_order_relaxed)) {
+    absl::MutexLock gc_lock(&gc_mu_);
+    if (gc_wanted_.load(std::memory_order_relaxed)) {
+      if (num_pending_.load(std::memory_order_relaxed) > 0) {
+        // Pending iterations refer to the current states.
+        return nullptr;
+      }
+      CollectGarbage(max_states_ - max_states_ / 4);
+      gc_wanted_.store(false, std::memory_order_relaxed);
+    }
+  }
+  absl::ReaderMutexLock gc_lock(&gc_mu_);
   State* cur = root_;
   CHECK(!cur->is_terminal);
+  if (cur->GetProof() != Proof::kUnknown) {
+    // Solved, nothing to search.
+    return nullptr;
+  }
 
   PredictionRequest::PathVec picked_path;
+  // Hashes of the positions after each move of 'picked_path', following
+  // 'hashes_'.
+  absl::InlinedVector<uint64_t, 32> path_hashes;
+  const int num_game_hashes = hashes_.size();
+  const auto hash_at = [&](int i) {
+    return i < num_game_hashes ? hashes_[i]
+                               : path_hashes[i - num_game_hashes];
+  };
   Board cur_board = current_;
+  // Only needed by MakeMove(), we never walk back up.
+  Board::UndoInfo undo;
   while (true) {
     CHECK_EQ(cur_board.turn(), cur->turn);
     // CHECK_EQ(BoardFingerprint(cur_board), cur->fp) << cur_board;
-    Action* best_action = PickAction(rand_, *cur, cur == root_);
-    picked_path.emplace_back(cur, best_action);
-    cur_board = Board(cur_board, best_action->move);
+    const int best_a = PickAction(
+        *cur, cur == root_ && root_priors_ != nullptr
+                  ? reinterpret_cast<const uint16_t*>(root_priors_.get())
+                  : nullptr);
+    picked_path.emplace_back(cur, best_a);
+    uint32_t child = cur->child(best_a);
+    cur_board.MakeMove(cur->move(best_a), &undo);
 
     const auto cur_fp = BoardFingerprint(cur_board);
 
-    // Check for a repetition draw. This also ensures that we don't get stuck
-    // in an infinite loop.
-    // TODO: Also compare with visited_, and only check for threefold
-    // repetition.
-    const bool loop = !path_visit.insert(cur_board.board_hash()).second;
-    auto visited_it = visited_.find(cur_board.board_hash());
-    const int history_count =
-        visited_it == visited_.end() ? 0 : visited_it->second;
-    if (loop || history_count > 2) {
+    // Check for a repetition draw: any repetition within the search (which
+    // also ensures that we don't get stuck in an infinite loop), or a
+    // threefold one counting the game history. Only positions since the last
+    // irreversible move can repeat, and only every other one has the same
+    // side to move.
+    const uint64_t hash = cur_board.board_hash();
+    const int end = num_game_hashes + path_hashes.size();
+    const int begin = std::max(0, end - cur_board.no_progress_count());
+    int search_reps = 0;
+    int game_reps = 0;
+    for (int i = end - 2; i >= begin; i -= 2) {
+      if (hash_at(i) == hash) {
+        ++(i >= root_index_ ? search_reps : game_reps);
+      }
+    }
+    path_hashes.push_back(hash);
+    if (search_reps > 0 || game_reps >= 2) {
       // Don't create a terminal node, but update all actions.
       CHECK(!picked_path.empty());
       for (auto e : picked_path) {
         // Draw.
-        e.a->AddResult(0);
+        e.s->AddResult(e.a, 0);
       }
       return nullptr;
     }
 
-    if (best_action->state == nullptr) {
+    if (child == 0) {
       // See if we already visited this state via some other path.
-      const auto trans_it = visited_states_.find(cur_fp);
-      if (trans_it != visited_states_.end()) {
-        CHECK(trans_it->second != nullptr);
-        best_action->state = trans_it->second.get();
+      child = FindState(cur_fp);
+      if (child != 0) {
+        child = LinkChild(cur, best_a, child);
+      } else if (const auto r = ProbeTablebase(cur_board)) {
+        child = LinkChild(
+            cur, best_a,
+            FindOrAddState(cur_fp, cur_board, TablebaseProof(*r)));
       } else {
         std::vector<Move> moves;
         MovegenResult res = IterateLegalMoves(
@@ -219,36 +410,36 @@ std::unique_ptr<MCTS::PredictionRequest> MCTS::StartIteration() {
           case MovegenResult::kNotOver: {
             // Increment virtual counts - this will be undone by Finish.
             for (auto e : picked_path) {
-              ++e.a->num_virtual;
+              e.s->AddVirtual(e.a);
             }
             std::unique_ptr<PredictionRequest> request(new PredictionRequest());
             request->picked_path_ = std::move(picked_path);
             request->parent_ = cur;
-            request->parent_a_ = best_action;
+            request->parent_a_ = best_a;
             request->board_ = cur_board;
             request->moves_ = std::move(moves);
+            num_pending_.fetch_add(1, std::memory_order_relaxed);
             return request;
           }
         }
         CHECK(is_terminal);
         // Add terminal node here.
-        auto new_term = std::make_unique<State>(cur_board, winner);
-        best_action->state = new_term.get();
-        CHECK(visited_states_.emplace(cur_fp, std::move(new_term)).second);
+        child = LinkChild(cur, best_a,
+                          FindOrAddState(cur_fp, cur_board, winner));
       }
     }
-    cur = best_action->state;
+    cur = nodes_[child];
     CHECK(cur);
-    // This could be a new terminal node, or one we've discovered before.
-    if (cur->is_terminal) {
-      // LOG(INFO) << "path len: " << picked_path.size();
-      // Terminal node, can't iterate.
+    // This could be a new terminal or tablebase node, or a proven one we've
+    // discovered before. Either way there's nothing more to search below it.
+    const Proof proof = cur->GetProof();
+    if (proof != Proof::kUnknown) {
       CHECK(!picked_path.empty());
       for (auto e : picked_path) {
-        // Terminal nodes have turn of the loser.
         const double mul = e.s->turn == cur_board.turn() ? 1.0 : -1.0;
-        e.a->AddResult(mul * cur->terminal_value());
+        e.s->AddResult(e.a, mul * ProofValue(proof));
       }
+      UpdateProofs(picked_path);
       return nullptr;
     }
   }
@@ -257,22 +448,17 @@ std::unique_ptr<MCTS::PredictionRequest> MCTS::StartIteration() {
 void MCTS::FinishIteration(std::unique_ptr<PredictionRequest> req,
                            const PredictionResult& p) {
   CHECK(root_ != nullptr);
+  absl::ReaderMutexLock gc_lock(&gc_mu_);
 
   CHECK(req->parent_ != nullptr);
-  auto& action = *req->parent_a_;
   // It's possible that 'state' was already added by a previous call to
   // FinishIteration(). StartIteration() may return the same position twice in
   // case the first iteration has not yet been finished.
-  if (action.state == nullptr) {
-    const auto fp = BoardFingerprint(req->board());
+  if (req->parent_->child(req->parent_a_) == 0) {
     // It's possible that another pending request already populated this state,
     // in which case we must reuse it.
-    auto& old_state = visited_states_[fp];
-    if (old_state == nullptr) {
-      // Initialize next state.
-      old_state = std::make_unique<State>(req->board(), p);
-    }
-    action.state = old_state.get();
+    LinkChild(req->parent_, req->parent_a_,
+              FindOrAddState(BoardFingerprint(req->board()), req->board(), p));
   }
   CHECK_EQ(req->picked_path_.back().s, req->parent_);
   for (auto e : req->picked_path_) {
@@ -281,38 +467,186 @@ void MCTS::FinishIteration(std::unique_ptr<PredictionRequest> req,
     // more weight than strong prediction outputs. This hopefully makes us seek
     // winning terminal nodes and avoid losing ones harder.
     const double kUncertainty = 1.0;
-    e.a->AddResult(mul * p.value * kUncertainty);
-    --e.a->num_virtual;
+    e.s->AddResult(e.a, mul * p.value * kUncertainty);
+    e.s->RemoveVirtual(e.a);
   }
+  // The state may be a proven one, reached via a transposition.
+  UpdateProofs(req->picked_path_);
+  num_pending_.fetch_sub(1, std::memory_order_relaxed);
 }
 
 int MCTS::num_iterations() const {
+  absl::ReaderMutexLock gc_lock(&gc_mu_);
   if (root_ == nullptr) {
     return 0;
   }
   int sum = 0;
-  for (const auto& action : root_->actions) {
-    sum += action.num_taken;
+  for (int a = 0; a < root_->num_actions; ++a) {
+    sum += root_->num_taken(a);
   }
   return sum;
 }
 
+void MCTS::UpdateProofs(const PredictionRequest::PathVec& path) {
+  for (auto it = path.rbegin(); it != path.rend(); ++it) {
+    const State* child = nodes_[it->s->child(it->a)];
+    const Proof child_proof =
+        child == nullptr ? Proof::kUnknown : child->GetProof();
+    if (child_proof == Proof::kUnknown) {
+      return;
+    }
+    if (child_proof == Proof::kWin) {
+      // Never worth searching again. Proven draws and wins are still picked,
+      // which is cheap as they end the iteration right away.
+      Exclude(it->s, it->a);
+    }
+    const Proof proof = ComputeProof(*it->s);
+    if (proof == Proof::kUnknown) {
+      return;
+    }
+    // Threads proving the same state compute the same proof.
+    it->s->proof.store(proof, std::memory_order_relaxed);
+  }
+}
+
+void MCTS::Exclude(State* s, int a) {
+  const uint16_t minus_inf =
+      generic::FloatToHalf(-std::numeric_limits<float>::infinity());
+  s->priors[a].store(minus_inf, std::memory_order_relaxed);
+  if (s == root_ && root_priors_ != nullptr) {
+    root_priors_[a].store(minus_inf, std::memory_order_relaxed);
+  }
+}
+
+Proof MCTS::ComputeProof(const State& s) const {
+  bool all_proven = true;
+  bool any_draw = false;
+  for (int a = 0; a < s.num_actions; ++a) {
+    const State* child = nodes_[s.child(a)];
+    const Proof p = child == nullptr ? Proof::kUnknown : child->GetProof();
+    if (p == Proof::kLoss) {
+      return Proof::kWin;
+    }
+    all_proven &= p != Proof::kUnknown;
+    any_draw |= p == Proof::kDraw;
+  }
+  if (!all_proven) {
+    return Proof::kUnknown;
+  }
+  return any_draw ? Proof::kDraw : Proof::kLoss;
+}
+
+int MCTS::BestAction(const State& s) const {
+  const Proof proof = s.GetProof();
+  if (proof == Proof::kWin || proof == Proof::kDraw) {
+    for (int a = 0; a < s.num_actions; ++a) {
+      const State* child = nodes_[s.child(a)];
+      if (child != nullptr && child->GetProof() == ChildProofFor(proof)) {
+        return a;
+      }
+    }
+  }
+  int best = -1;
+  int best_taken = 0;
+  for (int a = 0; a < s.num_actions; ++a) {
+    const int taken = s.num_taken(a);
+    if (taken > best_taken) {
+      best = a;
+      best_taken = taken;
+    }
+  }
+  return best;
+}
+
+MCTS::Proof MCTS::root_proof() const {
+  absl::ReaderMutexLock gc_lock(&gc_mu_);
+  return root_->GetProof();
+}
+
+void MCTS::GetRootVisits(std::vector<int>* visits) const {
+  absl::ReaderMutexLock gc_lock(&gc_mu_);
+  visits->clear();
+  for (int a = 0; a < root_->num_actions; ++a) {
+    visits->push_back(root_->num_taken(a));
+  }
+}
+
+std::vector<Move> MCTS::GetPrincipalVariation(int max_length) const {
+  absl::ReaderMutexLock gc_lock(&gc_mu_);
+  std::vector<Move> pv;
+  // Transpositions can form cycles, which 'max_length' also cuts.
+  Board b = current_;
+  const State* s = root_;
+  while (pv.size() < static_cast<size_t>(max_length)) {
+    Move m;
+    if (ProbeTablebase(b).has_value()) {
+      const std::vector<Move> best = tablebase_->BestMoves(b);
+      if (best.empty()) {
+        break;
+      }
+      m = best[0];
+    } else {
+      const int best = s == nullptr ? -1 : BestAction(*s);
+      if (best < 0) {
+        break;
+      }
+      m = s->move(best);
+      s = nodes_[s->child(best)];
+    }
+    pv.push_back(m);
+    b = Board(b, m);
+  }
+  return pv;
+}
+
 PredictionResult MCTS::GetPrediction() const {
+  absl::ReaderMutexLock gc_lock(&gc_mu_);
   PredictionResult res;
   CHECK(root_ != nullptr);
+  // Read each action once, as other threads may be updating them.
+  std::vector<int> taken(root_->num_actions);
   int sum_n = 0;
-  for (const auto& action : root_->actions) {
-    sum_n += action.num_taken;
-    CHECK(action.num_virtual == 0) << "m=" << action.move;
+  for (int a = 0; a < root_->num_actions; ++a) {
+    taken[a] = root_->num_taken(a);
+    sum_n += taken[a];
   }
   CHECK(sum_n != 0);
   const double inv_sum = 1.0 / sum_n;
   res.value = 0;
 
-  for (const auto& action : root_->actions) {
-    const int num = action.num_taken;
-    res.policy.emplace_back(action.move, num * inv_sum);
-    res.value += action.total_value * inv_sum;
+  for (int a = 0; a < root_->num_actions; ++a) {
+    res.policy.emplace_back(root_->move(a), taken[a] * inv_sum);
+    res.value += root_->total(a) * inv_sum;
+  }
+
+  if (const auto r = ProbeTablebase(current_)) {
+    const std::vector<Move> best = tablebase_->BestMoves(current_);
+    CHECK(!best.empty());
+    for (auto& move : res.policy) {
+      const bool is_best =
+          std::find(best.begin(), best.end(), move.first) != best.end();
+      move.second = is_best ? 1.0 / best.size() : 0.0;
+    }
+    res.value = r->wdl;
+    return res;
+  }
+  const Proof root_proof = root_->GetProof();
+  if (root_proof == Proof::kWin || root_proof == Proof::kDraw) {
+    int num_best = 0;
+    for (int a = 0; a < root_->num_actions; ++a) {
+      const State* child = nodes_[root_->child(a)];
+      const bool best =
+          child != nullptr && child->GetProof() == ChildProofFor(root_proof);
+      res.policy[a].second = best ? 1.0 : 0.0;
+      num_best += best;
+    }
+    CHECK_GT(num_best, 0);
+    for (auto& move : res.policy) {
+      move.second /= num_best;
+    }
+  }
+  if (root_proof != Proof::kUnknown) {
+    res.value = ProofValue(root_proof);
   }
 
   return res;
@@ -330,32 +664,96 @@ Prediction MCTS::GetPrior() const {
 #endif
 
 void MCTS::MakeMove(Move m) {
+  CHECK_EQ(num_pending_.load(), 0);
   bool found = false;
-  for (auto& action : root_->actions) {
-    if (action.move == m) {
+  for (int a = 0; a < root_->num_actions; ++a) {
+    if (root_->move(a) == m) {
       found = true;
-      root_ = action.state;
+      root_ = nodes_[root_->child(a)];
       break;
     }
   }
   CHECK(found) << current_.ToFEN() << " m " << m << "\n";
-  current_ = Board(current_, m);
+  Board::UndoInfo undo;
+  current_.MakeMove(m, &undo);
 
-  if (root_ != nullptr) {
+  if (root_ != nullptr && !root_->is_tablebase_leaf()) {
     CHECK_EQ(current_.turn(), root_->turn);
     // CHECK_EQ(BoardFingerprint(current_), root_->fp);
   } else {
-    SetBoard(current_);
+    SetRoot(current_);
   }
-  ++visited_[current_.board_hash()];
+  hashes_.resize(root_index_ + 1);
+  hashes_.push_back(current_.board_hash());
+  root_index_ = hashes_.size() - 1;
+  CollectGarbage(max_states_);
+  gc_wanted_ = false;
+  SampleRootNoise();
 }
 
 void MCTS::SetBoard(const Board& b) {
   current_ = b;
-  visited_.clear();
+  hashes_.clear();
+  hashes_.push_back(b.board_hash());
+  root_index_ = 0;
+  {
+    absl::MutexLock lock(&mu_);
+    visited_states_.clear();
+    arena_.Reset();
+  }
+  nodes_.Clear();
+  num_pending_ = 0;
+  gc_wanted_ = false;
+  SetRoot(b);
+  SampleRootNoise();
+}
+
+void MCTS::SetRootNoise(double alpha, double fraction) {
+  noise_alpha_ = alpha;
+  noise_fraction_ = fraction;
+  SampleRootNoise();
+}
+
+void MCTS::SampleRootNoise() {
+  root_priors_.reset();
+  if (noise_fraction_ <= 0 || root_->num_actions == 0) {
+    return;
+  }
+  std::gamma_distribution<double> gamma(noise_alpha_, 1.0);
+  std::vector<double> dir(root_->num_actions);
+  double gamma_sum = 0;
+  for (double& g : dir) {
+    g = gamma(rand_);
+    gamma_sum += g;
+  }
+  root_priors_.reset(new std::atomic<uint16_t>[root_->num_actions]);
+  for (int i = 0; i < root_->num_actions; ++i) {
+    root_priors_[i].store(
+        generic::FloatToHalf(root_->prior(i) * (1 - noise_fraction_) +
+                             noise_fraction_ * dir[i] / gamma_sum),
+        std::memory_order_relaxed);
+  }
+}
+
+absl::optional<TablebaseResult> MCTS::ProbeTablebase(const Board& b) const {
+  if (tablebase_ == nullptr) {
+    return absl::nullopt;
+  }
+  return tablebase_->Probe(b);
+}
+
+size_t MCTS::num_states() const {
+  absl::MutexLock lock(&mu_);
+  return visited_states_.size();
+}
+
+void MCTS::SetRoot(const Board& b) {
   const auto fp = BoardFingerprint(b);
+  absl::MutexLock lock(&mu_);
   const auto it = visited_states_.find(fp);
-  if (it == visited_states_.end()) {
+  // Tablebase leaves are replaced by a searchable state, as the root needs
+  // actions.
+  if (it == visited_states_.end() || nodes_[it->second]->is_tablebase_leaf()) {
     // Start with even split over all legal moves.
     // TODO: This is not correct, fix this.
     PredictionResult even;
@@ -364,25 +762,132 @@ void MCTS::SetBoard(const Board& b) {
     for (auto& move : even.policy) {
       move.second /= even.policy.size();
     }
-    std::unique_ptr<State> new_root;
+    State* new_root = nullptr;
     // TODO: Extract this to a function.
     switch (res) {
       case MovegenResult::kCheckmate:
         // player to move lost.
-        new_root = std::make_unique<State>(b, OtherColor(b.turn()));
+        new_root = arena_.New<State>(&arena_, b, OtherColor(b.turn()));
         break;
       case MovegenResult::kStalemate:
-        new_root = std::make_unique<State>(b, Color::kEmpty);
+        new_root = arena_.New<State>(&arena_, b, Color::kEmpty);
         break;
       case MovegenResult::kNotOver:
-        new_root = std::make_unique<State>(b, even);
+        new_root = arena_.New<State>(&arena_, b, even);
         break;
     }
-    root_ = new_root.get();
-    visited_states_[fp] = std::move(new_root);
+    root_ = new_root;
+    if (it == visited_states_.end()) {
+      visited_states_[fp] = AddState(new_root);
+    } else {
+      nodes_.Set(it->second, new_root);
+    }
   } else {
-    root_ = it->second.get();
+    root_ = nodes_[it->second];
+  }
+}
+
+void MCTS::CollectGarbage(size_t max_states) {
+  CHECK_EQ(num_pending_.load(), 0);
+  CHECK(root_ != nullptr);
+  absl::MutexLock lock(&mu_);
+  // Find all states reachable from the root. The tree is really a DAG due to
+  // transpositions, so a state can have several parents. Boards are needed to
+  // recompute the fingerprints.
+  struct Reachable {
+    State* state;
+    Board board;
+    // Highest visit count of an action leading here.
+    int visits;
+    // Parent for each action leading here.
+    absl::InlinedVector<int, 1> parents = {};
+    // Actions leading to states which are not evicted.
+    int num_children = 0;
+    bool evicted = false;
+  };
+  std::vector<Reachable> reachable;
+  absl::flat_hash_map<const State*, int> index;
+  reachable.push_back({root_, current_, std::numeric_limits<int>::max()});
+  index[root_] = 0;
+  for (size_t i = 0; i < reachable.size(); ++i) {
+    const State* s = reachable[i].state;
+    for (int a = 0; a < s->num_actions; ++a) {
+      State* const child_state = nodes_[s->child(a)];
+      if (child_state == nullptr) {
+        continue;
+      }
+      const auto [it, inserted] = index.emplace(child_state, reachable.size());
+      if (inserted) {
+        Board child = reachable[i].board;
+        Board::UndoInfo undo;
+        child.MakeMove(s->move(a), &undo);
+        reachable.push_back({child_state, child, s->num_taken(a)});
+      }
+      Reachable& r = reachable[it->second];
+      r.visits = std::max(r.visits, s->num_taken(a));
+      r.parents.push_back(i);
+      ++reachable[i].num_children;
+    }
+  }
+
+  size_t num_kept = reachable.size();
+  if (num_kept > max_states) {
+    // Evict the least visited leaves first. Evicting all children of a state
+    // makes it a leaf too. The root is never evicted, and neither are proven
+    // states, as the proofs of their parents and the best moves depend on
+    // them.
+    using Leaf = std::pair<int, int>;
+    std::priority_queue<Leaf, std::vector<Leaf>, std::greater<Leaf>> leaves;
+    for (size_t i = 1; i < reachable.size(); ++i) {
+      if (reachable[i].num_children == 0 &&
+          reachable[i].state->GetProof() == Proof::kUnknown) {
+        leaves.emplace(reachable[i].visits, i);
+      }
+    }
+    while (num_kept > max_states && !leaves.empty()) {
+      Reachable& r = reachable[leaves.top().second];
+      leaves.pop();
+      r.evicted = true;
+      --num_kept;
+      for (int parent : r.parents) {
+        if (--reachable[parent].num_children == 0 && parent != 0 &&
+            reachable[parent].state->GetProof() == Proof::kUnknown) {
+          leaves.emplace(reachable[parent].visits, parent);
+        }
+      }
+    }
+  }
+
+  // Copy the kept states to the spare arena, and then swap arenas. Copies get
+  // new indices, zero for evicted states.
+  spare_nodes_.Clear();
+  std::vector<uint32_t> copies(reachable.size(), 0);
+  absl::flat_hash_map<BoardFP, uint32_t> kept_states;
+  kept_states.reserve(num_kept);
+  for (size_t i = 0; i < reachable.size(); ++i) {
+    if (!reachable[i].evicted) {
+      copies[i] = spare_nodes_.Add(
+          spare_arena_.New<State>(&spare_arena_, *reachable[i].state));
+      kept_states[BoardFingerprint(reachable[i].board)] = copies[i];
+    }
+  }
+  for (size_t i = 1; i < spare_nodes_.size(); ++i) {
+    State* copy = spare_nodes_[i];
+    for (int a = 0; a < copy->num_actions; ++a) {
+      const uint32_t child = copy->child(a);
+      if (child != 0) {
+        // Evicted children map to zero, and will be searched again.
+        copy->children[a].store(copies[index.at(nodes_[child])],
+                                std::memory_order_relaxed);
+      }
+    }
   }
+  root_ = spare_nodes_[copies[0]];
+  nodes_.Swap(&spare_nodes_);
+  spare_nodes_.Clear();
+  visited_states_.swap(kept_states);
+  arena_.Swap(&spare_arena_);
+  spare_arena_.Reset();
 }
 
 }  // namespace chess
@@ -1,36 +1,87 @@
 #ifndef _C4CC_MCTS_H_
 #define _C4CC_MCTS_H_
 
+#include <atomic>
+#include <cstdint>
 #include <functional>
 #include <memory>
 #include <random>
+#include <vector>
 
 #include "absl/container/flat_hash_map.h"
 #include "absl/container/inlined_vector.h"
 #include "absl/container/node_hash_map.h"
+#include "absl/synchronization/mutex.h"
 #include "absl/types/optional.h"
 #include "chess/board.h"
+#include "chess/tablebase.h"
+#include "util/arena.h"
 
 namespace chess {
 
 // MCTS internals, not to be used by callers directly.
 namespace mcts {
 struct State;
-struct Action;
+// Action 'a' of state 's'.
 struct ActionRef {
-  ActionRef(mcts::State* ss, mcts::Action* aa) : s(ss), a(aa) {}
+  ActionRef(mcts::State* ss, int aa) : s(ss), a(aa) {}
   mcts::State* s;
-  mcts::Action* a;
+  int a;
+};
+
+// States by index, as referred to by State::children. Index 0 is null.
+// Entries never move once added, so search threads can read them without a
+// lock while another thread adds more: chunk k holds 2^(k + 10) entries. An
+// index must only be read after it has been published, e.g. with a release
+// store to a child slot.
+//
+// Add() and Set() must not be called concurrently with each other.
+class StateTable {
+ public:
+  StateTable() { Clear(); }
+
+  State* operator[](uint32_t i) const {
+    const uint64_t j = uint64_t{i} + kFirstChunkSize;
+    const int chunk = 63 - __builtin_clzll(j) - kFirstChunkBits;
+    return chunks_[chunk][j - (kFirstChunkSize << chunk)];
+  }
+  size_t size() const { return size_; }
+
+  // Returns the index of 's'.
+  uint32_t Add(State* s);
+  void Set(uint32_t i, State* s);
+  // Removes all but the null entry. Keeps the memory for reuse.
+  void Clear();
+  void Swap(StateTable* other);
+
+ private:
+  static constexpr int kFirstChunkBits = 10;
+  static constexpr uint64_t kFirstChunkSize = uint64_t{1} << kFirstChunkBits;
+  // Enough for all 32-bit indices.
+  static constexpr int kNumChunks = 33 - kFirstChunkBits;
+
+  std::unique_ptr<State*[]> chunks_[kNumChunks];
+  size_t size_ = 0;
 };
 
 }  // namespace mcts
 
 class MCTS {
  public:
+  // Game-theoretic value of a state for the player to move, as proven by the
+  // search ("MCTS-solver"). Checkmates and stalemates are proven by the
+  // rules; a state is a win if some move leads to a proven loss for the
+  // opponent, and otherwise proven once all its moves are. Draws by
+  // repetition or the 50-move rule depend on the history, and are not
+  // proven. Positions covered by the tablebase, if set, are proven when
+  // they're reached.
+  enum class Proof : uint8_t { kUnknown, kWin, kLoss, kDraw };
+
   explicit MCTS(const Board& start = {});
   ~MCTS();
 
-  // Resets position to 'b' with empty history.
+  // Resets position to 'b' with empty history. This frees the whole tree at
+  // once, but keeps its memory for the next one.
   void SetBoard(const Board& b);
 
   const Board& current_board() const;
@@ -38,11 +89,22 @@ class MCTS {
   //
   // Finds a new leaf node to explore and returns a prediction request.
   // FinishIteration() must be called with predictions for this position to
-  // complete the iteration. New iteration must not be started before calling
-  // FinishIteration().
+  // complete the iteration. Several iterations can be pending at once, e.g.
+  // to evaluate them as one batch, and they can be finished in any order.
+  // Pending iterations count as losses ("virtual loss"), so that the next ones
+  // spread out to other leaves; the same position may still be returned
+  // twice. All pending iterations must be finished before calling MakeMove()
+  // or SetBoard().
+  //
+  // StartIteration() and FinishIteration() may be called concurrently from
+  // multiple threads sharing this tree. So may the const methods, which then
+  // see the iterations finished so far. Other methods must not run
+  // concurrently with anything else.
   //
   // May return null in case no new leaf node was found (i.e. we hit a terminal
-  // node). In that case FinishIteration() must not be called.
+  // node), or when the tree has grown past set_max_states() and waits for
+  // pending iterations to finish before evicting states. In that case
+  // FinishIteration() must not be called.
   class PredictionRequest {
    public:
     PredictionRequest(const PredictionRequest&) = delete;
@@ -61,7 +123,7 @@ class MCTS {
     mcts::State* parent_;
     MoveList moves_;
     // The action from 'parent' leading to this board.
-    mcts::Action* parent_a_ = nullptr;
+    int parent_a_ = -1;
 
     friend class MCTS;
   };
@@ -75,24 +137,123 @@ class MCTS {
   // Number of times an iteration has been completed from the current node.
   int num_iterations() const;
 
-  // This is the prediction for the current board.
-  // Must not be called if there are outstanding prediction requests.
+  // Proven value of the current board. Once it's known, StartIteration()
+  // returns null without searching.
+  Proof root_proof() const;
+
+  // Sets 'visits' to the number of completed iterations through each root
+  // action.
+  void GetRootVisits(std::vector<int>* visits) const;
+
+  // Returns the most visited line from the current board, up to 'max_length'
+  // moves, following proven moves where known. Stops at the first state
+  // without visits.
+  std::vector<Move> GetPrincipalVariation(int max_length = 32) const;
+
+  // This is the prediction for the current board. If the board is proven to
+  // be a win or a draw, the policy is split evenly between the moves which
+  // achieve that. Pending iterations are not counted.
   PredictionResult GetPrediction() const;
   // Returns the prior prediction for the current (root) position.
   PredictionResult GetPrior() const;
 
-  // Advances the current state with a move.
+  // Advances the current state with a move. States which are no longer
+  // reachable from the new root are freed. Must not be called if there are
+  // outstanding prediction requests.
   void MakeMove(Move m);
 
+  // Limits the number of states kept in the tree. When the tree grows past
+  // 'n', the least visited leaves are evicted until it's down to 3/4 of that.
+  // Evicted states are searched again if needed; the visit counts leading to
+  // them are kept. Eviction only happens when there are no outstanding
+  // prediction requests: StartIteration() returns null until the pending ones
+  // are finished. A state takes roughly 100 bytes, plus 16 per action.
+  void set_max_states(size_t n) { max_states_ = n; }
+
+  // Mixes Dirichlet(alpha) noise into the root priors, with weight
+  // 'fraction', to make self-play explore. The noise is sampled once for each
+  // new root, i.e. by SetBoard() and MakeMove(), and kept for all iterations
+  // from it. A 'fraction' of zero disables noise. Defaults to alpha 0.3 and
+  // fraction 0.2.
+  void SetRootNoise(double alpha, double fraction);
+  // Number of states currently in the tree.
+  size_t num_states() const;
+
+  // Probes 'tablebase' for new positions, which are then proven without
+  // searching them. While the current board is covered, GetPrediction() and
+  // GetPrincipalVariation() follow the tablebase's best moves, which make
+  // progress towards mate unlike the proofs. May be null, which is the
+  // default. 'tablebase' must outlive this.
+  void set_tablebase(const Tablebase* tablebase) { tablebase_ = tablebase; }
+
  private:
+  // Makes 'b' the root, reusing its state if it's already in the tree.
+  void SetRoot(const Board& b);
+  // Result of 'b' in tablebase_, if set and covering 'b'.
+  absl::optional<TablebaseResult> ProbeTablebase(const Board& b) const;
+  // Gives 's' an index in nodes_, and returns it.
+  uint32_t AddState(mcts::State* s) EXCLUSIVE_LOCKS_REQUIRED(mu_);
+  // Returns the index of the state for 'fp', or 0 if there isn't one yet.
+  uint32_t FindState(BoardFP fp) LOCKS_EXCLUDED(mu_);
+  // Returns the index of the state for 'fp', first adding one constructed
+  // from 'args' if there isn't one yet.
+  template <typename... Args>
+  uint32_t FindOrAddState(BoardFP fp, Args&&... args) LOCKS_EXCLUDED(mu_);
+  // Called when the state at the end of 'path' may have become proven.
+  // Propagates the proof up the path as far as it goes.
+  void UpdateProofs(const PredictionRequest::PathVec& path);
+  // Stops PickAction() from choosing action 'a' of 's'.
+  void Exclude(mcts::State* s, int a);
+  // Sets the empty child slot of 'a' in 's' to 'index', unless another
+  // thread did first. Returns the index in the slot.
+  static uint32_t LinkChild(mcts::State* s, int a, uint32_t index);
+  // Proof for 's' given the proofs of its children.
+  Proof ComputeProof(const mcts::State& s) const;
+  // The move to follow from 's': one achieving its proof if it's a win or a
+  // draw, otherwise the most visited one. Returns -1 if there are no visits.
+  int BestAction(const mcts::State& s) const;
+  // Resamples root_priors_ for the current root.
+  void SampleRootNoise();
+  // Frees all states not reachable from root_, and if there are more than
+  // 'max_states' left, evicts the least visited leaves down to 'max_states'.
+  // This moves the remaining states to a fresh arena.
+  void CollectGarbage(size_t max_states) LOCKS_EXCLUDED(mu_);
+
   Board current_;
   mcts::State* root_;
 
-  absl::flat_hash_map<uint64_t, int> visited_;
-  // TODO: Optimize this memory-wise.
-  // TODO: Probably no need for shared_ptr here.
-  absl::flat_hash_map<BoardFP, std::unique_ptr<mcts::State>> visited_states_;
+  // Hashes of the game positions up to the root. Iterations keep the hashes
+  // of their own path separately.
+  std::vector<uint64_t> hashes_;
+  // Index of the root position in 'hashes_'.
+  int root_index_ = 0;
+  // Guards allocation and the transposition table only: states are
+  // published to the tree lock-free.
+  mutable absl::Mutex mu_;
+  // Owns all states and their actions.
+  util::Arena arena_ GUARDED_BY(mu_);
+  // Only used during CollectGarbage(), kept to reuse their memory.
+  util::Arena spare_arena_;
+  mcts::StateTable spare_nodes_;
+  // All states in the tree, indexed as in State::children.
+  mcts::StateTable nodes_;
+  // Index in 'nodes_' for each position.
+  absl::flat_hash_map<BoardFP, uint32_t> visited_states_ GUARDED_BY(mu_);
+  size_t max_states_ = SIZE_MAX;
+  // Held shared by iterations and by the const methods reading the tree, and
+  // exclusively to collect garbage between iterations.
+  mutable absl::Mutex gc_mu_;
+  // Set when the tree has grown past 'max_states_'.
+  std::atomic<bool> gc_wanted_{false};
+  // Requests returned by StartIteration() but not yet finished.
+  std::atomic<int> num_pending_{0};
   std::mt19937 rand_;
+
+  double noise_alpha_ = 0.3;
+  double noise_fraction_ = 0.2;
+  // Root priors with noise, as IEEE halves, or null if noise is disabled.
+  std::unique_ptr<std::atomic<uint16_t>[]> root_priors_;
+  const Tablebase* tablebase_ = nullptr;
 };
 
 }  // namespace chess
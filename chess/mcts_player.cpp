@@ -2,20 +2,27 @@
 
 #include <time.h>
 
+#include <algorithm>
+#include <thread>
+#include <vector>
+
 #include "chess/generic_board.h"
 #include "chess/tensors.h"
 #include "tensorflow/core/platform/logging.h"
 
 namespace chess {
 
-MCTSPlayer::MCTSPlayer(generic::PredictionQueue* pq, int iters_per_move)
-    : queue_(pq), iters_per_move_(iters_per_move) {
+MCTSPlayer::MCTSPlayer(generic::PredictionQueue* pq, int iters_per_move,
+                       int num_threads)
+    : queue_(pq), num_threads_(num_threads) {
+  limits_.iterations = iters_per_move;
   rand_.seed(time(0) ^ reinterpret_cast<intptr_t>(this));
-  mcts_ = std::make_unique<generic::MCTS>(MakeGenericBoard(board_));
+  mcts_ = std::make_unique<generic::MCTS>(MakeGenericBoard(board_),
+                                          /*transpositions=*/true);
 }
 
 void MCTSPlayer::Reset(const Board& b) {
-  mcts_->SetBoard(MakeGenericBoard(b));
+  mcts_->SetBoard(MakeGenericBoard(b, tablebase_));
   board_ = b;
   saved_predictions_.clear();
 }
@@ -26,7 +33,27 @@ void MCTSPlayer::Advance(const Move& m) {
   saved_predictions_.emplace_back();
 }
 
-void MCTSPlayer::RunIterations(int n) {
+void MCTSPlayer::Search() {
+  const generic::SearchController controller(limits_);
+  const int start_iterations = mcts_->num_iterations();
+  std::atomic<bool> stop(false);
+  if (num_threads_ <= 1) {
+    SearchThread(controller, start_iterations, &stop);
+    return;
+  }
+  std::vector<std::thread> threads;
+  for (int i = 0; i < num_threads_; ++i) {
+    threads.emplace_back([this, &controller, start_iterations, &stop] {
+      SearchThread(controller, start_iterations, &stop);
+    });
+  }
+  for (auto& t : threads) {
+    t.join();
+  }
+}
+
+void MCTSPlayer::SearchThread(const generic::SearchController& controller,
+                              int start_iterations, std::atomic<bool>* stop) {
   // Smaller number of games per minibatch should result in better accuracy, but
   // will be slower.
   const int minibatch_size = 8;
@@ -45,32 +72,67 @@ void MCTSPlayer::RunIterations(int n) {
     requests.clear();
   };
 
-  while (n >= 0) {
-    for (int i = 0; i < minibatch_size && i < n; ++i) {
+  std::vector<int> visits;
+  while (!stop->load(std::memory_order_relaxed)) {
+    for (int i = 0; i < minibatch_size; ++i) {
       auto pred_req = mcts_->StartIteration();
       if (pred_req != nullptr) {
         requests.push_back(std::move(pred_req));
       }
     }
     flush();
-    n -= minibatch_size;
+    // Checked once per minibatch, so the search may overshoot the limits by
+    // a minibatch per thread.
+    mcts_->GetRootVisits(&visits);
+    if (mcts_->root_proof() != generic::MCTS::Proof::kUnknown ||
+        controller.ShouldStop(visits,
+                              mcts_->num_iterations() - start_iterations)) {
+      stop->store(true, std::memory_order_relaxed);
+    }
+  }
+}
+
+void MCTSPlayer::SavePrediction(const generic::PredictionResult& pred) {
+  if (saved_predictions_.empty()) {
+    saved_predictions_.emplace_back();
+  }
+  auto& b = saved_predictions_.back();
+  b.board = board_;
+  b.pred = pred;
+}
+
+absl::optional<Move> MCTSPlayer::GetTablebaseMove() {
+  if (tablebase_ == nullptr) {
+    return absl::nullopt;
+  }
+  const auto result = tablebase_->Probe(board_);
+  if (!result.has_value()) {
+    return absl::nullopt;
+  }
+  const std::vector<Move> best = tablebase_->BestMoves(board_);
+  CHECK(!best.empty()) << board_.ToFEN();
+  // An exact target: the policy is split evenly over the best moves.
+  generic::PredictionResult pred;
+  pred.value = result->wdl;
+  for (const Move& m : board_.valid_moves()) {
+    const bool is_best = std::find(best.begin(), best.end(), m) != best.end();
+    pred.policy.emplace_back(EncodeMove(board_.turn(), m),
+                             is_best ? 1.0 / best.size() : 0.0);
   }
+  SavePrediction(pred);
+  return best[rand_() % best.size()];
 }
 
 Move MCTSPlayer::GetMove() {
-  RunIterations(iters_per_move_);
+  if (const absl::optional<Move> m = GetTablebaseMove()) {
+    return *m;
+  }
+  Search();
   const auto pred = mcts_->GetPrediction();
   CHECK_EQ(mcts_->current_board().fingerprint(),
       BoardFingerprint(board_));
 
-  if (saved_predictions_.empty()) {
-    saved_predictions_.emplace_back();
-  }
-  {
-    auto& b = saved_predictions_.back();
-    b.board = board_;
-    b.pred = pred;
-  }
+  SavePrediction(pred);
   // queue_->CacheRealPrediction(mcts_->current_board(), pred);
 
 #if 0
@@ -1,22 +1,41 @@
 #ifndef _CHESS_MCTS_PLAYER_H_
 #define _CHESS_MCTS_PLAYER_H_
 
+#include <atomic>
 #include <functional>
 #include <iostream>
 #include <memory>
 #include <string>
 
+#include "absl/types/optional.h"
 #include "chess/board.h"
 #include "chess/player.h"
+#include "chess/tablebase.h"
 #include "chess/types.h"
 #include "generic/mcts.h"
 #include "generic/prediction_queue.h"
+#include "generic/search_controller.h"
 
 namespace chess {
 
 class MCTSPlayer : public Player {
  public:
-  explicit MCTSPlayer(generic::PredictionQueue* pq, int iters_per_move);
+  // With 'num_threads' > 1, that many threads search the same tree at once,
+  // all sending requests to 'pq'. Each move is searched for 'iters_per_move'
+  // iterations, or less if the best move is already clear.
+  explicit MCTSPlayer(generic::PredictionQueue* pq, int iters_per_move,
+                      int num_threads = 1);
+
+  // Sets the budget for the following GetMove() calls, e.g. from the game
+  // clock.
+  void set_search_limits(const generic::SearchLimits& limits) {
+    limits_ = limits;
+  }
+
+  // Positions covered by 'tablebase' aren't searched past, and moves in them
+  // are picked from the tablebase's best moves. Takes effect at the next
+  // Reset(). May be null; 'tablebase' must outlive this.
+  void set_tablebase(const Tablebase* tablebase) { tablebase_ = tablebase; }
 
   //
   void Reset(const Board& b) override;
@@ -39,13 +58,26 @@ class MCTSPlayer : public Player {
   }
 
  private:
-  void RunIterations(int n);
+  // Searches the current position until 'limits_' say to stop.
+  void Search();
+  // Saves 'pred' as the prediction for the current position.
+  void SavePrediction(const generic::PredictionResult& pred);
+  // Picks one of the tablebase's best moves, if the current position is
+  // covered, and saves its prediction.
+  absl::optional<Move> GetTablebaseMove();
+  // Runs iterations on the calling thread until 'controller' or another
+  // thread sets 'stop'. 'start_iterations' is the root visit count at the
+  // start of the search.
+  void SearchThread(const generic::SearchController& controller,
+                    int start_iterations, std::atomic<bool>* stop);
 
   Board board_;
   generic::PredictionQueue* const queue_;
-  const int iters_per_move_;
+  generic::SearchLimits limits_;
+  const int num_threads_;
   std::vector<SavedPrediction> saved_predictions_;
   std::unique_ptr<generic::MCTS> mcts_;
+  const Tablebase* tablebase_ = nullptr;
   std::mt19937 rand_;
 };
 
@@ -0,0 +1,85 @@
+#include "chess/mcts.h"
+
+#include <thread>
+#include <vector>
+
+#include "chess/board.h"
+#include "gtest/gtest.h"
+
+namespace chess {
+namespace {
+
+// Even policy over the legal moves, and a value of zero.
+PredictionResult EvenPrediction(const MCTS::PredictionRequest& req) {
+  PredictionResult p;
+  for (const Move& m : req.moves()) {
+    p.policy.emplace_back(m, 1.0 / req.moves().size());
+  }
+  return p;
+}
+
+// Searches 'mcts' on 'num_threads' threads, each starting batches of
+// iterations and finishing them out of order, until it has 'num_iterations'
+// or the root is proven.
+void Search(MCTS* mcts, int num_threads, int num_iterations) {
+  std::vector<std::thread> threads;
+  for (int i = 0; i < num_threads; ++i) {
+    threads.emplace_back([&] {
+      while (mcts->num_iterations() < num_iterations &&
+             mcts->root_proof() == MCTS::Proof::kUnknown) {
+        std::vector<std::unique_ptr<MCTS::PredictionRequest>> batch;
+        for (int j = 0; j < 4; ++j) {
+          if (auto req = mcts->StartIteration()) {
+            batch.push_back(std::move(req));
+          }
+        }
+        while (!batch.empty()) {
+          const PredictionResult p = EvenPrediction(*batch.back());
+          mcts->FinishIteration(std::move(batch.back()), p);
+          batch.pop_back();
+        }
+      }
+    });
+  }
+  for (auto& t : threads) {
+    t.join();
+  }
+}
+
+TEST(MCTSTest, ThreadsShareTree) {
+  MCTS mcts;
+  mcts.SetRootNoise(0.3, 0.0);
+  // Small enough to collect garbage during the search.
+  mcts.set_max_states(2000);
+  Search(&mcts, 4, 20000);
+  EXPECT_GE(mcts.num_iterations(), 20000);
+  // Each thread may add a few states before it sees that the tree is full.
+  EXPECT_LE(mcts.num_states(), 2100);
+
+  const PredictionResult p = mcts.GetPrediction();
+  ASSERT_EQ(p.policy.size(), 20);
+  double sum = 0;
+  for (const auto& move : p.policy) {
+    sum += move.second;
+  }
+  EXPECT_NEAR(sum, 1.0, 1e-6);
+
+  // The tree is still consistent after the threads are done.
+  const std::vector<Move> pv = mcts.GetPrincipalVariation(1);
+  ASSERT_EQ(pv.size(), 1);
+  mcts.MakeMove(pv[0]);
+  Search(&mcts, 1, 1000);
+  EXPECT_GE(mcts.num_iterations(), 1000);
+}
+
+TEST(MCTSTest, ThreadsProveMateInOne) {
+  MCTS mcts(Board("6k1/5ppp/8/8/8/8/8/R5K1 w - - 0 1"));
+  Search(&mcts, 4, 1000000);
+  EXPECT_EQ(mcts.root_proof(), MCTS::Proof::kWin);
+  const std::vector<Move> pv = mcts.GetPrincipalVariation(1);
+  ASSERT_EQ(pv.size(), 1);
+  EXPECT_EQ(pv[0].ToString(), "a1a8");
+}
+
+}  // namespace
+}  // namespace chess
@@ -21,15 +21,13 @@ class MoveGenerator {
         turn_(b.turn()),
         opp_(OtherColor(b.turn())) {
     assert(turn_ == b_.turn());
-    occ_ = b.ComputeOcc();
-    for (int p = 0; p < kNumPieces; ++p) {
-      my_pieces_ |= b.bitboard(turn_, Piece(p));
-    }
+    occ_ = b.occupied();
+    my_pieces_ = b.pieces(turn_);
     opp_pieces_ = occ_ ^ my_pieces_;
-    king_s_ = GetFirstBit(b_.bitboard(turn_, Piece::kKing));
+    king_s_ = GetFirstBit(b_.kings() & my_pieces_);
 
     king_danger_ = ComputeKingDanger();
-    if (ABSL_PREDICT_FALSE(king_danger_ & b_.bitboard(turn_, Piece::kKing))) {
+    if (ABSL_PREDICT_FALSE(king_danger_ & b_.kings() & my_pieces_)) {
       in_check_ = true;
       bool in_check = ComputeCheck(&check_ok_, &push_mask_);
       if (ABSL_PREDICT_FALSE(!in_check)) {
@@ -140,7 +138,11 @@ class MoveGenerator {
       });
     }
 
-    // En passant moves (obviously never promotions):
+    EnPassantMoves(pawns);
+  }
+
+  // En passant moves (obviously never promotions).
+  void EnPassantMoves(uint64_t pawns) {
     if (b_.en_passant() != 0) {
       const int to = GetFirstBit(b_.en_passant());
       int to_rank = SquareRank(to);
@@ -176,8 +178,7 @@ class MoveGenerator {
               RookMoveMask(king_s_, (occ_ ^ removed_sqs)) &
               RankMask(SquareRank(king_s_));
           // Check if opponent rooks match this.
-          const uint64_t opp_rooks = b_.bitboard(opp_, Piece::kRook) |
-                                     b_.bitboard(opp_, Piece::kQueen);
+          const uint64_t opp_rooks = b_.orthogonal_sliders() & opp_pieces_;
           if (king_rook_moves & opp_rooks) {
             return;
           }
@@ -252,14 +253,15 @@ class MoveGenerator {
   }
 
   void GenerateMoves() {
-    PawnMoves(b_.bitboard(turn_, Piece::kPawn));
-    KnightMoves(b_.bitboard(turn_, Piece::kKnight));
-    BishopMoves(b_.bitboard(turn_, Piece::kBishop) |
-                b_.bitboard(turn_, Piece::kQueen));
-    RookMoves(b_.bitboard(turn_, Piece::kRook) |
-              b_.bitboard(turn_, Piece::kQueen));
-    KingMoves(b_.bitboard(turn_, Piece::kKing));
-    // Castling.
+    PawnMoves(b_.pawns() & my_pieces_);
+    KnightMoves(b_.knights() & my_pieces_);
+    BishopMoves(b_.diagonal_sliders() & my_pieces_);
+    RookMoves(b_.orthogonal_sliders() & my_pieces_);
+    KingMoves(b_.kings() & my_pieces_);
+    CastlingMoves();
+  }
+
+  void CastlingMoves() {
     if (!in_check_) {
       const int king_rank = turn_ == Color::kWhite ? 0 : 7;
       const int king_square = MakeSquare(king_rank, 4);
@@ -287,6 +289,87 @@ class MoveGenerator {
     }
   }
 
+  // Counts legal moves without producing them one by one, by taking popcounts
+  // of the target masks. Only the rare cases (pinned pieces, en passant and
+  // castling) are enumerated. Must not be combined with GenerateMoves().
+  int CountMoves() {
+    const uint64_t pawns = b_.pawns() & my_pieces_;
+    const uint64_t promotion_mask =
+        turn_ == Color::kWhite ? RankMask(6) : RankMask(1);
+    int n = CountSimplePawnMoves(pawns & ~promotion_mask);
+    if (ABSL_PREDICT_FALSE(pawns & promotion_mask)) {
+      n += 4 * CountSimplePawnMoves(pawns & promotion_mask);
+    }
+    for (int from : BitRange(b_.knights() & my_pieces_ & ~soft_pinned_)) {
+      n += PopCount(KnightMoveMask(from) & ~my_pieces_ & check_ok_);
+    }
+    n += CountSlider(b_.diagonal_sliders() & my_pieces_, &BishopMoveMask);
+    n += CountSlider(b_.orthogonal_sliders() & my_pieces_, &RookMoveMask);
+    n += PopCount(KingMoveMask(king_s_) & ~my_pieces_ & ~king_danger_);
+    // These go through OutputMove(), and are counted in gen_count_.
+    EnPassantMoves(pawns);
+    CastlingMoves();
+    return n + gen_count_;
+  }
+
+  // Same as EnumSimplePawnMoves(), but only counts the moves.
+  int CountSimplePawnMoves(uint64_t pawns) const {
+    const int dr = turn_ == Color::kWhite ? 8 : -8;
+    const uint64_t impossible_push_squares = occ_ | ~check_ok_;
+    const uint64_t blocked = turn_ == Color::kWhite
+                                 ? (impossible_push_squares >> 8)
+                                 : (impossible_push_squares << 8);
+    const uint64_t singles = pawns & ~blocked;
+    int n = PopCount(singles & ~soft_pinned_);
+    for (int sq : BitRange(singles & soft_pinned_)) {
+      n += SameDirection(king_s_, sq, sq + dr);
+    }
+
+    const uint64_t double_blocked =
+        turn_ == Color::kWhite
+            ? ((occ_ >> 8) | (impossible_push_squares >> 16))
+            : ((occ_ << 8) | (impossible_push_squares << 16));
+    const uint64_t double_mask = RankMask(turn_ == Color::kWhite ? 1 : 6);
+    const uint64_t doubles = pawns & double_mask & ~double_blocked;
+    n += PopCount(doubles & ~soft_pinned_);
+    for (int sq : BitRange(doubles & soft_pinned_)) {
+      n += SameDirection(king_s_, sq, sq + dr * 2);
+    }
+
+    const uint64_t pieces_to_capture = opp_pieces_ & check_ok_;
+    const uint64_t left_captures =
+        pawns & ~FileMask(0) &
+        (turn_ == Color::kWhite ? (pieces_to_capture >> 7)
+                                : (pieces_to_capture << 9));
+    n += PopCount(left_captures & ~soft_pinned_);
+    for (int from : BitRange(left_captures & soft_pinned_)) {
+      n += !IsPinned(from, from + (turn_ == Color::kWhite ? 7 : -9));
+    }
+    const uint64_t right_captures =
+        pawns & ~FileMask(7) &
+        (turn_ == Color::kWhite ? (pieces_to_capture >> 9)
+                                : (pieces_to_capture << 7));
+    n += PopCount(right_captures & ~soft_pinned_);
+    for (int from : BitRange(right_captures & soft_pinned_)) {
+      n += !IsPinned(from, from + (turn_ == Color::kWhite ? 9 : -7));
+    }
+    return n;
+  }
+
+  template <typename MaskFunc>
+  int CountSlider(uint64_t from_mask, const MaskFunc& mask_func) const {
+    int n = 0;
+    for (int from : BitRange(from_mask & ~soft_pinned_)) {
+      n += PopCount(mask_func(from, occ_) & ~my_pieces_ & check_ok_);
+    }
+    // Pinned pieces can only move along the ray from our king through them.
+    for (int from : BitRange(from_mask & soft_pinned_)) {
+      n += PopCount(mask_func(from, occ_) & ~my_pieces_ & check_ok_ &
+                    RayMask(king_s_, from));
+    }
+    return n;
+  }
+
   uint64_t ComputeKingDanger() const {
     // To account for sliding pieces, remove our king from the occ mask.
     // Otherwise the king could "hide behind itself".
@@ -295,7 +378,7 @@ class MoveGenerator {
     uint64_t danger = 0;
     // Pawns
     {
-      const uint64_t opp_pawns = b_.bitboard(opp_, Piece::kPawn);
+      const uint64_t opp_pawns = b_.pawns() & opp_pieces_;
       const uint64_t left_mask = ~FileMask(0);
       const uint64_t right_mask = ~FileMask(7);
       // Left and right captures:
@@ -306,21 +389,19 @@ class MoveGenerator {
     }
 
     // Knights.
-    for (int s : BitRange(b_.bitboard(opp_, Piece::kKnight))) {
+    for (int s : BitRange(b_.knights() & opp_pieces_)) {
       danger |= KnightMoveMask(s);
     }
     // Bishops and queen diagonal.
-    for (int s : BitRange(b_.bitboard(opp_, Piece::kBishop) |
-                          b_.bitboard(opp_, Piece::kQueen))) {
+    for (int s : BitRange(b_.diagonal_sliders() & opp_pieces_)) {
       danger |= BishopMoveMask(s, occ);
     }
     // Rooks and queens
-    for (int s : BitRange(b_.bitboard(opp_, Piece::kRook) |
-                          b_.bitboard(opp_, Piece::kQueen))) {
+    for (int s : BitRange(b_.orthogonal_sliders() & opp_pieces_)) {
       danger |= RookMoveMask(s, occ);
     }
     // King:
-    danger |= KingMoveMask(GetFirstBit(b_.bitboard(opp_, Piece::kKing)));
+    danger |= KingMoveMask(GetFirstBit(b_.kings() & opp_pieces_));
     // std::cerr << "KingDanger: " << BitboardToString(danger) << "\n";
     return danger;
   }
@@ -341,16 +422,14 @@ class MoveGenerator {
       if (SquareOnBoard(r + dr, f + 1)) {
         pawn_mask |= OneHot(MakeSquare(r + dr, f + 1));
       }
-      threats |= pawn_mask & b_.bitboard(opp_, Piece::kPawn);
+      threats |= pawn_mask & b_.pawns() & opp_pieces_;
     }
 
-    threats |= KnightMoveMask(king_s_) & b_.bitboard(opp_, Piece::kKnight);
+    threats |= KnightMoveMask(king_s_) & b_.knights() & opp_pieces_;
     slider_threats |=
-        BishopMoveMask(king_s_, occ_) &
-        (b_.bitboard(opp_, Piece::kBishop) | b_.bitboard(opp_, Piece::kQueen));
+        BishopMoveMask(king_s_, occ_) & b_.diagonal_sliders() & opp_pieces_;
     slider_threats |=
-        RookMoveMask(king_s_, occ_) &
-        (b_.bitboard(opp_, Piece::kRook) | b_.bitboard(opp_, Piece::kQueen));
+        RookMoveMask(king_s_, occ_) & b_.orthogonal_sliders() & opp_pieces_;
     threats |= slider_threats;
     if (threats == 0) {
       *capture_mask = kAllBits;
@@ -377,16 +456,14 @@ class MoveGenerator {
 
     const uint64_t king_bishop_mask = BishopMoveMask(king_s_, occ_);
     const uint64_t possible_bishops =
-        (b_.bitboard(opp_, Piece::kBishop) | b_.bitboard(opp_, Piece::kQueen)) &
-        BishopMoveMask(king_s_, 0);
+        b_.diagonal_sliders() & opp_pieces_ & BishopMoveMask(king_s_, 0);
     for (int s : BitRange(possible_bishops)) {
       const uint64_t move_mask = BishopMoveMask(s, occ_);
       pinned |= (move_mask & king_bishop_mask);
     }
     const uint64_t king_rook_mask = RookMoveMask(king_s_, occ_);
     const uint64_t possible_rooks =
-        (b_.bitboard(opp_, Piece::kRook) | b_.bitboard(opp_, Piece::kQueen)) &
-        RookMoveMask(king_s_, 0);
+        b_.orthogonal_sliders() & opp_pieces_ & RookMoveMask(king_s_, 0);
     for (int s : BitRange(possible_rooks)) {
       const uint64_t move_mask = RookMoveMask(s, occ_);
       pinned |= (move_mask & king_rook_mask);
@@ -464,6 +541,25 @@ MovegenResult IterateLegalMoves(const Board& b, const MoveFunc& f) {
   return MovegenResult::kNotOver;
 }
 
+// Returns the number of legal moves in 'b'. This is much faster than counting
+// with IterateLegalMoves(), since most moves are never materialized. If
+// 'result' is not null, it's set to what IterateLegalMoves() would return.
+inline int CountLegalMoves(const Board& b, MovegenResult* result = nullptr) {
+  const auto ignore = [](const Move& m) {};
+  MoveGenerator<decltype(ignore)> gen(b, ignore);
+  const int num_moves = gen.CountMoves();
+  if (result != nullptr) {
+    if (num_moves != 0) {
+      *result = MovegenResult::kNotOver;
+    } else if (gen.IsInCheck()) {
+      *result = MovegenResult::kCheckmate;
+    } else {
+      *result = MovegenResult::kStalemate;
+    }
+  }
+  return num_moves;
+}
+
 }  // namespace chess
 
 #endif
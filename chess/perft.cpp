@@ -1,5 +1,14 @@
+#include "chess/perft.h"
+
+#include <algorithm>
+#include <cassert>
 #include <cstdlib>
+#include <deque>
+#include <limits>
+#include <thread>
+#include <vector>
 
+#include "absl/synchronization/mutex.h"
 #include "chess/board.h"
 #include "chess/movegen.h"
 
@@ -8,7 +17,62 @@ namespace chess {
 // Undef this to get easier-to-read profile output.
 #define OPTIMIZED
 
-int64_t Perft(const Board& b, int d) {
+namespace {
+
+// Entry data holds the depth in the top bits, and node count in the rest.
+constexpr int kDepthShift = 56;
+constexpr uint64_t kNodesMask = (1ull << kDepthShift) - 1;
+
+}  // namespace
+
+PerftTable::PerftTable(size_t size_mb) {
+  const size_t max_buckets = (size_mb << 20) / sizeof(Bucket);
+  num_buckets_ = 1;
+  while (num_buckets_ * 2 <= max_buckets) {
+    num_buckets_ *= 2;
+  }
+  buckets_.reset(new Bucket[num_buckets_]);
+}
+
+bool PerftTable::Lookup(uint64_t hash, int depth, int64_t* nodes) const {
+  const Bucket& bucket = buckets_[hash & (num_buckets_ - 1)];
+  for (const Entry& e : bucket.entries) {
+    const uint64_t data = e.data.load(std::memory_order_relaxed);
+    const uint64_t key = e.key.load(std::memory_order_relaxed);
+    if ((key ^ data) == hash && int(data >> kDepthShift) == depth) {
+      *nodes = data & kNodesMask;
+      return true;
+    }
+  }
+  return false;
+}
+
+void PerftTable::Insert(uint64_t hash, int depth, int64_t nodes) {
+  assert(nodes >= 0 && static_cast<uint64_t>(nodes) <= kNodesMask);
+  Bucket& bucket = buckets_[hash & (num_buckets_ - 1)];
+  // Replace the shallowest entry, since those are the cheapest to recompute.
+  // Empty entries have depth 0.
+  Entry* replace = &bucket.entries[0];
+  int replace_depth = std::numeric_limits<int>::max();
+  for (Entry& e : bucket.entries) {
+    const int e_depth =
+        int(e.data.load(std::memory_order_relaxed) >> kDepthShift);
+    if (e_depth < replace_depth) {
+      replace = &e;
+      replace_depth = e_depth;
+    }
+  }
+  const uint64_t data = (uint64_t(depth) << kDepthShift) | uint64_t(nodes);
+  replace->key.store(hash ^ data, std::memory_order_relaxed);
+  replace->data.store(data, std::memory_order_relaxed);
+}
+
+namespace {
+
+// Both of these modify 'b' while searching, but restore it before returning.
+// It's safe to make and unmake moves inside IterateLegalMoves() callbacks, as
+// the board is restored before generation continues.
+int64_t PerftInPlace(Board* b, int d) {
   if (d <= 0) {
     return 1;
   }
@@ -16,22 +80,182 @@ int64_t Perft(const Board& b, int d) {
   int64_t nodes = 0;
 #ifdef OPTIMIZED
   if (d == 1) {
-    IterateLegalMoves(b, [&](const Move& m) { ++nodes; });
+    nodes = CountLegalMoves(*b);
   } else {
-    IterateLegalMoves(
-        b, [&](const Move& m) { nodes += Perft(Board(b, m), d - 1); });
+    Board::UndoInfo undo;
+    IterateLegalMoves(*b, [&](const Move& m) {
+      b->MakeMove(m, &undo);
+      nodes += PerftInPlace(b, d - 1);
+      b->UnmakeMove(undo);
+    });
   }
 #else
-  const auto moves = b.valid_moves();
+  const auto moves = b->valid_moves();
   if (d == 1) {
     nodes += moves.size();
   } else {
     for (const Move& m : moves) {
-      nodes += Perft(b, m, d - 1);
+      nodes += Perft(Board(*b, m), d - 1);
     }
   }
 #endif
   return nodes;
 }
 
+int64_t HashedPerftInPlace(Board* b, int d, PerftTable* table) {
+  // Leaf counts are cheap enough that storing them would only pollute the
+  // table.
+  if (d <= 1) {
+    return PerftInPlace(b, d);
+  }
+  int64_t nodes = 0;
+  const uint64_t hash = b->board_hash();
+  if (table->Lookup(hash, d, &nodes)) {
+    return nodes;
+  }
+  Board::UndoInfo undo;
+  IterateLegalMoves(*b, [&](const Move& m) {
+    b->MakeMove(m, &undo);
+    nodes += HashedPerftInPlace(b, d - 1, table);
+    b->UnmakeMove(undo);
+  });
+  table->Insert(hash, d, nodes);
+  return nodes;
+}
+
+}  // namespace
+
+int64_t Perft(const Board& b, int d) {
+  Board copy = b;
+  return PerftInPlace(&copy, d);
+}
+
+int64_t Perft(const Board& b, int d, PerftTable* table) {
+  if (table == nullptr) {
+    return Perft(b, d);
+  }
+  Board copy = b;
+  return HashedPerftInPlace(&copy, d, table);
+}
+
+namespace {
+
+struct PerftTask {
+  Board board;
+  int depth;
+};
+
+// Each worker owns a deque of subtrees. Workers take work from the back of
+// their own deque, and once that runs out, steal from the front of the other
+// workers' deques. Subtree sizes vary by orders of magnitude, so a static
+// split would leave most threads idle towards the end.
+class WorkStealingPerft {
+ public:
+  WorkStealingPerft(int num_threads, PerftTable* table)
+      : queues_(num_threads), table_(table) {}
+
+  // Must not be called after Run().
+  void AddTask(const PerftTask& task) {
+    queues_[num_tasks_++ % queues_.size()].tasks.push_back(task);
+  }
+
+  int64_t Run() {
+    std::vector<int64_t> results(queues_.size(), 0);
+    std::vector<std::thread> threads;
+    for (size_t i = 0; i < queues_.size(); ++i) {
+      threads.emplace_back([this, i, &results] { results[i] = Work(i); });
+    }
+    int64_t nodes = 0;
+    for (size_t i = 0; i < threads.size(); ++i) {
+      threads[i].join();
+      nodes += results[i];
+    }
+    return nodes;
+  }
+
+ private:
+  struct Queue {
+    absl::Mutex mu;
+    std::deque<PerftTask> tasks GUARDED_BY(mu);
+  };
+
+  int64_t Work(int worker_id) {
+    int64_t nodes = 0;
+    PerftTask task;
+    while (PopOwn(worker_id, &task) || Steal(worker_id, &task)) {
+      nodes += Perft(task.board, task.depth, table_);
+    }
+    return nodes;
+  }
+
+  bool PopOwn(int worker_id, PerftTask* task) {
+    Queue& q = queues_[worker_id];
+    absl::MutexLock lock(&q.mu);
+    if (q.tasks.empty()) {
+      return false;
+    }
+    *task = q.tasks.back();
+    q.tasks.pop_back();
+    return true;
+  }
+
+  bool Steal(int worker_id, PerftTask* task) {
+    // No new tasks are added while running, so once every queue has been
+    // found empty we're done.
+    for (size_t i = 1; i < queues_.size(); ++i) {
+      Queue& q = queues_[(worker_id + i) % queues_.size()];
+      absl::MutexLock lock(&q.mu);
+      if (!q.tasks.empty()) {
+        *task = q.tasks.front();
+        q.tasks.pop_front();
+        return true;
+      }
+    }
+    return false;
+  }
+
+  std::vector<Queue> queues_;
+  PerftTable* const table_;
+  int num_tasks_ = 0;
+};
+
+void SplitTree(const Board& b, int d, int split_depth,
+               WorkStealingPerft* pool) {
+  if (split_depth == 0) {
+    pool->AddTask(PerftTask{b, d});
+    return;
+  }
+  IterateLegalMoves(b, [&](const Move& m) {
+    SplitTree(Board(b, m), d - 1, split_depth - 1, pool);
+  });
+}
+
+}  // namespace
+
+int64_t ParallelPerft(const Board& b, int d, int num_threads,
+                      int split_depth, PerftTable* table) {
+  // Leave at least one ply for the workers, there's no point in splitting
+  // further than that.
+  split_depth = std::min(split_depth, d - 1);
+  if (num_threads <= 1 || split_depth <= 0) {
+    return Perft(b, d, table);
+  }
+  WorkStealingPerft pool(num_threads, table);
+  SplitTree(b, d, split_depth, &pool);
+  return pool.Run();
+}
+
+std::vector<std::pair<Move, int64_t>> PerftDivide(const Board& b, int d,
+                                                  int num_threads,
+                                                  int split_depth,
+                                                  PerftTable* table) {
+  assert(d >= 1);
+  std::vector<std::pair<Move, int64_t>> result;
+  IterateLegalMoves(b, [&](const Move& m) { result.emplace_back(m, 0); });
+  for (auto& [m, nodes] : result) {
+    nodes = ParallelPerft(Board(b, m), d - 1, num_threads, split_depth, table);
+  }
+  return result;
+}
+
 }  // namespace chess
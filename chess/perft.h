@@ -1,14 +1,69 @@
 #ifndef _CHESS_PERFT_H_
 #define _CHESS_PERFT_H_
 
+#include <atomic>
+#include <cstddef>
 #include <cstdint>
+#include <memory>
+#include <utility>
+#include <vector>
 
 #include "chess/board.h"
+#include "chess/types.h"
 
 namespace chess {
 
+// Fixed-size table of subtree counts keyed by Board::board_hash() and depth.
+//
+// This class is thread-safe and lock-free. Each entry is stored as two words,
+// (key ^ data, data), so an entry torn by concurrent writers simply fails to
+// match on lookup ("lockless hashing" from Crafty).
+class PerftTable {
+ public:
+  // Uses at most 'size_mb' megabytes, rounded down to a power of two number of
+  // buckets.
+  explicit PerftTable(size_t size_mb);
+
+  bool Lookup(uint64_t hash, int depth, int64_t* nodes) const;
+  void Insert(uint64_t hash, int depth, int64_t nodes);
+
+  size_t size_bytes() const { return num_buckets_ * sizeof(Bucket); }
+
+ private:
+  struct Entry {
+    std::atomic<uint64_t> key{0};
+    std::atomic<uint64_t> data{0};
+  };
+  // One bucket fills a cache line.
+  static constexpr int kBucketSize = 4;
+  struct alignas(64) Bucket {
+    Entry entries[kBucketSize];
+  };
+  static_assert(sizeof(Bucket) == 64);
+
+  size_t num_buckets_ = 0;
+  std::unique_ptr<Bucket[]> buckets_;
+};
+
 int64_t Perft(const Board& board, int d);
 
+// Same as Perft(), but looks up and stores subtree counts in 'table'.
+int64_t Perft(const Board& board, int d, PerftTable* table);
+
+// Same as Perft(), but uses 'num_threads' threads. The tree is split into
+// independent subtrees 'split_depth' plies below the root, and the subtrees are
+// distributed over a work-stealing thread pool. 'table' may be null, and may be
+// shared by all threads.
+int64_t ParallelPerft(const Board& board, int d, int num_threads,
+                      int split_depth = 2, PerftTable* table = nullptr);
+
+// Returns the Perft() count below each legal root move, as in the "divide"
+// command of most engines. Requires d >= 1.
+std::vector<std::pair<Move, int64_t>> PerftDivide(const Board& board, int d,
+                                                  int num_threads,
+                                                  int split_depth = 2,
+                                                  PerftTable* table = nullptr);
+
 }  // namespace chess
 
 #endif
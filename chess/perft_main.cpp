@@ -1,14 +1,29 @@
+#include <algorithm>
 #include <cstdlib>
 #include <iostream>
+#include <memory>
 #include <string>
+#include <vector>
 
 #include "absl/container/flat_hash_map.h"
+#include "absl/flags/flag.h"
+#include "absl/flags/parse.h"
 #include "absl/strings/string_view.h"
 #include "absl/time/clock.h"
 #include "absl/time/time.h"
 #include "chess/board.h"
 #include "chess/perft.h"
 
+ABSL_FLAG(int, threads, 1, "Number of threads to count with.");
+ABSL_FLAG(int, split_depth, 2,
+          "Depth at which the tree is split into subtrees for the worker "
+          "threads. Only used with --threads > 1.");
+ABSL_FLAG(int, hash_mb, 0,
+          "Size of the transposition table for subtree counts, in megabytes. "
+          "0 disables hashing.");
+ABSL_FLAG(bool, divide, false,
+          "Print the number of leaves below each legal root move.");
+
 namespace chess {
 
 const int64_t known_results[] = {
@@ -16,16 +31,37 @@ const int64_t known_results[] = {
     4865609, 119060324, 3195901860, 84998978956, 2439530234167,
 };
 
-void Go(int d, Board b) {
+// Returns false if the result is known to be wrong.
+bool Go(int d, Board b) {
   if (d >= int(sizeof(known_results) / sizeof(known_results[0]))) {
     std::cerr << "d too large: " << d << "\n";
     abort();
   }
+  const int threads = absl::GetFlag(FLAGS_threads);
+  const int split_depth = absl::GetFlag(FLAGS_split_depth);
+  std::unique_ptr<PerftTable> table;
+  if (absl::GetFlag(FLAGS_hash_mb) > 0) {
+    table = std::make_unique<PerftTable>(absl::GetFlag(FLAGS_hash_mb));
+    std::cout << "Hash: " << (table->size_bytes() >> 20) << " MB\n";
+  }
   absl::Time start = absl::Now();
-  int64_t p = Perft(b, d);
+  int64_t p = 0;
+  if (absl::GetFlag(FLAGS_divide) && d >= 1) {
+    auto divide = PerftDivide(b, d, threads, split_depth, table.get());
+    // Sorted, to make diffing against other engines easy.
+    std::sort(divide.begin(), divide.end(), [](const auto& a, const auto& b) {
+      return a.first.ToString() < b.first.ToString();
+    });
+    for (const auto& [m, nodes] : divide) {
+      std::cout << m << ": " << nodes << "\n";
+      p += nodes;
+    }
+  } else {
+    p = ParallelPerft(b, d, threads, split_depth, table.get());
+  }
   absl::Time end = absl::Now();
   std::cout << p << "\n";
-  std::cout << "Time: " << (end - start) << "\n";
+  std::cout << "Time: " << (end - start) << " (" << threads << " threads)\n";
   std::cout << "Leaves per second: "
             << int64_t(p / absl::ToDoubleSeconds(end - start))
             << "\n";
@@ -34,22 +70,25 @@ void Go(int d, Board b) {
       std::cout << "Correct result\n";
     } else {
       std::cout << "Wrong result, expected " << known_results[d] << "\n";
+      return false;
     }
   }
+  return true;
 }
 
 }  // namespace chess
 
 int main(int argc, char** argv) {
-  if (argc <= 1) {
-    std::cerr << "Usage: " << argv[0] << " depth\n";
+  const std::vector<char*> args = absl::ParseCommandLine(argc, argv);
+  if (args.size() <= 1) {
+    std::cerr << "Usage: " << args[0]
+              << " [--threads=N] [--hash_mb=N] [--divide] depth [fen]\n";
     return 1;
   }
   chess::Board b;
-  if (argc > 2) {
-    b = chess::Board(argv[2]);
+  if (args.size() > 2) {
+    b = chess::Board(args[2]);
   }
 
-  chess::Go(atoi(argv[1]), b);
-  return 0;
+  return chess::Go(atoi(args[1]), b) ? 0 : 1;
 }
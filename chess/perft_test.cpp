@@ -1,6 +1,7 @@
 #include "chess/perft.h"
 
 #include "chess/board.h"
+#include "chess/movegen.h"
 #include "gmock/gmock.h"
 #include "gtest/gtest.h"
 
@@ -60,6 +61,66 @@ TEST(MoveEncodingTest, Position5) {
   EXPECT_EQ(Perft(b, 5), 89941194);
 }
 
+// Checks CountLegalMoves() against IterateLegalMoves() in every node of the
+// tree.
+void CheckCounts(const Board& b, int d) {
+  int num_moves = 0;
+  const MovegenResult expected_res =
+      IterateLegalMoves(b, [&](const Move& m) { ++num_moves; });
+  MovegenResult res;
+  ASSERT_EQ(CountLegalMoves(b, &res), num_moves) << b.ToFEN();
+  ASSERT_EQ(res, expected_res) << b.ToFEN();
+  if (d > 1) {
+    IterateLegalMoves(b,
+                      [&](const Move& m) { CheckCounts(Board(b, m), d - 1); });
+  }
+}
+
+TEST(MoveEncodingTest, CountLegalMoves) {
+  CheckCounts(Board(), 4);
+  CheckCounts(
+      Board("r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - "
+            "0 1"),
+      3);
+  CheckCounts(Board("8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - - 0 1"), 5);
+  CheckCounts(
+      Board("r3k2r/Pppp1ppp/1b3nbN/nP6/BBP1P3/q4N2/Pp1P2PP/R2Q1RK1 w kq - 0 1"),
+      4);
+  CheckCounts(
+      Board("rnbq1k1r/pp1Pbppp/2p5/8/2B5/8/PPP1NnPP/RNBQK2R w KQ - 1 8"), 3);
+}
+
+TEST(MoveEncodingTest, Parallel) {
+  Board b(
+      "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1");
+  EXPECT_EQ(ParallelPerft(b, 1, 4), 48);
+  EXPECT_EQ(ParallelPerft(b, 3, 4), 97862);
+  EXPECT_EQ(ParallelPerft(b, 4, 4, /*split_depth=*/1), 4085603);
+  EXPECT_EQ(ParallelPerft(b, 4, 3, /*split_depth=*/3), 4085603);
+}
+
+TEST(MoveEncodingTest, Hashed) {
+  Board b(
+      "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1");
+  // Tiny table, to exercise replacement.
+  PerftTable table(1);
+  EXPECT_EQ(Perft(b, 4, &table), 4085603);
+  EXPECT_EQ(Perft(b, 4, &table), 4085603);
+  EXPECT_EQ(ParallelPerft(Board(), 6, 4, 2, &table), 119060324);
+}
+
+TEST(MoveEncodingTest, Divide) {
+  Board b("8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - - 0 1");
+  const auto divide = PerftDivide(b, 3, 2);
+  EXPECT_EQ(divide.size(), 14);
+  int64_t sum = 0;
+  for (const auto& [m, nodes] : divide) {
+    EXPECT_EQ(nodes, Perft(Board(b, m), 2)) << m;
+    sum += nodes;
+  }
+  EXPECT_EQ(sum, 2812);
+}
+
 }  // namespace
 }  // namespace chess
 
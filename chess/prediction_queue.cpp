@@ -13,7 +13,7 @@ constexpr int kGenBuckets = 10;
 
 }  // namespace
 
-PredictionQueue::PredictionQueue(Model* model, int max_batch_size)
+PredictionQueue::PredictionQueue(generic::Model* model, int max_batch_size)
     : model_(model), max_batch_size_(max_batch_size) {
   const int kNumWorkers = 2;
   for (int i = 0; i < kNumWorkers; ++i) {
@@ -40,12 +40,12 @@ void PredictionQueue::WorkerThread(int worker_id) {
       if (stopped_) {
         return true;
       }
-      if (num_working_ == 0) {
-        // First worker will take anything.
-        return !batches_.empty();
+      if (batches_.empty() || batches_.front()->pending_writes > 0) {
+        return false;
       }
-      // Rest, only take work if the batch is full.
-      return !batches_.empty() && batches_.front()->size == max_batch_size_;
+      // First worker will take anything. Rest, only take work if the batch is
+      // full.
+      return num_working_ == 0 || batches_.front()->size == max_batch_size_;
     };
     mu_.Await(absl::Condition(&stopped_or_have_work));
     if (stopped_) {
@@ -86,6 +86,7 @@ std::shared_ptr<PredictionQueue::WorkBatch> PredictionQueue::CreateBatch() {
 
   r->ready = false;
   r->size = 0;
+  r->pending_writes = 0;
   // Should already be zero.
   CHECK_EQ(r->pending_requests, 0);
   return r;
@@ -106,6 +107,11 @@ void PredictionQueue::GetPredictions(Request* requests_in, int n) {
   }
   n = not_cached.size();
   Request** requests = not_cached.data();
+  std::vector<const Board*> board_ptrs(n);
+  for (int i = 0; i < n; ++i) {
+    board_ptrs[i] = requests[i]->board;
+  }
+  const Board* const* boards = board_ptrs.data();
 
   while (n > 0) {
     std::shared_ptr<WorkBatch> last_batch;
@@ -128,12 +134,14 @@ void PredictionQueue::GetPredictions(Request* requests_in, int n) {
       batch_n = std::min(n, max_batch_size_ - offset);
       last_batch->size += batch_n;
       ++last_batch->pending_requests;
-
-      // Write input in the tensor already.
-      for (int i = 0; i < batch_n; ++i) {
-        auto slice = last_batch->board_tensor.SubSlice(offset + i);
-        BoardToTensor(*requests[i]->board, &slice);
-      }
+      ++last_batch->pending_writes;
+    }
+    // Write input to our slots without holding the lock. The batch can't be
+    // evaluated or reused before we're done, since pending_writes is nonzero.
+    BoardsToTensor(boards, batch_n, &last_batch->board_tensor, offset);
+    {
+      absl::MutexLock lock(&mu_);
+      --last_batch->pending_writes;
       // Wait for this batch to be ready.
       mu_.Await(absl::Condition(&last_batch->ready));
     }
@@ -164,13 +172,14 @@ void PredictionQueue::GetPredictions(Request* requests_in, int n) {
       for (auto& move_p : request.result.policy) {
         move_p.second /= total;
       }
-      request.result.value = last_batch->value.flat<float>()(i);
+      request.result.value = last_batch->value.flat<float>()(offset + i);
       cache_.Insert(gen, *request.board, request.result);
     }
 
     // Now we can try making a new request.
     n -= batch_n;
     requests += batch_n;
+    boards += batch_n;
 
     // Potentially freelist last_batch.
     {
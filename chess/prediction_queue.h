@@ -28,7 +28,7 @@ class PredictionQueue {
 
     PredictionResult result;
   };
-  explicit PredictionQueue(Model* model, int max_batch_size = 64);
+  explicit PredictionQueue(generic::Model* model, int max_batch_size = 64);
   ~PredictionQueue();
 
   // Blocks.
@@ -60,7 +60,11 @@ class PredictionQueue {
     tensorflow::Tensor board_tensor;
     tensorflow::Tensor move_p;
     tensorflow::Tensor value;
+    // Number of slots reserved by requests.
     int size = 0;
+    // Requests that have reserved slots but are still writing their input.
+    // The batch can only be evaluated once this drops to zero.
+    int pending_writes = 0;
     bool ready = false;
     int pending_requests = 0;
   };
@@ -69,7 +73,7 @@ class PredictionQueue {
 
   std::shared_ptr<WorkBatch> CreateBatch() EXCLUSIVE_LOCKS_REQUIRED(mu_);
 
-  Model* const model_;
+  generic::Model* const model_;
   const int max_batch_size_;
 
   std::atomic<int64_t> pred_count_{0};
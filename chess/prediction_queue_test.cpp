@@ -1,8 +1,13 @@
 #include "chess/prediction_queue.h"
 
 #include <cstdint>
+#include <random>
+#include <thread>
 #include <vector>
 
+#include "chess/board.h"
+#include "chess/tensors.h"
+#include "generic/model.h"
 #include "gmock/gmock.h"
 #include "gtest/gtest.h"
 
@@ -23,5 +28,83 @@ namespace {
 //
 // These 
 
+// A different value for each board in 'batch', at index 'i'.
+float FakeValue(const tensorflow::Tensor& batch, int i) {
+  const int size = kBoardTensorNumLayers * 64;
+  const float* input = batch.flat<float>().data() + int64_t{i} * size;
+  float sum = 0;
+  for (int j = 0; j < size; ++j) {
+    sum += input[j] * j;
+  }
+  return sum / 1e6;
+}
+
+float FakeValue(const Board& b) {
+  tensorflow::Tensor t = MakeBoardTensor(1);
+  const Board* boards[] = {&b};
+  BoardsToTensor(boards, 1, &t, 0);
+  return FakeValue(t, 0);
+}
+
+// Predicts FakeValue() for each board, and an even policy.
+class FakeModel : public generic::Model {
+ public:
+  Prediction Predict(const tensorflow::Tensor& batch) override {
+    const int n = batch.dim_size(0);
+    Prediction pred;
+    pred.move_p = tensorflow::Tensor(
+        tensorflow::DT_FLOAT, tensorflow::TensorShape({n, kMoveVectorSize}));
+    pred.value =
+        tensorflow::Tensor(tensorflow::DT_FLOAT, tensorflow::TensorShape({n}));
+    for (int64_t i = 0; i < int64_t{n} * kMoveVectorSize; ++i) {
+      pred.move_p.flat<float>()(i) = 1.0;
+    }
+    for (int i = 0; i < n; ++i) {
+      pred.value.flat<float>()(i) = FakeValue(batch, i);
+    }
+    return pred;
+  }
+};
+
+// Threads sharing a queue get their requests batched together, at any
+// offset in the batch. Each must still get the results for its own boards.
+TEST(PredictionQueueTest, ThreadsShareBatches) {
+  FakeModel model;
+  PredictionQueue queue(&model, 16);
+  std::vector<std::thread> threads;
+  for (int t = 0; t < 8; ++t) {
+    threads.emplace_back([&queue, t] {
+      std::mt19937 rand(t);
+      for (int round = 0; round < 50; ++round) {
+        // Boards after a few random moves, with their moves.
+        std::vector<Board> boards(8);
+        std::vector<MoveList> moves(8);
+        PredictionQueue::Request requests[8];
+        for (int i = 0; i < 8; ++i) {
+          for (int ply = 0; ply < 6; ++ply) {
+            const MoveList valid = boards[i].valid_moves();
+            boards[i] = Board(boards[i], valid[rand() % valid.size()]);
+          }
+          moves[i] = boards[i].valid_moves();
+          requests[i].board = &boards[i];
+          requests[i].moves = &moves[i];
+        }
+        queue.GetPredictions(requests, 8);
+        for (int i = 0; i < 8; ++i) {
+          EXPECT_FLOAT_EQ(requests[i].result.value, FakeValue(boards[i]))
+              << boards[i].ToFEN();
+          ASSERT_EQ(requests[i].result.policy.size(), moves[i].size());
+          for (const auto& move_p : requests[i].result.policy) {
+            EXPECT_FLOAT_EQ(move_p.second, 1.0 / moves[i].size());
+          }
+        }
+      }
+    });
+  }
+  for (auto& t : threads) {
+    t.join();
+  }
+}
+
 }  // namespace
 }  // namespace chess
@@ -14,6 +14,7 @@
 #include "chess/model.h"
 #include "chess/model_collection.h"
 #include "chess/player.h"
+#include "chess/tablebase.h"
 #include "generic/prediction_queue.h"
 #include "generic/shuffling_trainer.h"
 #include "tensorflow/core/platform/env.h"
@@ -24,6 +25,9 @@
 namespace chess {
 
 const int kNumIters = 400;
+// Generated with tablebase_gen. Games end as soon as they reach a position
+// in the tables, and searches don't go past them.
+const char kTablebaseDir[] = "/mnt/tensor-data/chess-tablebases";
 
 const std::string kTrainingFens[] = {
     // One rook per side
@@ -96,14 +100,16 @@ Board CreateStartBoard(std::mt19937_64& rand) {
 }
 
 void PlayerThread(int thread_i, generic::PredictionQueue* pred_queue,
-                  generic::ShufflingTrainer* trainer) {
+                  generic::ShufflingTrainer* trainer,
+                  const Tablebase* tablebase) {
   auto player = std::make_unique<MCTSPlayer>(pred_queue, kNumIters);
+  player->set_tablebase(tablebase);
   const int kGamesPerRefresh = 1;
   int games_to_refresh = kGamesPerRefresh;
 
   std::mt19937_64 rand(thread_i);
   while (true) {
-    Game g({player.get()}, CreateStartBoard(rand));
+    Game g({player.get()}, CreateStartBoard(rand), tablebase);
     while (!g.is_over()) {
       g.Work();
     }
@@ -140,6 +146,7 @@ void PlayerThread(int thread_i, generic::PredictionQueue* pred_queue,
       // Player state is reset since we may have learned something and play
       // better now.
       player = std::make_unique<MCTSPlayer>(pred_queue, kNumIters);
+      player->set_tablebase(tablebase);
     }
   }
 }
@@ -155,6 +162,9 @@ void PlayGames() {
     LOG(INFO) << "Continuing training";
   }
 
+  const std::unique_ptr<Tablebase> tablebase = Tablebase::Open(kTablebaseDir);
+  LOG(INFO) << "Tablebase has up to " << tablebase->max_pieces() << " pieces";
+
   generic::PredictionQueue pred_queue(model.get(), 256);
   generic::ShufflingTrainer trainer(model.get(), *MakeGenericBoard(Board()));
   std::vector<std::thread> threads;
@@ -162,8 +172,9 @@ void PlayGames() {
   const int kNumThreads = 80;
   // const int kNumThreads = 1;
   for (int i = 0; i < kNumThreads; ++i) {
-    threads.emplace_back(
-        [i, &pred_queue, &trainer] { PlayerThread(i, &pred_queue, &trainer); });
+    threads.emplace_back([i, &pred_queue, &trainer, &tablebase] {
+      PlayerThread(i, &pred_queue, &trainer, tablebase.get());
+    });
   }
   int64_t last_num_preds = 0;
   absl::Time last_log = absl::Now();
@@ -85,9 +85,13 @@ void ShufflingTrainer::WorkerThread() {
       }
     }
 
+    std::vector<const Board*> boards(batch_size_);
+    for (int i = 0; i < batch_size_; ++i) {
+      boards[i] = &batch_samples[i]->board;
+    }
+    BoardsToTensor(boards.data(), batch_size_, &board_tensor, 0);
     for (int i = 0; i < batch_size_; ++i) {
       const auto& sample = batch_samples[i];
-      BoardToTensor(sample->board, board_tensor.SubSlice(i));
 
       auto move_vec = move_tensor.SubSlice(i);
       for (int i = 0; i < kMoveVectorSize; ++i) {
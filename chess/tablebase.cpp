@@ -0,0 +1,840 @@
+#include "chess/tablebase.h"
+
+#include <dirent.h>
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <limits>
+
+#include "absl/container/inlined_vector.h"
+#include "absl/strings/match.h"
+#include "absl/strings/str_split.h"
+#include "chess/bitboard.h"
+#include "chess/magic.h"
+#include "chess/movegen.h"
+#include "chess/square.h"
+#include "util/mapped_file.h"
+
+namespace chess {
+
+namespace {
+
+// Table files start with this header, followed by one byte per position.
+struct Header {
+  char magic[8];
+  uint32_t version;
+  uint32_t reserved;
+  uint64_t num_positions;
+  // Canonical material name, zero padded.
+  char material[16];
+};
+static_assert(sizeof(Header) == 40);
+
+constexpr char kMagic[8] = "CHESSTB";
+constexpr uint32_t kVersion = 1;
+constexpr absl::string_view kSuffix = ".tb";
+
+// Values of the positions. Other values are the DTM in plies.
+constexpr uint8_t kMaxDtm = 251;
+// Only used during generation.
+constexpr uint8_t kUnresolved = 252;
+constexpr uint8_t kDraw = 254;
+// Illegal positions, and positions which have another index by symmetry.
+constexpr uint8_t kInvalid = 255;
+
+// The eight symmetries of the board: bit 0 mirrors files, bit 1 ranks, and
+// bit 2 swaps them (after the mirroring). With pawns only the first two are
+// symmetries.
+int Transform(int sq, int t) {
+  int r = SquareRank(sq);
+  int f = SquareFile(sq);
+  if (t & 1) {
+    f = 7 - f;
+  }
+  if (t & 2) {
+    r = 7 - r;
+  }
+  if (t & 4) {
+    std::swap(r, f);
+  }
+  return MakeSquare(r, f);
+}
+
+// Squares attacked by the pieces of 'c'.
+uint64_t Attacks(const Board& b, Color c) {
+  const uint64_t occ = b.occupied();
+  const uint64_t mine = b.pieces(c);
+  const uint64_t pawns = b.pawns() & mine;
+  uint64_t attacks = c == Color::kWhite
+                         ? ((pawns & ~FileMask(0)) << 7) |
+                               ((pawns & ~FileMask(7)) << 9)
+                         : ((pawns & ~FileMask(0)) >> 9) |
+                               ((pawns & ~FileMask(7)) >> 7);
+  for (int s : BitRange(b.knights() & mine)) {
+    attacks |= KnightMoveMask(s);
+  }
+  for (int s : BitRange(b.diagonal_sliders() & mine)) {
+    attacks |= BishopMoveMask(s, occ);
+  }
+  for (int s : BitRange(b.orthogonal_sliders() & mine)) {
+    attacks |= RookMoveMask(s, occ);
+  }
+  for (int s : BitRange(b.kings() & mine)) {
+    attacks |= KingMoveMask(s);
+  }
+  return attacks;
+}
+
+// Whether the player who just moved is not in check.
+bool IsLegal(const Board& b) {
+  const Color opp = OtherColor(b.turn());
+  return (Attacks(b, b.turn()) & b.kings() & b.pieces(opp)) == 0;
+}
+
+bool HasEnPassantCapture(const Board& b) {
+  bool found = false;
+  IterateLegalMoves(b, [&](const Move& m) {
+    found |= m.type == Move::Type::kEnPassant;
+  });
+  return found;
+}
+
+absl::optional<TablebaseResult> DecodeValue(uint8_t v) {
+  if (v == kInvalid || v == kUnresolved) {
+    return absl::nullopt;
+  }
+  TablebaseResult r;
+  if (v != kDraw) {
+    r.wdl = v % 2 == 1 ? 1 : -1;
+    r.dtm = v;
+  }
+  return r;
+}
+
+// Maps the positions of one material to table indices.
+//
+// Pieces are ordered as in the material name: the white king, white pieces,
+// the black king and black pieces. The index is made of the side to move and
+// the square of each piece, with symmetric positions sharing one index: the
+// board is turned so that the white king is on a1-d1-d4 (or on files a-d,
+// with pawns), and identical pieces are sorted by square. Where several
+// symmetries qualify, the smallest index is used. Other indices are left
+// unused.
+class Layout {
+ public:
+  explicit Layout(const Material& m) {
+    for (int c = 0; c < 2; ++c) {
+      pieces_.push_back({Piece::kKing, Color(c)});
+      for (Piece p : m.pieces[c]) {
+        pieces_.push_back({p, Color(c)});
+      }
+    }
+    for (int i = 0; i < num_pieces();) {
+      int end = i + 1;
+      while (end < num_pieces() && pieces_[end].p == pieces_[i].p &&
+             pieces_[end].c == pieces_[i].c) {
+        ++end;
+      }
+      runs_.emplace_back(i, end);
+      i = end;
+    }
+
+    const bool pawns = m.has_pawns();
+    std::fill_n(king_region_, 64, -1);
+    for (int sq = 0; sq < 64; ++sq) {
+      const int r = SquareRank(sq);
+      const int f = SquareFile(sq);
+      if (f < 4 && (pawns || r <= f)) {
+        king_region_[sq] = king_squares_.size();
+        king_squares_.push_back(sq);
+      }
+    }
+    const int num_transforms = pawns ? 2 : 8;
+    for (int sq = 0; sq < 64; ++sq) {
+      for (int t = 0; t < num_transforms; ++t) {
+        if (king_region_[Transform(sq, t)] >= 0) {
+          transforms_[sq].push_back(t);
+        }
+      }
+    }
+
+    size_ = 2 * king_squares_.size();
+    for (int i = 1; i < num_pieces(); ++i) {
+      size_ *= range(i);
+    }
+  }
+
+  uint64_t size() const { return size_; }
+  int num_pieces() const { return pieces_.size(); }
+  const PieceColor& piece(int i) const { return pieces_[i]; }
+
+  // Index of the position with 'turn' to move and the pieces on 'squares'.
+  uint64_t Index(Color turn, const int* squares) const {
+    uint64_t best = std::numeric_limits<uint64_t>::max();
+    int transformed[kMaxTablebasePieces];
+    for (int t : transforms_[squares[0]]) {
+      for (int i = 0; i < num_pieces(); ++i) {
+        transformed[i] = Transform(squares[i], t);
+      }
+      for (const auto& run : runs_) {
+        std::sort(transformed + run.first, transformed + run.second);
+      }
+      best = std::min(best, RawIndex(turn, transformed));
+    }
+    return best;
+  }
+
+  // Inverse of Index(), without the symmetries. Sets 'squares' and returns
+  // the side to move.
+  Color Decode(uint64_t index, int* squares) const {
+    for (int i = pieces_.size() - 1; i >= 1; --i) {
+      const int v = index % range(i);
+      index /= range(i);
+      squares[i] = pieces_[i].p == Piece::kPawn ? v + 8 : v;
+    }
+    squares[0] = king_squares_[index % king_squares_.size()];
+    index /= king_squares_.size();
+    return index == 0 ? Color::kWhite : Color::kBlack;
+  }
+
+  // Sets 'squares' to the squares of the pieces of 'b', which must have this
+  // material, or with 'flip' its flipped material.
+  void GetSquares(const Board& b, bool flip, int* squares) const {
+    for (const auto& run : runs_) {
+      const PieceColor& pc = pieces_[run.first];
+      const Color c = flip ? OtherColor(pc.c) : pc.c;
+      int i = run.first;
+      for (int s : BitRange(b.bitboard(c, pc.p))) {
+        squares[i++] = flip ? s ^ 56 : s;
+      }
+    }
+  }
+
+  Board MakeBoard(Color turn, const int* squares) const {
+    PieceColor arr[64] = {};
+    for (int i = 0; i < num_pieces(); ++i) {
+      arr[squares[i]] = pieces_[i];
+    }
+    return Board(arr, turn);
+  }
+
+ private:
+  // Number of squares piece 'i' can be on. The king is the white king.
+  int range(int i) const {
+    if (i == 0) {
+      return king_squares_.size();
+    }
+    return pieces_[i].p == Piece::kPawn ? 48 : 64;
+  }
+
+  uint64_t RawIndex(Color turn, const int* squares) const {
+    uint64_t index = turn == Color::kWhite ? 0 : 1;
+    index = index * king_squares_.size() + king_region_[squares[0]];
+    for (int i = 1; i < num_pieces(); ++i) {
+      const int sq = squares[i];
+      index = index * range(i) + (pieces_[i].p == Piece::kPawn ? sq - 8 : sq);
+    }
+    return index;
+  }
+
+  std::vector<PieceColor> pieces_;
+  // Ranges of identical pieces, [begin, end).
+  std::vector<std::pair<int, int>> runs_;
+  // Index of each square among the white king squares, or -1.
+  int king_region_[64];
+  std::vector<int> king_squares_;
+  // Symmetries which take the white king from each square to the region.
+  absl::InlinedVector<int, 2> transforms_[64];
+  uint64_t size_;
+};
+
+// Retrograde analysis of one table. Starting from checkmates, positions are
+// resolved in order of their DTM: a position is won in d + 1 if any move
+// leads to a position lost in d, and lost once all its moves lead to won
+// positions. Predecessors are found by "unmoving" quiet moves, while the
+// moves themselves come from the regular move generator. What's left
+// unresolved is drawn.
+//
+// Table positions have no en passant square, so a double pawn push which
+// allows an en passant capture leads to an extra position outside the table:
+// the table position with the en passant captures added. Its result is the
+// better of the two for its player to move.
+class Generator {
+ public:
+  Generator(const Material& material, const Tablebase& tablebase)
+      : layout_(material),
+        tablebase_(tablebase),
+        values_(layout_.size(), kInvalid),
+        counts_(layout_.size(), 0),
+        exits_(layout_.size(), 0) {}
+
+  // Returns false if some DTM doesn't fit in a byte.
+  bool Run() {
+    std::vector<uint32_t> children;
+    for (uint64_t i = 0; i < layout_.size(); ++i) {
+      Init(i, &children);
+    }
+    std::vector<uint32_t> parents;
+    for (size_t d = 0; d < queues_.size(); ++d) {
+      // Later levels may be added meanwhile.
+      for (size_t i = 0; i < queues_[d].size(); ++i) {
+        const uint32_t index = queues_[d][i];
+        if (values_[index] != kUnresolved) {
+          continue;
+        }
+        if (d > kMaxDtm) {
+          std::cerr << "DTM " << d << " does not fit in the table\n";
+          return false;
+        }
+        values_[index] = d;
+        if (index >= layout_.size()) {
+          // Only reached by the double push from its parent.
+          parents.assign(1, en_passant_parents_[index - layout_.size()]);
+        } else {
+          GetParents(index, &parents);
+          ResolveEnPassant(index, d);
+        }
+        for (uint32_t p : parents) {
+          if (values_[p] != kUnresolved) {
+            continue;
+          }
+          if (d % 2 == 0) {
+            Push(d + 1, p);
+          } else if (--counts_[p] == 0 && exits_[p] != kCantLose) {
+            Push(std::max<int>(d + 1, exits_[p]), p);
+          }
+        }
+      }
+      std::vector<uint32_t>().swap(queues_[d]);
+    }
+    values_.resize(layout_.size());
+    for (uint8_t& v : values_) {
+      if (v == kUnresolved) {
+        v = kDraw;
+      }
+    }
+    return true;
+  }
+
+  const std::vector<uint8_t>& values() const { return values_; }
+
+ private:
+  // In exits_, for positions with a capture or promotion which doesn't lose.
+  static constexpr uint8_t kCantLose = 255;
+
+  // Results of the moves which leave the table, for the player to move.
+  struct Exits {
+    int win = std::numeric_limits<int>::max();
+    int loss = 0;
+    bool draw = false;
+
+    bool cant_lose() const {
+      return draw || win != std::numeric_limits<int>::max();
+    }
+    uint8_t value() const {
+      return cant_lose() ? kCantLose : std::min<int>(loss, kCantLose - 1);
+    }
+  };
+
+  void AddExit(const Board& child, Exits* exits) const {
+    const auto r = tablebase_.Probe(child);
+    if (!r.has_value()) {
+      std::cerr << "No table for " << child.ToFEN() << "\n";
+      abort();
+    }
+    if (r->wdl < 0) {
+      exits->win = std::min(exits->win, r->dtm + 1);
+    } else if (r->wdl == 0) {
+      exits->draw = true;
+    } else {
+      exits->loss = std::max(exits->loss, r->dtm + 1);
+    }
+  }
+
+  // Whether 'm' is a double pawn push which allows an en passant capture.
+  static bool AllowsEnPassant(const Board& b, const Move& m) {
+    return b.square(m.from).p == Piece::kPawn &&
+           std::abs(m.to - m.from) == 16 && HasEnPassantCapture(Board(b, m));
+  }
+
+  // Finds out whether 'index' is a legal position, and if so, counts its
+  // moves within the table and evaluates those leaving it. Checkmates and
+  // wins by leaving the table are queued for their level.
+  void Init(uint64_t index, std::vector<uint32_t>* children) {
+    int squares[kMaxTablebasePieces];
+    const Color turn = layout_.Decode(index, squares);
+    uint64_t occ = 0;
+    for (int i = 0; i < layout_.num_pieces(); ++i) {
+      if (occ & OneHot(squares[i])) {
+        return;
+      }
+      occ |= OneHot(squares[i]);
+    }
+    if (layout_.Index(turn, squares) != index) {
+      return;
+    }
+    const Board b = layout_.MakeBoard(turn, squares);
+    if (!IsLegal(b)) {
+      return;
+    }
+    values_[index] = kUnresolved;
+
+    children->clear();
+    Exits exits;
+    const MovegenResult res = IterateLegalMoves(b, [&](const Move& m) {
+      if (m.promotion != Piece::kNone || b.square(m.to).c != Color::kEmpty) {
+        AddExit(Board(b, m), &exits);
+        return;
+      }
+      int child[kMaxTablebasePieces];
+      std::copy_n(squares, layout_.num_pieces(), child);
+      *std::find(child, child + layout_.num_pieces(), m.from) = m.to;
+      const uint32_t child_index = layout_.Index(OtherColor(turn), child);
+      if (AllowsEnPassant(b, m)) {
+        children->push_back(
+            AddEnPassantPosition(Board(b, m), index, child_index));
+      } else {
+        children->push_back(child_index);
+      }
+    });
+    if (res == MovegenResult::kCheckmate) {
+      Push(0, index);
+      return;
+    }
+    if (res == MovegenResult::kStalemate) {
+      values_[index] = kDraw;
+      return;
+    }
+    std::sort(children->begin(), children->end());
+    children->erase(std::unique(children->begin(), children->end()),
+                    children->end());
+    counts_[index] = children->size();
+    exits_[index] = exits.value();
+    if (exits.win != std::numeric_limits<int>::max()) {
+      Push(exits.win, index);
+    } else if (children->empty() && !exits.cant_lose()) {
+      Push(exits.loss, index);
+    }
+  }
+
+  // Adds the position 'b' after a double push from 'parent', which is table
+  // position 'position' with en passant captures. Returns its index.
+  uint32_t AddEnPassantPosition(const Board& b, uint32_t parent,
+                                uint32_t position) {
+    Exits exits;
+    IterateLegalMoves(b, [&](const Move& m) {
+      if (m.type == Move::Type::kEnPassant) {
+        AddExit(Board(b, m), &exits);
+      }
+    });
+    const uint32_t index = values_.size();
+    values_.push_back(kUnresolved);
+    counts_.push_back(0);
+    exits_.push_back(exits.value());
+    en_passant_parents_.push_back(parent);
+    en_passant_[position].push_back(index);
+    if (exits.win != std::numeric_limits<int>::max()) {
+      Push(exits.win, index);
+    }
+    return index;
+  }
+
+  // Table position 'index' was resolved at 'd': so are the en passant
+  // positions for which it's at least as good as the captures.
+  void ResolveEnPassant(uint32_t index, int d) {
+    const auto it = en_passant_.find(index);
+    if (it == en_passant_.end()) {
+      return;
+    }
+    for (uint32_t p : it->second) {
+      if (values_[p] != kUnresolved) {
+        continue;
+      }
+      if (d % 2 == 1) {
+        Push(d, p);
+      } else if (exits_[p] != kCantLose) {
+        Push(std::max<int>(d, exits_[p]), p);
+      }
+    }
+  }
+
+  // Sets 'parents' to the distinct legal positions with a quiet move to
+  // 'index'.
+  void GetParents(uint32_t index, std::vector<uint32_t>* parents) const {
+    parents->clear();
+    int squares[kMaxTablebasePieces];
+    const Color mover = OtherColor(layout_.Decode(index, squares));
+    uint64_t occ = 0;
+    for (int i = 0; i < layout_.num_pieces(); ++i) {
+      occ |= OneHot(squares[i]);
+    }
+    for (int i = 0; i < layout_.num_pieces(); ++i) {
+      const PieceColor& pc = layout_.piece(i);
+      if (pc.c != mover) {
+        continue;
+      }
+      const int to = squares[i];
+      uint64_t from = 0;
+      switch (pc.p) {
+        case Piece::kPawn: {
+          const int back = mover == Color::kWhite ? -8 : 8;
+          const int rank = mover == Color::kWhite ? SquareRank(to)
+                                                  : 7 - SquareRank(to);
+          if (rank >= 2 && !BitIsSet(occ, to + back)) {
+            from |= OneHot(to + back);
+            if (rank == 3 && !BitIsSet(occ, to + 2 * back)) {
+              from |= OneHot(to + 2 * back);
+            }
+          }
+          break;
+        }
+        case Piece::kKnight:
+          from = KnightMoveMask(to);
+          break;
+        case Piece::kBishop:
+          from = BishopMoveMask(to, occ);
+          break;
+        case Piece::kRook:
+          from = RookMoveMask(to, occ);
+          break;
+        case Piece::kQueen:
+          from = BishopMoveMask(to, occ) | RookMoveMask(to, occ);
+          break;
+        default:
+          from = KingMoveMask(to);
+          break;
+      }
+      for (int s : BitRange(from & ~occ)) {
+        squares[i] = s;
+        const uint64_t parent = layout_.Index(mover, squares);
+        if (values_[parent] == kInvalid) {
+          continue;
+        }
+        if (pc.p == Piece::kPawn && std::abs(to - s) == 16 &&
+            AllowsEnPassant(layout_.MakeBoard(mover, squares),
+                            Move(s, to, Move::Type::kRegular))) {
+          // The parent's move leads to an en passant position instead.
+          continue;
+        }
+        parents->push_back(parent);
+      }
+      squares[i] = to;
+    }
+    std::sort(parents->begin(), parents->end());
+    parents->erase(std::unique(parents->begin(), parents->end()),
+                   parents->end());
+  }
+
+  void Push(int level, uint32_t index) {
+    if (level >= static_cast<int>(queues_.size())) {
+      queues_.resize(level + 1);
+    }
+    queues_[level].push_back(index);
+  }
+
+  const Layout layout_;
+  const Tablebase& tablebase_;
+  std::vector<uint8_t> values_;
+  // Number of distinct unresolved positions reached by quiet moves.
+  std::vector<uint8_t> counts_;
+  // Longest loss by a capture or promotion, in plies, or kCantLose.
+  std::vector<uint8_t> exits_;
+  // Parent of each en passant position, indexed from layout_.size().
+  std::vector<uint32_t> en_passant_parents_;
+  // En passant positions of each table position.
+  absl::flat_hash_map<uint32_t, absl::InlinedVector<uint32_t, 1>> en_passant_;
+  // Positions to resolve at each DTM, if still unresolved by then.
+  std::vector<std::vector<uint32_t>> queues_;
+};
+
+}  // namespace
+
+absl::optional<Material> Material::FromString(absl::string_view name) {
+  const std::vector<absl::string_view> sides = absl::StrSplit(name, 'v');
+  if (sides.size() != 2) {
+    return absl::nullopt;
+  }
+  Material m;
+  for (int c = 0; c < 2; ++c) {
+    if (!absl::StartsWith(sides[c], "K")) {
+      return absl::nullopt;
+    }
+    for (char ch : sides[c].substr(1)) {
+      const size_t p = absl::string_view("PNBRQ").find(ch);
+      if (p == absl::string_view::npos) {
+        return absl::nullopt;
+      }
+      m.pieces[c].push_back(Piece(p));
+    }
+    std::sort(m.pieces[c].rbegin(), m.pieces[c].rend());
+  }
+  return m;
+}
+
+Material Material::FromBoard(const Board& b) {
+  Material m;
+  for (int c = 0; c < 2; ++c) {
+    for (Piece p : {Piece::kQueen, Piece::kRook, Piece::kBishop,
+                    Piece::kKnight, Piece::kPawn}) {
+      m.pieces[c].insert(m.pieces[c].end(),
+                         PopCount(b.bitboard(Color(c), p)), p);
+    }
+  }
+  return m;
+}
+
+std::string Material::ToString() const {
+  std::string s;
+  for (int c = 0; c < 2; ++c) {
+    if (c == 1) {
+      s += 'v';
+    }
+    s += 'K';
+    for (Piece p : pieces[c]) {
+      s += PieceChar(p);
+    }
+  }
+  return s;
+}
+
+bool Material::has_pawns() const {
+  for (int c = 0; c < 2; ++c) {
+    if (std::count(pieces[c].begin(), pieces[c].end(), Piece::kPawn) > 0) {
+      return true;
+    }
+  }
+  return false;
+}
+
+Material Material::Flipped() const {
+  Material m;
+  m.pieces[0] = pieces[1];
+  m.pieces[1] = pieces[0];
+  return m;
+}
+
+Material Material::Canonical() const {
+  return pieces[0] < pieces[1] ? Flipped() : *this;
+}
+
+std::vector<Material> Material::Successors() const {
+  std::vector<Material> out;
+  const auto add = [&out](Material m) {
+    for (int c = 0; c < 2; ++c) {
+      std::sort(m.pieces[c].rbegin(), m.pieces[c].rend());
+    }
+    if (m.num_pieces() == 2) {
+      return;
+    }
+    m = m.Canonical();
+    if (std::find(out.begin(), out.end(), m) == out.end()) {
+      out.push_back(m);
+    }
+  };
+  for (int c = 0; c < 2; ++c) {
+    for (size_t i = 0; i < pieces[c].size(); ++i) {
+      // Captured by the other side.
+      Material captured = *this;
+      captured.pieces[c].erase(captured.pieces[c].begin() + i);
+      add(captured);
+      if (pieces[c][i] != Piece::kPawn) {
+        continue;
+      }
+      for (Piece promo : kPromoPieces) {
+        Material promoted = *this;
+        promoted.pieces[c][i] = promo;
+        add(promoted);
+        // Promoting with a capture.
+        for (size_t j = 0; j < pieces[1 - c].size(); ++j) {
+          Material both = promoted;
+          both.pieces[1 - c].erase(both.pieces[1 - c].begin() + j);
+          add(both);
+        }
+      }
+    }
+  }
+  return out;
+}
+
+struct Tablebase::Table {
+  explicit Table(const Material& m) : layout(m) {}
+
+  const Layout layout;
+  std::unique_ptr<util::MappedFile> file;
+  const uint8_t* values = nullptr;
+};
+
+Tablebase::Tablebase() {}
+Tablebase::~Tablebase() {}
+
+std::unique_ptr<Tablebase> Tablebase::Open(const std::string& dir) {
+  auto tablebase = std::make_unique<Tablebase>();
+  DIR* d = opendir(dir.c_str());
+  if (d == nullptr) {
+    std::cerr << "Can't open tablebase directory " << dir << "\n";
+    return tablebase;
+  }
+  while (const dirent* entry = readdir(d)) {
+    const std::string name = entry->d_name;
+    if (absl::EndsWith(name, kSuffix) &&
+        !tablebase->AddTable(dir + "/" + name)) {
+      std::cerr << "Skipping invalid table " << dir << "/" << name << "\n";
+    }
+  }
+  closedir(d);
+  return tablebase;
+}
+
+bool Tablebase::AddTable(const std::string& path) {
+  auto file = util::MappedFile::Open(path);
+  if (file == nullptr || file->size() < sizeof(Header)) {
+    return false;
+  }
+  Header header;
+  std::memcpy(&header, file->data(), sizeof(header));
+  if (std::memcmp(header.magic, kMagic, sizeof(kMagic)) != 0 ||
+      header.version != kVersion) {
+    return false;
+  }
+  const std::string name(header.material,
+                         strnlen(header.material, sizeof(header.material)));
+  const absl::optional<Material> material = Material::FromString(name);
+  if (!material.has_value() || !(material->Canonical() == *material) ||
+      material->num_pieces() > kMaxTablebasePieces) {
+    return false;
+  }
+  auto table = std::make_unique<Table>(*material);
+  if (header.num_positions != table->layout.size() ||
+      file->size() != sizeof(Header) + header.num_positions) {
+    return false;
+  }
+  table->values = file->data() + sizeof(Header);
+  table->file = std::move(file);
+  max_pieces_ = std::max(max_pieces_, material->num_pieces());
+  tables_[name] = std::move(table);
+  return true;
+}
+
+bool Tablebase::Has(const Material& m) const {
+  return tables_.contains(m.Canonical().ToString());
+}
+
+absl::optional<TablebaseResult> Tablebase::Probe(const Board& b) const {
+  const int num_pieces = PopCount(b.occupied());
+  if (num_pieces > max_pieces_ || b.castling_rights() != 0) {
+    return absl::nullopt;
+  }
+  if (b.en_passant() != 0 && HasEnPassantCapture(b)) {
+    return ProbeMoves(b);
+  }
+  if (num_pieces == 2) {
+    // Bare kings.
+    return TablebaseResult();
+  }
+  const Material material = Material::FromBoard(b);
+  const Material canonical = material.Canonical();
+  const auto it = tables_.find(canonical.ToString());
+  if (it == tables_.end()) {
+    return absl::nullopt;
+  }
+  const Table& table = *it->second;
+  const bool flip = !(canonical == material);
+  int squares[kMaxTablebasePieces];
+  table.layout.GetSquares(b, flip, squares);
+  const Color turn = flip ? OtherColor(b.turn()) : b.turn();
+  return DecodeValue(table.values[table.layout.Index(turn, squares)]);
+}
+
+absl::optional<TablebaseResult> Tablebase::ProbeMoves(const Board& b) const {
+  TablebaseResult best;
+  best.wdl = -2;
+  bool covered = true;
+  const MovegenResult res = IterateLegalMoves(b, [&](const Move& m) {
+    const auto child = Probe(Board(b, m));
+    if (!child.has_value()) {
+      covered = false;
+      return;
+    }
+    const int wdl = -child->wdl;
+    const int dtm = wdl == 0 ? 0 : child->dtm + 1;
+    // Prefer the fastest win and the slowest loss.
+    if (wdl > best.wdl || (wdl == best.wdl && (wdl > 0 ? dtm < best.dtm
+                                                         : dtm > best.dtm))) {
+      best = {wdl, dtm};
+    }
+  });
+  if (!covered) {
+    return absl::nullopt;
+  }
+  if (res == MovegenResult::kCheckmate) {
+    return TablebaseResult{-1, 0};
+  }
+  if (res == MovegenResult::kStalemate) {
+    return TablebaseResult();
+  }
+  return best;
+}
+
+std::vector<Move> Tablebase::BestMoves(const Board& b) const {
+  std::vector<Move> best;
+  const auto result = Probe(b);
+  if (!result.has_value()) {
+    return best;
+  }
+  IterateLegalMoves(b, [&](const Move& m) {
+    const auto child = Probe(Board(b, m));
+    if (!child.has_value()) {
+      return;
+    }
+    if (result->wdl == 0 ? child->wdl == 0
+                         : child->wdl == -result->wdl &&
+                               child->dtm + 1 == result->dtm) {
+      best.push_back(m);
+    }
+  });
+  return best;
+}
+
+bool GenerateTable(const Material& material, const Tablebase& tablebase,
+                   const std::string& path) {
+  const std::string name = material.ToString();
+  if (!(material.Canonical() == material) || material.num_pieces() <= 2 ||
+      material.num_pieces() > kMaxTablebasePieces) {
+    std::cerr << "Can't generate a table for " << name << "\n";
+    return false;
+  }
+  for (const Material& m : material.Successors()) {
+    if (!tablebase.Has(m)) {
+      std::cerr << "Generating " << name << " needs " << m.ToString() << "\n";
+      return false;
+    }
+  }
+
+  Generator generator(material, tablebase);
+  if (!generator.Run()) {
+    return false;
+  }
+
+  Header header = {};
+  std::memcpy(header.magic, kMagic, sizeof(kMagic));
+  header.version = kVersion;
+  header.num_positions = generator.values().size();
+  // Zeroed above, so this keeps a terminating zero. Names of tables with up
+  // to kMaxTablebasePieces pieces fit with room to spare.
+  std::memcpy(header.material, name.data(),
+              std::min(name.size(), sizeof(header.material) - 1));
+  std::ofstream out(path, std::ios::binary);
+  out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+  out.write(reinterpret_cast<const char*>(generator.values().data()),
+            generator.values().size());
+  out.close();
+  if (!out) {
+    std::cerr << "Failed to write " << path << "\n";
+    return false;
+  }
+  return true;
+}
+
+}  // namespace chess
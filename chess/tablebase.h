@@ -0,0 +1,118 @@
+#ifndef _CHESS_TABLEBASE_H_
+#define _CHESS_TABLEBASE_H_
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "absl/container/flat_hash_map.h"
+#include "absl/strings/string_view.h"
+#include "absl/types/optional.h"
+#include "chess/board.h"
+#include "chess/types.h"
+
+namespace chess {
+
+// Largest number of pieces in a table, kings included.
+constexpr int kMaxTablebasePieces = 5;
+
+// The pieces of an endgame, like "KRPvKR" for king, rook and pawn against king
+// and rook. Both sides have exactly one king.
+struct Material {
+  // Non-king pieces of each color, strongest first.
+  std::vector<Piece> pieces[2];
+
+  // Parses names like "KRPvKR". Returns nullopt for invalid names.
+  static absl::optional<Material> FromString(absl::string_view name);
+  static Material FromBoard(const Board& b);
+
+  std::string ToString() const;
+  // Including kings.
+  int num_pieces() const { return 2 + pieces[0].size() + pieces[1].size(); }
+  bool has_pawns() const;
+  // The same pieces with colors swapped.
+  Material Flipped() const;
+  // Tables are only stored with the stronger side as white. This returns
+  // either this or Flipped().
+  Material Canonical() const;
+  // Canonical materials reached by one capture or promotion, other than bare
+  // kings. Their tables are needed for generating this one.
+  std::vector<Material> Successors() const;
+
+  bool operator==(const Material& o) const {
+    return pieces[0] == o.pieces[0] && pieces[1] == o.pieces[1];
+  }
+};
+
+// Result of a position for the player to move, with perfect play from both
+// sides. The 50-move rule is ignored.
+struct TablebaseResult {
+  // 1 for a win, 0 for a draw and -1 for a loss, like generic::Board::result().
+  int wdl = 0;
+  // Plies until mate: odd for wins and even for losses, 0 if the player to
+  // move is already checkmated. Zero for draws.
+  int dtm = 0;
+};
+
+// Endgame tables, with the result of every position of their materials. The
+// tables are files of one byte per position, generated by GenerateTable() and
+// memory-mapped when opened, so that probing doesn't load them in full.
+//
+// Tables don't cover castling, and have no en passant squares: boards where
+// an en passant capture is possible are probed by searching their moves.
+//
+// This class is thread-safe.
+class Tablebase {
+ public:
+  // Without any tables. Boards with only the kings are still covered.
+  Tablebase();
+  ~Tablebase();
+
+  // Opens all tables ("*.tb" files) in 'dir'. Invalid files are skipped with
+  // a warning.
+  static std::unique_ptr<Tablebase> Open(const std::string& dir);
+
+  // Adds the table in file 'path'. Returns false if it's not a valid table.
+  // Must not be called concurrently with probes.
+  bool AddTable(const std::string& path);
+
+  // Whether there is a table for 'm', or for m.Flipped().
+  bool Has(const Material& m) const;
+  // Largest number of pieces in any of the tables.
+  int max_pieces() const { return max_pieces_; }
+
+  // Result of 'b', or nullopt if it's not covered. Cheap for boards with
+  // more pieces than max_pieces().
+  absl::optional<TablebaseResult> Probe(const Board& b) const;
+
+  // The moves of 'b' which keep its result: the fastest mates when winning,
+  // the slowest ones when losing, and all drawing moves otherwise. Empty if
+  // 'b' is not covered, or has no moves.
+  std::vector<Move> BestMoves(const Board& b) const;
+
+ private:
+  struct Table;
+
+  // Result of 'b' from the results of its moves, or nullopt if some of them
+  // are not covered.
+  absl::optional<TablebaseResult> ProbeMoves(const Board& b) const;
+
+  // Indexed by the canonical material name.
+  absl::flat_hash_map<std::string, std::unique_ptr<Table>> tables_;
+  int max_pieces_ = 2;
+};
+
+// Generates the table for 'material', which must be canonical, and writes it
+// to 'path'. Results after captures and promotions are read from
+// 'tablebase', which must have all material.Successors(). Returns false on
+// failure.
+//
+// Generation works backwards from the checkmates (retrograde analysis), and
+// takes about three bytes of memory per position of the table: a few
+// megabytes for four pieces, and up to 2.5 GB for five pieces with pawns.
+bool GenerateTable(const Material& material, const Tablebase& tablebase,
+                   const std::string& path);
+
+}  // namespace chess
+
+#endif
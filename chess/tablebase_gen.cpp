@@ -0,0 +1,69 @@
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "absl/flags/flag.h"
+#include "absl/flags/parse.h"
+#include "absl/time/clock.h"
+#include "absl/time/time.h"
+#include "chess/tablebase.h"
+
+ABSL_FLAG(std::string, dir, ".",
+          "Directory for the tables. Tables already there are reused.");
+
+namespace chess {
+namespace {
+
+// Generates the table for 'm' into 'tablebase', and first the tables it
+// depends on.
+bool Generate(const Material& m, const std::string& dir,
+              Tablebase* tablebase) {
+  if (tablebase->Has(m)) {
+    return true;
+  }
+  for (const Material& successor : m.Successors()) {
+    if (!Generate(successor, dir, tablebase)) {
+      return false;
+    }
+  }
+  const std::string path = dir + "/" + m.ToString() + ".tb";
+  std::cout << "Generating " << m.ToString() << "..." << std::endl;
+  const absl::Time start = absl::Now();
+  if (!GenerateTable(m, *tablebase, path)) {
+    return false;
+  }
+  std::cout << "Wrote " << path << " in " << absl::Now() - start << "\n";
+  return tablebase->AddTable(path);
+}
+
+}  // namespace
+}  // namespace chess
+
+int main(int argc, char** argv) {
+  const std::vector<char*> args = absl::ParseCommandLine(argc, argv);
+  if (args.size() <= 1) {
+    std::cerr << "Usage: " << args[0] << " [--dir=DIR] material...\n"
+              << "Materials are like KRvK or KRPvKR, with at most "
+              << chess::kMaxTablebasePieces << " pieces.\n";
+    return 1;
+  }
+  const std::string dir = absl::GetFlag(FLAGS_dir);
+  auto tablebase = chess::Tablebase::Open(dir);
+  for (size_t i = 1; i < args.size(); ++i) {
+    const auto material = chess::Material::FromString(args[i]);
+    if (!material.has_value() ||
+        material->num_pieces() > chess::kMaxTablebasePieces) {
+      std::cerr << "Invalid material: " << args[i] << "\n";
+      return 1;
+    }
+    if (material->num_pieces() == 2) {
+      // Bare kings are always covered.
+      continue;
+    }
+    if (!chess::Generate(material->Canonical(), dir, tablebase.get())) {
+      return 1;
+    }
+  }
+  return 0;
+}
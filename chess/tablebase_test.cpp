@@ -0,0 +1,319 @@
+#include "chess/tablebase.h"
+
+#include <cstdlib>
+#include <random>
+#include <string>
+
+#include "chess/movegen.h"
+#include "chess/square.h"
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+namespace chess {
+namespace {
+
+using ::testing::ElementsAre;
+using ::testing::UnorderedElementsAre;
+
+std::string TablePath(const std::string& name) {
+  const char* dir = getenv("TEST_TMPDIR");
+  return std::string(dir != nullptr ? dir : "/tmp") + "/tablebase_test_" +
+         name + ".tb";
+}
+
+// Generates the table for 'm' into 'tablebase', and first the tables it
+// depends on.
+bool GenerateWithSuccessors(const Material& m, Tablebase* tablebase) {
+  if (tablebase->Has(m)) {
+    return true;
+  }
+  for (const Material& successor : m.Successors()) {
+    if (!GenerateWithSuccessors(successor, tablebase)) {
+      return false;
+    }
+  }
+  const std::string path = TablePath(m.ToString());
+  return GenerateTable(m, *tablebase, path) && tablebase->AddTable(path);
+}
+
+// Checks that 'r', the result of 'b', agrees with a one-ply search over the
+// results of its moves.
+void CheckConsistent(const Tablebase& tablebase, const Board& b,
+                     const TablebaseResult& r) {
+  int best = -2;
+  int dtm = 0;
+  const MovegenResult res = IterateLegalMoves(b, [&](const Move& m) {
+    const auto child = tablebase.Probe(Board(b, m));
+    ASSERT_TRUE(child.has_value()) << b.ToFEN() << " " << m;
+    const int v = -child->wdl;
+    const int d = child->dtm + 1;
+    if (v > best) {
+      best = v;
+      dtm = d;
+    } else if (v == best && v > 0) {
+      dtm = std::min(dtm, d);
+    } else if (v == best && v < 0) {
+      dtm = std::max(dtm, d);
+    }
+  });
+  if (res == MovegenResult::kCheckmate) {
+    best = -1;
+  } else if (res == MovegenResult::kStalemate) {
+    best = 0;
+  }
+  ASSERT_EQ(r.wdl, best) << b.ToFEN();
+  if (best != 0) {
+    ASSERT_EQ(r.dtm, dtm) << b.ToFEN();
+  }
+}
+
+// Whether some move of 'b' lets the opponent capture en passant.
+bool AllowsEnPassant(const Board& b) {
+  bool found = false;
+  IterateLegalMoves(b, [&](const Move& m) {
+    IterateLegalMoves(Board(b, m), [&](const Move& reply) {
+      found |= reply.type == Move::Type::kEnPassant;
+    });
+  });
+  return found;
+}
+
+class TablebaseTest : public ::testing::Test {
+ protected:
+  // Generating these takes a few seconds, so they're shared by all tests.
+  static void SetUpTestSuite() {
+    tablebase_ = new Tablebase();
+    for (const char* name : {"KQvK", "KRvK", "KBvK", "KNvK", "KPvK"}) {
+      const std::string path = TablePath(name);
+      ASSERT_TRUE(GenerateTable(*Material::FromString(name), *tablebase_,
+                                path));
+      ASSERT_TRUE(tablebase_->AddTable(path));
+    }
+  }
+
+  static void TearDownTestSuite() {
+    delete tablebase_;
+    tablebase_ = nullptr;
+  }
+
+  static TablebaseResult Probe(absl::string_view fen) {
+    const auto r = tablebase_->Probe(Board(fen));
+    EXPECT_TRUE(r.has_value()) << fen;
+    return r.value_or(TablebaseResult());
+  }
+
+  // Longest mate with 'piece' against a bare king, with white to move.
+  static int LongestMate(Piece piece) {
+    int longest = -1;
+    for (int wk = 0; wk < 64; ++wk) {
+      for (int p = 0; p < 64; ++p) {
+        for (int bk = 0; bk < 64; ++bk) {
+          if (wk == p || p == bk || wk == bk) {
+            continue;
+          }
+          PieceColor arr[64] = {};
+          arr[wk] = {Piece::kKing, Color::kWhite};
+          arr[p] = {piece, Color::kWhite};
+          arr[bk] = {Piece::kKing, Color::kBlack};
+          const auto r = tablebase_->Probe(Board(arr));
+          if (r.has_value()) {
+            EXPECT_GE(r->wdl, 0);
+            longest = std::max(longest, r->dtm);
+          }
+        }
+      }
+    }
+    return longest;
+  }
+
+  static Tablebase* tablebase_;
+};
+
+Tablebase* TablebaseTest::tablebase_ = nullptr;
+
+TEST(MaterialTest, Names) {
+  const auto m = Material::FromString("KPRvKN");
+  ASSERT_TRUE(m.has_value());
+  EXPECT_THAT(m->pieces[0], ElementsAre(Piece::kRook, Piece::kPawn));
+  EXPECT_EQ(m->ToString(), "KRPvKN");
+  EXPECT_EQ(m->num_pieces(), 5);
+  EXPECT_TRUE(m->has_pawns());
+  EXPECT_EQ(m->Flipped().ToString(), "KNvKRP");
+  EXPECT_EQ(m->Flipped().Canonical().ToString(), "KRPvKN");
+  EXPECT_FALSE(Material::FromString("KRK").has_value());
+  EXPECT_FALSE(Material::FromString("KXvK").has_value());
+  EXPECT_FALSE(Material::FromString("RvK").has_value());
+  EXPECT_EQ(Material::FromBoard(Board("8/8/1k6/8/8/8/8/3KR3 w - - 0 1"))
+                .ToString(),
+            "KRvK");
+}
+
+TEST(MaterialTest, Successors) {
+  std::vector<std::string> names;
+  for (const Material& m : Material::FromString("KPvK")->Successors()) {
+    names.push_back(m.ToString());
+  }
+  EXPECT_THAT(names, UnorderedElementsAre("KQvK", "KRvK", "KBvK", "KNvK"));
+  names.clear();
+  for (const Material& m : Material::FromString("KRvKP")->Successors()) {
+    names.push_back(m.ToString());
+  }
+  // Captures, promotions of the black pawn, and both at once.
+  EXPECT_THAT(names, UnorderedElementsAre("KPvK", "KRvK", "KQvKR", "KRvKR",
+                                          "KRvKB", "KRvKN", "KQvK", "KBvK",
+                                          "KNvK"));
+}
+
+TEST_F(TablebaseTest, LongestMates) {
+  // Well known: 10 moves with a queen and 16 with a rook.
+  EXPECT_EQ(LongestMate(Piece::kQueen), 19);
+  EXPECT_EQ(LongestMate(Piece::kRook), 31);
+  EXPECT_EQ(LongestMate(Piece::kKnight), 0);
+}
+
+TEST_F(TablebaseTest, Results) {
+  // Mate in one, either way around.
+  EXPECT_EQ(Probe("k7/8/1K6/8/8/8/8/7R w - - 0 1").dtm, 1);
+  EXPECT_EQ(Probe("7r/8/8/8/8/1k6/8/K7 b - - 0 1").dtm, 1);
+  EXPECT_EQ(Probe("7r/8/8/8/8/1k6/8/K7 b - - 0 1").wdl, 1);
+  // Checkmated.
+  EXPECT_EQ(Probe("R1k5/8/2K5/8/8/8/8/8 b - - 0 1").wdl, -1);
+  EXPECT_EQ(Probe("R1k5/8/2K5/8/8/8/8/8 b - - 0 1").dtm, 0);
+  // Stalemate.
+  EXPECT_EQ(Probe("k7/2Q5/1K6/8/8/8/8/8 b - - 0 1").wdl, 0);
+  // King on the sixth rank in front of the pawn wins, the rook pawn doesn't.
+  EXPECT_EQ(Probe("4k3/8/4K3/4P3/8/8/8/8 w - - 0 1").wdl, 1);
+  EXPECT_EQ(Probe("4k3/8/4K3/4P3/8/8/8/8 b - - 0 1").wdl, -1);
+  EXPECT_EQ(Probe("k7/8/K7/P7/8/8/8/8 w - - 0 1").wdl, 0);
+  // Bare kings, without a table.
+  EXPECT_EQ(Probe("k7/8/8/8/8/8/8/7K w - - 0 1").wdl, 0);
+}
+
+TEST_F(TablebaseTest, NotCovered) {
+  // Too many pieces, no table, castling.
+  EXPECT_FALSE(tablebase_->Probe(Board()).has_value());
+  EXPECT_FALSE(
+      tablebase_->Probe(Board("k7/8/8/8/8/8/8/RR5K w - - 0 1")).has_value());
+  EXPECT_FALSE(
+      tablebase_->Probe(Board("k7/8/8/8/8/8/8/R3K3 w Q - 0 1")).has_value());
+}
+
+TEST_F(TablebaseTest, BestMoves) {
+  const Board mate_in_one("k7/8/1K6/8/8/8/8/7R w - - 0 1");
+  std::vector<std::string> moves;
+  for (const Move& m : tablebase_->BestMoves(mate_in_one)) {
+    moves.push_back(m.ToString());
+  }
+  EXPECT_THAT(moves, ElementsAre("h1h8"));
+
+  // Following the best moves from a long mate ends in a mate on time.
+  Board b("8/8/3k4/8/8/8/8/R6K w - - 0 1");
+  const int dtm = Probe(b.ToFEN()).dtm;
+  for (int ply = 0; ply < dtm; ++ply) {
+    const std::vector<Move> best = tablebase_->BestMoves(b);
+    ASSERT_FALSE(best.empty()) << b.ToFEN();
+    b = Board(b, best[0]);
+  }
+  MovegenResult res;
+  CountLegalMoves(b, &res);
+  EXPECT_EQ(res, MovegenResult::kCheckmate) << b.ToFEN();
+}
+
+// The tables agree with a one-ply search over their own results.
+TEST_F(TablebaseTest, ConsistentWithChildren) {
+  std::mt19937 rand(1);
+  int checked = 0;
+  while (checked < 20000) {
+    PieceColor arr[64] = {};
+    const int wk = rand() % 64;
+    const int bk = rand() % 64;
+    const int other = rand() % 64;
+    const Piece piece = Piece(rand() % 5);
+    if (wk == bk || wk == other || bk == other ||
+        (piece == Piece::kPawn && (other < 8 || other >= 56))) {
+      continue;
+    }
+    arr[wk] = {Piece::kKing, Color::kWhite};
+    arr[bk] = {Piece::kKing, Color::kBlack};
+    arr[other] = {piece, Color(rand() % 2)};
+    const Board b(arr, Color(rand() % 2));
+    const auto r = tablebase_->Probe(b);
+    if (!r.has_value()) {
+      continue;
+    }
+    ++checked;
+    ASSERT_NO_FATAL_FAILURE(CheckConsistent(*tablebase_, b, *r));
+  }
+}
+
+// KPvKP needs all four-piece tables with a queen, rook, bishop or knight
+// against a piece or pawn. Generating them takes minutes, so this is a
+// separate test target.
+class TablebasePawnsTest : public ::testing::Test {
+ protected:
+  static void SetUpTestSuite() {
+    tablebase_ = new Tablebase();
+    ASSERT_TRUE(
+        GenerateWithSuccessors(*Material::FromString("KPvKP"), tablebase_));
+  }
+
+  static void TearDownTestSuite() {
+    delete tablebase_;
+    tablebase_ = nullptr;
+  }
+
+  static Tablebase* tablebase_;
+};
+
+Tablebase* TablebasePawnsTest::tablebase_ = nullptr;
+
+// As TablebaseTest.ConsistentWithChildren, and half of the positions have a
+// double pawn push which allows an en passant capture. Those results depend
+// on the en passant positions, which the tables don't have.
+TEST_F(TablebasePawnsTest, ConsistentWithChildren) {
+  std::mt19937 rand(1);
+  int checked = 0;
+  int en_passant = 0;
+  while (checked < 20000) {
+    const Color turn = Color(rand() % 2);
+    const int wk = rand() % 64;
+    const int bk = rand() % 64;
+    int wp = 8 + rand() % 48;
+    int bp = 8 + rand() % 48;
+    if (rand() % 2 == 0) {
+      // A pawn of the player to move on its starting square, and an enemy
+      // pawn on an adjacent file where it can capture a double push.
+      const int file = rand() % 8;
+      const int adjacent =
+          file == 0 || (file < 7 && rand() % 2 == 0) ? file + 1 : file - 1;
+      if (turn == Color::kWhite) {
+        wp = MakeSquare(1, file);
+        bp = MakeSquare(3, adjacent);
+      } else {
+        bp = MakeSquare(6, file);
+        wp = MakeSquare(4, adjacent);
+      }
+    }
+    if (wk == bk || wk == wp || wk == bp || bk == wp || bk == bp ||
+        wp == bp) {
+      continue;
+    }
+    PieceColor arr[64] = {};
+    arr[wk] = {Piece::kKing, Color::kWhite};
+    arr[bk] = {Piece::kKing, Color::kBlack};
+    arr[wp] = {Piece::kPawn, Color::kWhite};
+    arr[bp] = {Piece::kPawn, Color::kBlack};
+    const Board b(arr, turn);
+    const auto r = tablebase_->Probe(b);
+    if (!r.has_value()) {
+      continue;
+    }
+    ++checked;
+    en_passant += AllowsEnPassant(b);
+    ASSERT_NO_FATAL_FAILURE(CheckConsistent(*tablebase_, b, *r));
+  }
+  EXPECT_GT(en_passant, 1000);
+}
+
+}  // namespace
+}  // namespace chess
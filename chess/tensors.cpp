@@ -1,7 +1,5 @@
 #include "chess/tensors.h"
 
-#include <functional>
-
 #include "chess/bitboard.h"
 #include "tensorflow/core/platform/logging.h"
 
@@ -18,51 +16,7 @@ int FlippedSquare(int x) {
   return r * 8 + f;
 }
 
-void SetBitBoard(uint64_t bb, bool flip, ::tensorflow::Tensor* tensor) {
-  for (int i = 0; i < 64; ++i) {
-    int ind = flip ? FlippedSquare(i) : i;
-    bool set = BitIsSet(bb, ind);
-    tensor->flat<float>()(i) = set ? 1.0 : 0.0;
-  }
-}
-
-struct BitboardLayer {
-  BitboardLayer(bool my, Piece p) : my_(my), p_(p) {}
-
-  void operator()(const Board& b, tensorflow::Tensor* tensor) const {
-    const Color c = my_ ? b.turn() : OtherColor(b.turn());
-    SetBitBoard(b.bitboard(c, p_),
-                /*flip=*/b.turn() == Color::kBlack, tensor);
-  }
-
-  bool my_;
-  Piece p_;
-};
-
-using LayerFunc = std::function<void(const Board&, tensorflow::Tensor*)>;
-
-const LayerFunc layers[] = {
-    BitboardLayer(true, Piece::kPawn),
-    BitboardLayer(true, Piece::kKnight),
-    BitboardLayer(true, Piece::kBishop),
-    BitboardLayer(true, Piece::kRook),
-    BitboardLayer(true, Piece::kQueen),
-    BitboardLayer(true, Piece::kKing),
-    BitboardLayer(false, Piece::kPawn),
-    BitboardLayer(false, Piece::kKnight),
-    BitboardLayer(false, Piece::kBishop),
-    BitboardLayer(false, Piece::kRook),
-    BitboardLayer(false, Piece::kQueen),
-    BitboardLayer(false, Piece::kKing),
-    [](const Board& b, tensorflow::Tensor* tensor) {
-      SetBitBoard(b.en_passant(), b.turn() == Color::kBlack, tensor);
-    },
-    [](const Board& b, tensorflow::Tensor* tensor) {
-      SetBitBoard(b.castling_rights(), b.turn() == Color::kBlack, tensor);
-    },
-};
-
-static_assert(sizeof(layers) / sizeof(layers[0]) == kBoardTensorNumLayers,
+static_assert(kBoardTensorNumLayers == 14,
               "Update build_graph.py if this number changes");
 
 // Move encoding is very similar to Leela Chess.  Moves are encoded as 64 *
@@ -214,10 +168,20 @@ void BoardToTensor(const Board& b, tensorflow::Tensor tensor) {
   CHECK_EQ(tensor.dims(), 2);
   CHECK_EQ(tensor.dim_size(0), kBoardTensorNumLayers);
   CHECK_EQ(tensor.dim_size(1), 64);
-  for (int layer = 0; layer < kBoardTensorNumLayers; ++layer) {
-    auto slice = tensor.SubSlice(layer);
-    layers[layer](b, &slice);
-  }
+  const Board* boards[] = {&b};
+  // Slices are not necessarily aligned.
+  EncodeBoards(boards, 1, tensor.unaligned_flat<float>().data());
+}
+
+void BoardsToTensor(const Board* const* boards, int n,
+                    tensorflow::Tensor* tensor, int offset) {
+  CHECK_EQ(tensor->dims(), 3);
+  CHECK_LE(offset + n, tensor->dim_size(0));
+  CHECK_EQ(tensor->dim_size(1), kBoardTensorNumLayers);
+  CHECK_EQ(tensor->dim_size(2), 64);
+  EncodeBoards(boards, n,
+               tensor->flat<float>().data() +
+                   int64_t{offset} * kBoardTensorNumLayers * 64);
 }
 
 double MovePriorFromTensor(const tensorflow::Tensor& tensor, Color turn,
@@ -3,12 +3,12 @@
 #define _CHESS_TENSORS_H_
 
 #include "chess/board.h"
+#include "chess/board_planes.h"
 #include "tensorflow/core/framework/tensor.h"
 
 namespace chess {
 
 extern const int kMoveVectorSize;
-inline constexpr int kBoardTensorNumLayers = 14;
 // Returns an unset tensor of the shape to hold 'batch_size' input boards.
 tensorflow::Tensor MakeBoardTensor(int batch_size);
 tensorflow::Tensor MakeMoveTensor(int batch_size);
@@ -16,6 +16,11 @@ tensorflow::Tensor MakeMoveTensor(int batch_size);
 // Writes board state to tensor.
 void BoardToTensor(const Board& b, tensorflow::Tensor tensor);
 
+// Writes 'n' boards to entries [offset, offset + n) of a tensor made with
+// MakeBoardTensor().
+void BoardsToTensor(const Board* const* boards, int n,
+                    tensorflow::Tensor* tensor, int offset);
+
 int EncodeMove(Color turn, Move m);
 Move DecodeMove(const Board& b, int encoded);
 
@@ -1,16 +1,30 @@
+#include <algorithm>
+#include <atomic>
+#include <cmath>
 #include <iostream>
+#include <memory>
 #include <string>
+#include <thread>
+#include <vector>
 
 #include "absl/strings/match.h"
+#include "absl/strings/numbers.h"
 #include "absl/strings/str_cat.h"
 #include "absl/strings/str_join.h"
 #include "absl/strings/str_split.h"
+#include "absl/synchronization/mutex.h"
+#include "absl/time/clock.h"
+#include "absl/time/time.h"
 #include "absl/types/optional.h"
 #include "chess/board.h"
-#include "chess/model.h"
-#include "chess/player.h"
+#include "chess/mcts.h"
+#include "chess/model_collection.h"
+#include "chess/movegen.h"
 #include "chess/prediction_queue.h"
+#include "chess/tablebase.h"
 #include "chess/types.h"
+#include "generic/model.h"
+#include "generic/search_controller.h"
 #include "tensorflow/core/platform/env.h"
 #include "tensorflow/core/platform/init_main.h"
 #include "tensorflow/core/platform/logging.h"
@@ -18,28 +32,130 @@
 namespace chess {
 namespace {
 
-constexpr absl::string_view kName = "PolicyBot";
+constexpr absl::string_view kName = "MCTSBot";
 constexpr absl::string_view kAuthor = "Aleksi Hartikainen";
 
+// Iterations started at once and sent to the prediction queue as one batch.
+constexpr int kBatchSize = 8;
+// Limit for the search tree, about 500 MB with 35 moves per position.
+constexpr size_t kMaxStates = 750000;
+// How often "info" is sent during a search.
+constexpr absl::Duration kInfoInterval = absl::Seconds(1);
+// Search time for "go" without any supported limit, like "go depth 5" or
+// "go mate 3": MCTS has no fixed depth to stop at.
+constexpr absl::Duration kDefaultMoveTime = absl::Seconds(5);
+// Endgame tables, generated with tablebase_gen. The search works without
+// them if the directory is missing.
+constexpr char kTablebaseDir[] = "/mnt/tensor-data/chess-tablebases";
+
 void FailWith(absl::string_view error) {
   std::cerr << error << "\n";
   std::cerr << "Exiting\n";
   abort();
 }
 
-class BotThread {
+// Output comes from both the main thread and the search thread.
+absl::Mutex output_mu;
+
+void Send(absl::string_view line) {
+  absl::MutexLock lock(&output_mu);
+  std::cout << line << std::endl;
+}
+
+// Maps an expected result in [-1, 1] to centipawns for display. The scale is
+// arbitrary, but 0.5 maps to about one pawn.
+int ValueToCentipawns(double v) {
+  v = std::max(-0.999, std::min(0.999, v));
+  return std::lround(100 * std::tan(1.5637541897 * v));
+}
+
+std::string MovesToString(const std::vector<Move>& moves) {
+  return absl::StrJoin(moves, " ", [](std::string* out, const Move& m) {
+    out->append(m.ToString());
+  });
+}
+
+struct GoCommand {
+  generic::SearchLimits limits;
+  // Search until "stop" (or "ponderhit", if pondering).
+  bool infinite = false;
+  bool ponder = false;
+};
+
+GoCommand ParseGo(const std::vector<std::string>& components, Color turn) {
+  GoCommand go;
+  const bool white = turn == Color::kWhite;
+  bool has_limit = false;
+  for (int i = 1; i < components.size(); ++i) {
+    const std::string& c = components[i];
+    if (c == "infinite") {
+      go.infinite = true;
+      continue;
+    }
+    if (c == "ponder") {
+      go.ponder = true;
+      continue;
+    }
+    int64_t value;
+    if (i + 1 == components.size() ||
+        !absl::SimpleAtoi(components[i + 1], &value)) {
+      // Unsupported, like "searchmoves" and its moves.
+      continue;
+    }
+    ++i;
+    if (c == "movetime") {
+      go.limits.move_time = absl::Milliseconds(value);
+    } else if (c == "nodes") {
+      go.limits.iterations = value;
+    } else if (c == "movestogo") {
+      go.limits.moves_to_go = value;
+      continue;
+    } else if (c == (white ? "wtime" : "btime")) {
+      go.limits.time_left = absl::Milliseconds(value);
+    } else if (c == (white ? "winc" : "binc")) {
+      go.limits.increment = absl::Milliseconds(value);
+      continue;
+    } else {
+      // Unsupported, like "depth" and "mate".
+      continue;
+    }
+    has_limit = true;
+  }
+  if (!has_limit && !go.infinite) {
+    go.limits.move_time = kDefaultMoveTime;
+  }
+  return go;
+}
+
+// Searches with MCTS on a background thread, so that "stop" and "ponderhit"
+// take effect during the search. It's helped by a thread per core, all
+// sharing the tree, and their batches are merged by the prediction queue.
+// The tree is kept as long as new positions continue the previous one.
+class Engine {
  public:
-  BotThread() {
+  Engine() {
     CHECK(model_ != nullptr);
-    player_ = std::make_unique<PolicyNetworkPlayer>(&pq_);
+    mcts_.set_max_states(kMaxStates);
+    // Noise is for self-play only.
+    mcts_.SetRootNoise(0.3, 0.0);
+    mcts_.set_tablebase(tablebase_.get());
+  }
+  ~Engine() { Stop(); }
+
+  void NewGame() {
+    Stop();
+    start_ = Board();
+    moves_.clear();
+    mcts_.SetBoard(start_);
   }
-  void NewGame() {}
 
   void SetPosition(const std::vector<std::string>& components) {
-    Board pos;
+    Stop();
+    Board start;
+    std::vector<Move> moves;
     for (int i = 1; i < components.size(); ++i) {
       const std::string& c = components[i];
-      if (c == "position" || c == "startpos") {
+      if (c == "position" || c == "startpos" || c == "moves") {
         continue;
       } else if (c == "fen") {
         // Start fen parsing.
@@ -50,32 +166,209 @@ class BotThread {
             break;
           }
         }
-        pos = Board(absl::StrJoin(components.begin() + i + 1,
-                                  components.begin() + end, " "));
+        start = Board(absl::StrJoin(components.begin() + i + 1,
+                                    components.begin() + end, " "));
         i = end;
       } else if (c.size() <= 5) {
         if (absl::optional<Move> m = Move::FromString(c)) {
-          pos = Board(pos, *m);
+          moves.push_back(*m);
         } else {
           FailWith("Invalid move string");
         }
       } else {
         // Assume FEN string.
-        pos = Board(c);
+        start = Board(c);
       }
     }
-    std::cerr << "Interpreted board:\n" << pos.ToPrintString() << "\n";
-    std::cerr << pos.ToFEN() << "\n";
-    player_->Reset(pos);
+    const bool continues = start.ToFEN() == start_.ToFEN() &&
+                           moves.size() >= moves_.size() &&
+                           std::equal(moves_.begin(), moves_.end(),
+                                      moves.begin());
+    if (!continues) {
+      start_ = start;
+      moves_.clear();
+      mcts_.SetBoard(start_);
+    }
+    for (size_t i = moves_.size(); i < moves.size(); ++i) {
+      mcts_.MakeMove(moves[i]);
+    }
+    moves_ = std::move(moves);
+    std::cerr << "Interpreted board:\n"
+              << mcts_.current_board().ToPrintString() << "\n";
+    std::cerr << mcts_.current_board().ToFEN() << "\n";
   }
 
-  Move GetBestMove() const { return player_->GetMove(); }
+  void Go(const std::vector<std::string>& components) {
+    Stop();
+    const absl::Time start = absl::Now();
+    const Board& board = mcts_.current_board();
+    if (IterateLegalMoves(board, [](const Move&) {}) !=
+        MovegenResult::kNotOver) {
+      Send("bestmove 0000");
+      return;
+    }
+    const GoCommand go = ParseGo(components, board.turn());
+    {
+      absl::MutexLock lock(&mu_);
+      limits_ = go.limits;
+      limits_start_ = start;
+      infinite_ = go.infinite;
+      pondering_ = go.ponder;
+    }
+    stop_.store(false);
+    search_thread_ = std::thread([this, start] { Search(start); });
+  }
+
+  // The opponent played the expected move: continue with the clock running.
+  void PonderHit() {
+    absl::MutexLock lock(&mu_);
+    pondering_ = false;
+    limits_start_ = absl::Now();
+  }
+
+  // Stops the search, if any. The search thread sends "bestmove".
+  void Stop() {
+    if (search_thread_.joinable()) {
+      stop_.store(true);
+      search_thread_.join();
+    }
+  }
 
  private:
-  std::unique_ptr<Model> model_ = CreateDefaultModel(/*allow_init=*/false);
+  // Runs up to kBatchSize iterations as one batch. Returns false if none
+  // needed a prediction. Thread-safe.
+  bool RunBatch() {
+    std::vector<std::unique_ptr<MCTS::PredictionRequest>> requests;
+    for (int i = 0; i < kBatchSize; ++i) {
+      auto req = mcts_.StartIteration();
+      if (req != nullptr) {
+        requests.push_back(std::move(req));
+      }
+    }
+    if (requests.empty()) {
+      return false;
+    }
+    PredictionQueue::Request batch[kBatchSize];
+    for (int i = 0; i < requests.size(); ++i) {
+      batch[i].board = &requests[i]->board();
+      batch[i].moves = &requests[i]->moves();
+    }
+    pq_.GetPredictions(batch, requests.size());
+    for (int i = 0; i < requests.size(); ++i) {
+      mcts_.FinishIteration(std::move(requests[i]), batch[i].result);
+    }
+    return true;
+  }
+
+  // Runs on the search thread.
+  void Search(absl::Time start) {
+    const int start_iterations = mcts_.num_iterations();
+    std::atomic<bool> done{false};
+    std::vector<std::thread> helpers;
+    for (int i = 1; i < num_threads_; ++i) {
+      helpers.emplace_back([this, &done] {
+        while (!done.load(std::memory_order_relaxed)) {
+          if (!RunBatch()) {
+            // Solved, or waiting for other threads to finish their batches.
+            absl::SleepFor(absl::Milliseconds(1));
+          }
+        }
+      });
+    }
+    absl::optional<generic::SearchController> controller;
+    int controller_iterations = 0;
+    std::vector<int> visits;
+    absl::Time last_info = start;
+    while (true) {
+      RunBatch();
+
+      if (stop_.load(std::memory_order_relaxed)) {
+        break;
+      }
+      if (mcts_.root_proof() != MCTS::Proof::kUnknown) {
+        // Solved, more search can't change the move. While pondering or
+        // searching "infinite", "bestmove" still has to wait for the GUI.
+        bool wait;
+        {
+          absl::MutexLock lock(&mu_);
+          wait = infinite_ || pondering_;
+        }
+        if (!wait) {
+          break;
+        }
+        absl::SleepFor(absl::Milliseconds(10));
+        continue;
+      }
+      if (!controller.has_value()) {
+        // Starts counting once the limits apply, i.e. after "ponderhit".
+        absl::MutexLock lock(&mu_);
+        if (!infinite_ && !pondering_) {
+          controller.emplace(limits_, limits_start_);
+          controller_iterations = mcts_.num_iterations();
+        }
+      }
+      const absl::Time now = absl::Now();
+      if (controller.has_value()) {
+        mcts_.GetRootVisits(&visits);
+        if (controller->ShouldStop(
+                visits, mcts_.num_iterations() - controller_iterations, now)) {
+          break;
+        }
+      }
+      if (now - last_info >= kInfoInterval) {
+        SendInfo(start, start_iterations);
+        last_info = now;
+      }
+    }
+    done.store(true);
+    for (auto& t : helpers) {
+      t.join();
+    }
+
+    SendInfo(start, start_iterations);
+    const std::vector<Move> pv = mcts_.GetPrincipalVariation(2);
+    CHECK(!pv.empty());
+    if (pv.size() > 1) {
+      Send(absl::StrCat("bestmove ", pv[0].ToString(), " ponder ",
+                        pv[1].ToString()));
+    } else {
+      Send(absl::StrCat("bestmove ", pv[0].ToString()));
+    }
+  }
+
+  void SendInfo(absl::Time start, int start_iterations) {
+    const PredictionResult pred = mcts_.GetPrediction();
+    const std::vector<Move> pv = mcts_.GetPrincipalVariation();
+    const int64_t nodes = mcts_.num_iterations() - start_iterations;
+    const int64_t ms = absl::ToInt64Milliseconds(absl::Now() - start);
+    const int64_t nps = ms > 0 ? nodes * 1000 / ms : 0;
+    Send(absl::StrCat("info depth ", pv.size(), " nodes ", nodes, " nps ", nps,
+                      " time ", ms, " score cp ",
+                      ValueToCentipawns(pred.value), " pv ",
+                      MovesToString(pv)));
+  }
+
+  std::unique_ptr<generic::Model> model_ = generic::Model::Open(
+      kModelPath, GetModelCollection()->CurrentCheckpointDir());
   PredictionQueue pq_{model_.get()};
-  std::unique_ptr<Player> player_;
-};  // namespace
+  const std::unique_ptr<Tablebase> tablebase_ = Tablebase::Open(kTablebaseDir);
+  // Position as last given by "position": a start board and moves from it.
+  Board start_;
+  std::vector<Move> moves_;
+  // Only used by the search threads while they're running.
+  MCTS mcts_{start_};
+  const int num_threads_ =
+      std::max(1, static_cast<int>(std::thread::hardware_concurrency()));
+
+  std::thread search_thread_;
+  std::atomic<bool> stop_{false};
+  absl::Mutex mu_;
+  generic::SearchLimits limits_ GUARDED_BY(mu_);
+  // When 'limits_' started to apply.
+  absl::Time limits_start_ GUARDED_BY(mu_);
+  bool infinite_ GUARDED_BY(mu_) = false;
+  bool pondering_ GUARDED_BY(mu_) = false;
+};
 
 void Go() {
   // First line should be "uci".
@@ -84,34 +377,41 @@ void Go() {
   if (uciline != "uci") {
     FailWith(absl::StrCat("Expected 'uci', got '", uciline, "'"));
   }
-  std::cout << "id name" << kName << "\n";
-  std::cout << "id author " << kAuthor << "\n";
+  Send(absl::StrCat("id name ", kName));
+  Send(absl::StrCat("id author ", kAuthor));
   // No supported options, they would be here.
-  std::cout << "uciok\n";
+  Send("uciok");
 
   std::cin >> uciline;
   if (uciline != "isready") {
     FailWith(absl::StrCat("Expected 'isready', got '", uciline, "'"));
   }
 
-  BotThread bot;
+  Engine engine;
 
-  std::cout << "readyok\n";
+  Send("readyok");
 
   while (std::getline(std::cin, uciline)) {
     std::cerr << "uciline: " << uciline << "\n";
-    const std::vector<std::string> components = absl::StrSplit(uciline, " ");
+    const std::vector<std::string> components =
+        absl::StrSplit(uciline, " ", absl::SkipEmpty());
+    if (components.empty()) {
+      continue;
+    }
     if (components[0] == "ucinewgame") {
-      bot.NewGame();
+      engine.NewGame();
     } else if (components[0] == "isready") {
-      std::cout << "readyok\n";
+      Send("readyok");
     } else if (components[0] == "position") {
-      bot.SetPosition(components);
+      engine.SetPosition(components);
     } else if (components[0] == "go") {
-      if (std::count(components.begin(), components.end(), "ponder")) {
-        continue;
-      }
-      std::cout << "bestmove " << bot.GetBestMove() << "\n";
+      engine.Go(components);
+    } else if (components[0] == "ponderhit") {
+      engine.PonderHit();
+    } else if (components[0] == "stop") {
+      engine.Stop();
+    } else if (components[0] == "quit") {
+      break;
     }
   }
 }
@@ -22,7 +22,8 @@ struct PredictionResult {
   double value = 0.0;
 };
 
-std::ostream& operator<<(std::ostream& out, const PredictionResult& res) {
+inline std::ostream& operator<<(std::ostream& out,
+                                const PredictionResult& res) {
   out << "{ ";
   for (auto& m : res.policy) {
     out << m.first << ":" << std::setprecision(3) << m.second << " ";
@@ -1,34 +1,78 @@
+#include <algorithm>
+#include <atomic>
 #include <cmath>
+#include <limits>
 
 #include "generic/mcts.h"
+#include "generic/puct.h"
 #include "tensorflow/core/platform/logging.h"
 
 namespace generic {
 
 namespace mcts {
 
-struct Action {
-  Action(int m, float p) : move(m), prior(p) {}
-  const int move;
-  // Prior don't change after construction.
-  const float prior;
+using Proof = MCTS::Proof;
 
-  int num_virtual = 0;
-  int num_taken = 0;
-  double total_value = 0;
-  std::shared_ptr<State> state;
+// Action statistics are stored as parallel arrays, so that PickAction() can
+// score all actions at once with SIMD. Search threads update the counts
+// concurrently. All accesses are relaxed: PickAction() only needs
+// approximately current values, and reads them with plain vector loads.
+static_assert(sizeof(std::atomic<int32_t>) == sizeof(int32_t) &&
+              std::atomic<int32_t>::is_always_lock_free);
+static_assert(sizeof(std::atomic<float>) == sizeof(float) &&
+              std::atomic<float>::is_always_lock_free);
 
-  void AddResult(double v);
-};
+Proof TerminalProof(const Board& b) {
+  if (!b.is_over()) {
+    return Proof::kUnknown;
+  }
+  const int result = b.result();
+  return result > 0 ? Proof::kWin : result < 0 ? Proof::kLoss : Proof::kDraw;
+}
+
+// Value of a proven state for the player to move.
+double ProofValue(Proof p) {
+  switch (p) {
+    case Proof::kWin:
+      return 1.0;
+    case Proof::kLoss:
+      return -1.0;
+    default:
+      return 0.0;
+  }
+}
 
+// Proof of a child state which gives 'p' to its parent.
+Proof ChildProofFor(Proof p) {
+  switch (p) {
+    case Proof::kWin:
+      return Proof::kLoss;
+    case Proof::kLoss:
+      return Proof::kWin;
+    default:
+      return p;
+  }
+}
+
+// Terminal states have no actions, and their value is the result.
 struct State {
-  State(std::unique_ptr<Board> b, const PredictionResult& p)
-      : board(std::move(b)) {
+  State(util::Arena* arena, std::unique_ptr<Board> b,
+        const PredictionResult& p)
+      : board(std::move(b)),
+        value(p.value),
+        proof(TerminalProof(*board)),
+        num_actions(p.policy.size()),
+        moves(arena->NewArray<int>(num_actions)),
+        priors(arena->NewArray<std::atomic<float>>(num_actions)),
+        num_taken(arena->NewArray<std::atomic<int32_t>>(num_actions)),
+        num_virtual(arena->NewArray<std::atomic<int32_t>>(num_actions)),
+        total_value(arena->NewArray<std::atomic<float>>(num_actions)),
+        children(arena->NewArray<std::atomic<State*>>(num_actions)) {
     // Give a positive prior to all moves, so that we still sometimes explore
     // them in case the prediction network gives a zero weight for the move.
-    actions.reserve(p.policy.size());
-    for (const auto& [move, prob] : p.policy) {
-      actions.emplace_back(move, prob);
+    for (int i = 0; i < num_actions; ++i) {
+      moves[i] = p.policy[i].first;
+      priors[i].store(p.policy[i].second, std::memory_order_relaxed);
     }
   }
   State(const State&) = delete;
@@ -40,16 +84,82 @@ struct State {
     return board->result();
   }
 
+  int NumTaken(int a) const {
+    return num_taken[a].load(std::memory_order_relaxed);
+  }
+  int NumVirtual(int a) const {
+    return num_virtual[a].load(std::memory_order_relaxed);
+  }
+  double TotalValue(int a) const {
+    return total_value[a].load(std::memory_order_relaxed);
+  }
+  State* Child(int a) const {
+    return children[a].load(std::memory_order_acquire);
+  }
+  Proof GetProof() const { return proof.load(std::memory_order_relaxed); }
+  void AddResult(int a, double v);
+
+  // Stops PickAction() from choosing 'a', e.g. once it's proven to lose.
+  void Exclude(int a) {
+    priors[a].store(-std::numeric_limits<float>::infinity(),
+                    std::memory_order_relaxed);
+  }
+
+  // Proof for this state given the proofs of its children.
+  Proof ComputeProof() const;
+
+  PuctStats puct_stats() const {
+    return {reinterpret_cast<const float*>(priors),
+            reinterpret_cast<const int32_t*>(num_taken),
+            reinterpret_cast<const int32_t*>(num_virtual),
+            reinterpret_cast<const float*>(total_value), num_actions};
+  }
+
   const std::unique_ptr<Board> board;
-  std::vector<Action> actions;
+  // Predicted value, for the player to move.
+  const float value;
+  // Only ever changes from kUnknown to a proven value.
+  std::atomic<Proof> proof;
+  const int num_actions;
+  // Moves don't change after construction. Priors only change when the
+  // action is excluded.
+  int* const moves;
+  std::atomic<float>* const priors;
+  std::atomic<int32_t>* const num_taken;
+  std::atomic<int32_t>* const num_virtual;
+  std::atomic<float>* const total_value;
+  // Allocated from the same arena as this state. Set only once, by the
+  // thread which expands the child.
+  std::atomic<State*>* const children;
 };
 
-void Action::AddResult(double v) {
-  num_taken += 1;
-  total_value += v;
+void State::AddResult(int a, double v) {
+  num_taken[a].fetch_add(1, std::memory_order_relaxed);
+  float total = total_value[a].load(std::memory_order_relaxed);
+  while (!total_value[a].compare_exchange_weak(total, total + v,
+                                               std::memory_order_relaxed)) {
+  }
   // mean_value = total_value / num_taken;
 }
 
+Proof State::ComputeProof() const {
+  bool all_proven = true;
+  bool any_draw = false;
+  for (int a = 0; a < num_actions; ++a) {
+    const State* child = Child(a);
+    const Proof p = child == nullptr ? Proof::kUnknown : child->GetProof();
+    if (p == Proof::kLoss) {
+      return Proof::kWin;
+    }
+    all_proven &= p != Proof::kUnknown;
+    any_draw |= p == Proof::kDraw;
+  }
+  if (!all_proven) {
+    return Proof::kUnknown;
+  }
+  return any_draw ? Proof::kDraw : Proof::kLoss;
+}
+
 // Important points from AlphaGo paper:
 //
 // To pick multiple nodes at once, use "virtual loss": Continue search as if
@@ -62,58 +172,37 @@ void Action::AddResult(double v) {
 
 namespace {
 
-using mcts::Action;
 using mcts::ActionRef;
+using mcts::ChildProofFor;
+using mcts::Proof;
+using mcts::ProofValue;
 using mcts::State;
 
-const double kPUCT = 1.0;
-
-Action* PickAction(std::mt19937& rand, State& s) {
-  static const double rand_add = 0.001;
-  std::uniform_real_distribution<double> rand_dist(0.0, rand_add);
-  int num_sum = 0;
-  for (const auto& a : s.actions) {
-    num_sum += a.num_taken + a.num_virtual;
-  }
-  const double num_sum_sqrt = sqrt(num_sum);
-
-  const auto score_move = [num_sum,
-                           num_sum_sqrt](const Action& action) -> double {
-    if (num_sum == 0) {
-      return action.prior;
-    } else {
-      const int num = action.num_taken + action.num_virtual;
-      // Reminder: virtual moves are counted as losses for both players.
-      double mean_value =
-          num == 0 ? 0 : (action.total_value - action.num_virtual) / num;
-      return mean_value + kPUCT * action.prior * num_sum_sqrt / (1.0 + num);
-    }
-  };
-
-  double best_score = -10000;
-  Action* best_a = nullptr;
-  for (Action& action : s.actions) {
-    const double score = score_move(action) + rand_dist(rand);
-    if (score > best_score) {
-      best_score = score;
-      best_a = &action;
-    }
-  }
-#if 0
-  // Add debugging here if below check fails.
-  if (best_a < 0) {
-    for (int m : s.board.valid_moves()) {
-      LOG(INFO) << "m " << m << " s " << score_move(m);
-    }
+const float kPUCT = 1.0;
+
+// Mean value of 's' for the player to move, over all visits through any of its
+// parents. Falls back to the predicted value if there are none yet.
+double StateValue(const State& s) {
+  int num = 0;
+  double total = 0.0;
+  for (int a = 0; a < s.num_actions; ++a) {
+    num += s.NumTaken(a);
+    total += s.TotalValue(a);
   }
-#endif
-  CHECK_NE(best_a, nullptr);
-  return best_a;
+  return num == 0 ? s.value : total / num;
+}
+
+int PickAction(const State& s) {
+  CHECK_GT(s.num_actions, 0);
+  return PuctArgmax(s.puct_stats(), kPUCT);
 }
 
 }  // namespace
 
-MCTS::MCTS(std::unique_ptr<Board> start) { SetBoard(std::move(start)); }
+MCTS::MCTS(std::unique_ptr<Board> start, bool transpositions)
+    : transpositions_(transpositions) {
+  SetBoard(std::move(start));
+}
 
 MCTS::~MCTS() {}
 
@@ -121,33 +210,62 @@ const Board& MCTS::current_board() const { return *root_->board; }
 
 std::unique_ptr<MCTS::PredictionRequest> MCTS::StartIteration() {
   CHECK(root_ != nullptr);
-  // TODO: Use some tricks to avoid keeping 'cur' a shared ptr.
-  std::shared_ptr<State> cur = root_;
+  State* cur = root_;
   CHECK(!cur->is_terminal());
-  // TODO: Use InlinedVector
+  if (cur->GetProof() != Proof::kUnknown) {
+    // Solved, nothing to search.
+    return nullptr;
+  }
   PredictionRequest::PathVec picked_path;
   while (true) {
-    Action* const best_a = PickAction(rand_, *cur);
-    picked_path.emplace_back(cur.get(), best_a);
-    if (best_a->state == nullptr) {
-      std::unique_ptr<Board> board = cur->board->Move(best_a->move);
-      std::shared_ptr<State> state;
-      if (board->is_over()) {
-        // Terminal node, can't iterate.
-        CHECK(!picked_path.empty());
-        const double terminal_value = board->result();
-        for (auto e : picked_path) {
-          const double mul = e.s->board->turn() == board->turn() ? 1.0 : -1.0;
-          e.a->AddResult(mul * terminal_value);
+    const int best_a = PickAction(*cur);
+    picked_path.emplace_back(cur, best_a);
+    std::atomic<State*>& child = cur->children[best_a];
+    State* next = child.load(std::memory_order_acquire);
+    if (next == nullptr) {
+      std::unique_ptr<Board> board = cur->board->Move(cur->moves[best_a]);
+      if (transpositions_ && !board->is_over()) {
+        next = FindState(board->fingerprint());
+      }
+      if (next != nullptr) {
+        // Reached a known state via a new path. Link it here, and count its
+        // value for the new edge instead of evaluating the position again.
+        State* linked = nullptr;
+        if (!child.compare_exchange_strong(linked, next,
+                                           std::memory_order_acq_rel)) {
+          // Another thread linked it first.
+          next = linked;
+        }
+        if (next->GetProof() == Proof::kUnknown) {
+          const double value = StateValue(*next);
+          for (auto e : picked_path) {
+            const double mul =
+                e.s->board->turn() == next->board->turn() ? 1.0 : -1.0;
+            e.s->AddResult(e.a, mul * value);
+          }
+          return nullptr;
+        }
+        // Proven, handled below.
+      } else if (board->is_over()) {
+        // Terminal node. Keep it as a proven state, so that its parents can
+        // be proven too.
+        PredictionResult terminal;
+        terminal.value = board->result();
+        {
+          absl::MutexLock lock(&mu_);
+          next = arena_.New<State>(&arena_, std::move(board), terminal);
+        }
+        State* linked = nullptr;
+        if (!child.compare_exchange_strong(linked, next,
+                                           std::memory_order_acq_rel)) {
+          next = linked;
         }
-        return nullptr;
-
       } else {
         // OK, it's a new node: must request a prediction.
 
         // Increment virtual counts - this will be undone by Finish.
         for (auto e : picked_path) {
-          ++e.a->num_virtual;
+          e.s->num_virtual[e.a].fetch_add(1, std::memory_order_relaxed);
         }
         std::unique_ptr<PredictionRequest> request(new PredictionRequest());
         request->picked_path_ = std::move(picked_path);
@@ -156,9 +274,29 @@ std::unique_ptr<MCTS::PredictionRequest> MCTS::StartIteration() {
         request->board_ = std::move(board);
         return request;
       }
-      best_a->state = std::move(state);
     }
-    cur = best_a->state;
+    if (next->GetProof() != Proof::kUnknown) {
+      // Proven (or terminal) node, no need to search further.
+      const double value = ProofValue(next->GetProof());
+      for (auto e : picked_path) {
+        const double mul =
+            e.s->board->turn() == next->board->turn() ? 1.0 : -1.0;
+        e.s->AddResult(e.a, mul * value);
+      }
+      UpdateProofs(picked_path);
+      return nullptr;
+    }
+    // With transpositions, the tree may have cycles (repeated positions).
+    // Count those as draws, like the rules mostly do.
+    if (transpositions_ &&
+        std::any_of(picked_path.begin(), picked_path.end(),
+                    [next](const ActionRef& e) { return e.s == next; })) {
+      for (auto e : picked_path) {
+        e.s->AddResult(e.a, 0.0);
+      }
+      return nullptr;
+    }
+    cur = next;
   }
 }
 
@@ -169,31 +307,40 @@ void MCTS::FinishIteration(std::unique_ptr<PredictionRequest> req,
   CHECK(req->board_ != nullptr);
 
   CHECK(req->parent_ != nullptr);
-  Action* const action = req->parent_a_;
+  std::atomic<State*>& child = req->parent_->children[req->parent_a_];
   // It's possible that 'state' was already added by a previous call to
   // FinishIteration(). StartIteration() may return the same position twice in
   // case the first iteration has not yet been finished.
-  std::shared_ptr<State> state;
-  if (action->state == nullptr) {
-    // Initialize next state.
-    state = std::make_shared<State>(std::move(req->board_), p);
-#if 0
-    auto& old_state = visited_states_[req->board()];
-    // We never request predictions for moves that are already visited and
-    // found live in the map.
-    // CHECK(old_state.expired());
-    // CHECK(old_state == nullptr);
-    old_state = state;
-#endif
-    action->state = state;
-  } else {
-    state = action->state;
+  State* state = child.load(std::memory_order_acquire);
+  if (state == nullptr) {
+    // Initialize next state, unless another request for the same position
+    // already did.
+    State* new_state = nullptr;
+    {
+      const BoardFP fp = transpositions_ ? req->board_->fingerprint() : 0;
+      absl::MutexLock lock(&mu_);
+      if (transpositions_) {
+        auto& known = states_[fp];
+        if (known == nullptr) {
+          known = arena_.New<State>(&arena_, std::move(req->board_), p);
+        }
+        new_state = known;
+      } else {
+        new_state = arena_.New<State>(&arena_, std::move(req->board_), p);
+      }
+    }
+    // Publish the state. If another thread got there first, use its state
+    // instead; ours stays unused in the arena until SetBoard().
+    if (child.compare_exchange_strong(state, new_state,
+                                      std::memory_order_acq_rel)) {
+      state = new_state;
+    }
   }
-  CHECK_EQ(req->picked_path_.back().a, action);
-  CHECK_EQ(req->picked_path_.back().s, req->parent_.get());
+  CHECK_EQ(req->picked_path_.back().a, req->parent_a_);
+  CHECK_EQ(req->picked_path_.back().s, req->parent_);
   for (auto e : req->picked_path_) {
     CHECK(e.s->board != nullptr);
-    CHECK(e.a->state != nullptr);
+    CHECK(e.s->children[e.a] != nullptr);
     CHECK(state != nullptr);
     CHECK(state->board != nullptr);
     const double mul = e.s->board->turn() == state->board->turn() ? 1.0 : -1.0;
@@ -203,40 +350,95 @@ void MCTS::FinishIteration(std::unique_ptr<PredictionRequest> req,
     //
     // XXX: Above comment makes sense if the following value is < 1.0.
     const double kUncertainty = 1.0;
-    e.a->AddResult(mul * p.value * kUncertainty);
-    --e.a->num_virtual;
+    e.s->AddResult(e.a, mul * p.value * kUncertainty);
+    e.s->num_virtual[e.a].fetch_sub(1, std::memory_order_relaxed);
   }
+  // The state may be a proven one, reached via a transposition.
+  UpdateProofs(req->picked_path_);
 }
 
+void MCTS::UpdateProofs(const PredictionRequest::PathVec& path) {
+  // Several threads may do this at once. That's fine, as proofs only ever
+  // change from unknown to a value which only depends on the children.
+  for (auto it = path.rbegin(); it != path.rend(); ++it) {
+    const State* child = it->s->Child(it->a);
+    const Proof child_proof =
+        child == nullptr ? Proof::kUnknown : child->GetProof();
+    if (child_proof == Proof::kUnknown) {
+      return;
+    }
+    if (child_proof == Proof::kWin) {
+      // Never worth searching again. Proven draws and wins are still picked,
+      // which is cheap as they end the iteration right away.
+      it->s->Exclude(it->a);
+    }
+    const Proof proof = it->s->ComputeProof();
+    if (proof == Proof::kUnknown) {
+      return;
+    }
+    it->s->proof.store(proof, std::memory_order_relaxed);
+  }
+}
+
+MCTS::Proof MCTS::root_proof() const { return root_->GetProof(); }
+
 int MCTS::num_iterations() const {
   if (root_ == nullptr) {
     return 0;
   }
   int sum = 0;
-  for (int i = 0; i < 7; ++i) {
-    sum += root_->actions[i].num_taken;
+  for (int a = 0; a < root_->num_actions; ++a) {
+    sum += root_->NumTaken(a);
   }
   return sum;
 }
 
+void MCTS::GetRootVisits(std::vector<int>* visits) const {
+  visits->clear();
+  if (root_ == nullptr) {
+    return;
+  }
+  for (int a = 0; a < root_->num_actions; ++a) {
+    visits->push_back(root_->NumTaken(a));
+  }
+}
+
 PredictionResult MCTS::GetPrediction() const {
   PredictionResult res;
   CHECK(root_ != nullptr);
   int sum_n = 0;
-  for (const Action& a : root_->actions) {
-    sum_n += a.num_taken;
-    CHECK(a.num_virtual == 0) << "move=" << a.move;
+  for (int a = 0; a < root_->num_actions; ++a) {
+    sum_n += root_->NumTaken(a);
+    CHECK(root_->NumVirtual(a) == 0) << "move=" << root_->moves[a];
   }
   CHECK(sum_n != 0);
   const double inv_sum = 1.0 / sum_n;
   res.value = 0;
 
-  for (const Action& a : root_->actions) {
-    const int num = a.num_taken;
-    res.policy.emplace_back(a.move, num * inv_sum);
-    res.value += a.total_value * inv_sum;
+  for (int a = 0; a < root_->num_actions; ++a) {
+    const int num = root_->NumTaken(a);
+    res.policy.emplace_back(root_->moves[a], num * inv_sum);
+    res.value += root_->TotalValue(a) * inv_sum;
   }
 
+  const Proof proof = root_->GetProof();
+  if (proof == Proof::kWin || proof == Proof::kDraw) {
+    int num_best = 0;
+    for (int a = 0; a < root_->num_actions; ++a) {
+      const State* child = root_->Child(a);
+      const bool best =
+          child != nullptr && child->GetProof() == ChildProofFor(proof);
+      res.policy[a].second = best ? 1.0 : 0.0;
+      num_best += best;
+    }
+    CHECK_GT(num_best, 0);
+    for (auto& move : res.policy) {
+      move.second /= num_best;
+    }
+  }
+  if (proof != Proof::kUnknown) {
+    res.value = ProofValue(proof);
+  }
   return res;
 }
 
@@ -263,10 +465,10 @@ Prediction MCTS::GetChildValues() const {
 #endif
 
 void MCTS::MakeMove(int a) {
-  std::shared_ptr<State> new_root;
-  for (Action& action : root_->actions) {
-    if (action.move == a) {
-      new_root = action.state;
+  State* new_root = nullptr;
+  for (int i = 0; i < root_->num_actions; ++i) {
+    if (root_->moves[i] == a) {
+      new_root = root_->children[i].load(std::memory_order_relaxed);
       break;
     }
   }
@@ -283,7 +485,20 @@ void MCTS::SetBoard(std::unique_ptr<Board> b) {
   for (const int m : moves) {
     equal_p.policy.emplace_back(m, 1.0 / moves.size());
   }
-  root_ = std::make_shared<State>(std::move(b), equal_p);
+  const BoardFP fp = transpositions_ ? b->fingerprint() : 0;
+  absl::MutexLock lock(&mu_);
+  arena_.Reset();
+  states_.clear();
+  root_ = arena_.New<State>(&arena_, std::move(b), equal_p);
+  if (transpositions_) {
+    states_[fp] = root_;
+  }
+}
+
+mcts::State* MCTS::FindState(BoardFP fp) {
+  absl::MutexLock lock(&mu_);
+  const auto it = states_.find(fp);
+  return it == states_.end() ? nullptr : it->second;
 }
 
 }  // namespace generic
@@ -2,34 +2,52 @@
 #define _GENERIC_MCTS_H_
 
 #include <algorithm>
+#include <cstdint>
 #include <functional>
 #include <memory>
 #include <random>
+#include <vector>
 
+#include "absl/container/flat_hash_map.h"
 #include "absl/container/inlined_vector.h"
 #include "absl/container/node_hash_map.h"
+#include "absl/synchronization/mutex.h"
 #include "absl/types/optional.h"
 #include "generic/board.h"
+#include "util/arena.h"
 
 namespace generic {
 
 // MCTS internals, not to be used by callers directly.
 namespace mcts {
 struct State;
-struct Action;
+// Action 'a' of state 's'.
 struct ActionRef {
-  ActionRef(mcts::State* ss, mcts::Action* aa) : s(ss), a(aa) {}
+  ActionRef(mcts::State* ss, int aa) : s(ss), a(aa) {}
   mcts::State* s;
-  mcts::Action* a;
+  int a;
 };
 }  // namespace mcts
 
 class MCTS {
  public:
-  explicit MCTS(std::unique_ptr<Board> start);
+  // Game-theoretic value of a state for the player to move, as proven by the
+  // search ("MCTS-solver"). Terminal states are proven by the rules; a state
+  // is a win if some action leads to a proven loss for the opponent, and
+  // otherwise proven once all its actions are.
+  enum class Proof : uint8_t { kUnknown, kWin, kLoss, kDraw };
+
+  // With 'transpositions', positions reached via different move orders share
+  // a single state, keyed by Board::fingerprint(). Each parent keeps its own
+  // visit counts for the shared state, so values are backed up only along the
+  // path taken. A new edge to a known state is credited with that state's
+  // current value without evaluating it again.
+  explicit MCTS(std::unique_ptr<Board> start, bool transpositions = false);
   ~MCTS();
 
-  // Resets position to 'b'.
+  // Resets position to 'b'. This frees the whole tree at once, but keeps its
+  // memory for the next one. Must not be called while there are outstanding
+  // prediction requests.
   void SetBoard(std::unique_ptr<Board> b);
 
   const Board& current_board() const;
@@ -37,8 +55,13 @@ class MCTS {
   //
   // Finds a new leaf node to explore and returns a prediction request.
   // FinishIteration() must be called with predictions for this position to
-  // complete the iteration. New iteration must not be started before calling
-  // FinishIteration().
+  // complete the iteration. Several iterations can be in flight at once:
+  // pending ones count as losses ("virtual loss") so that other iterations
+  // spread out to other leaves.
+  //
+  // StartIteration() and FinishIteration() may be called concurrently from
+  // multiple threads sharing this tree. Other methods must not run
+  // concurrently with anything else.
   //
   // May return null in case no new leaf node was found (i.e. we hit a terminal
   // node). In that case FinishIteration() must not be called.
@@ -56,9 +79,9 @@ class MCTS {
     // What board we want to get inspected.
     std::unique_ptr<Board> board_;
     PathVec picked_path_;
-    std::shared_ptr<mcts::State> parent_;
+    mcts::State* parent_ = nullptr;
     // The action from 'parent' leading to this board.
-    mcts::Action* parent_a_ = nullptr;
+    int parent_a_ = -1;
 
     friend class MCTS;
   };
@@ -72,7 +95,18 @@ class MCTS {
   // Number of times an iteration has been completed.
   int num_iterations() const;
 
-  // This is the prediction for the current board.
+  // Proven value of the current board. Once it's known, StartIteration()
+  // returns null without searching.
+  Proof root_proof() const;
+
+  // Sets 'visits' to the number of completed iterations through each root
+  // action. This and num_iterations() may be called while other threads run
+  // iterations.
+  void GetRootVisits(std::vector<int>* visits) const;
+
+  // This is the prediction for the current board. If the board is proven to
+  // be a win or a draw, the policy is split evenly between the moves which
+  // achieve that.
   // Must not be called if there are outstanding
   PredictionResult GetPrediction() const;
 
@@ -80,16 +114,28 @@ class MCTS {
   // PredictionResult GetPrior() const;
   // PredictionResult GetChildValues() const;
 
-  // Advances the current state with a move.
+  // Advances the current state with a move. Nodes which are no longer
+  // reachable are only freed by SetBoard().
   void MakeMove(int a);
 
  private:
-  std::unique_ptr<Board> current_;
-  std::shared_ptr<mcts::State> root_;
+  // Returns the state for 'fp', or null if there isn't one yet.
+  mcts::State* FindState(BoardFP fp) LOCKS_EXCLUDED(mu_);
+  // Called when the state at the end of 'path' may have become proven.
+  // Propagates the proof up the path as far as it goes.
+  static void UpdateProofs(const PredictionRequest::PathVec& path);
 
-  // TODO: Optimize this memory-wise.
-  // absl::node_hash_map<BoardFP, std::shared_ptr<mcts::State>> visited_states_;
-  std::mt19937 rand_;
+  std::unique_ptr<Board> current_;
+  const bool transpositions_;
+  // Guards allocation and the transposition table only: states are
+  // published to the tree lock-free.
+  absl::Mutex mu_;
+  // Owns all states and their actions.
+  util::Arena arena_ GUARDED_BY(mu_);
+  // All states by fingerprint, if 'transpositions_' is set. Includes states
+  // no longer reachable from the root, until SetBoard().
+  absl::flat_hash_map<BoardFP, mcts::State*> states_ GUARDED_BY(mu_);
+  mcts::State* root_ = nullptr;
 };
 
 }  // namespace generic
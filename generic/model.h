@@ -22,7 +22,10 @@ class Model {
     tensorflow::Tensor value;
   };
 
-  Prediction Predict(const tensorflow::Tensor& batch);
+  virtual ~Model() {}
+
+  // Virtual for fakes in tests.
+  virtual Prediction Predict(const tensorflow::Tensor& batch);
 
   void RunTrainStep(const tensorflow::Tensor& board_batch,
                     const tensorflow::Tensor& move_batch,
@@ -41,6 +44,10 @@ class Model {
   // Creates a new model, initialized
   static std::unique_ptr<Model> New(const std::string& graph_def_file);
 
+ protected:
+  // Without a session, for fakes which override Predict().
+  Model() {}
+
  private:
   // Creates a new model, initialized
   static std::unique_ptr<Model> OpenInternal(
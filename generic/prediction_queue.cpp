@@ -36,12 +36,12 @@ void PredictionQueue::WorkerThread(int worker_id) {
       if (stopped_) {
         return true;
       }
-      if (num_working_ == 0) {
-        // First worker will take anything.
-        return !batches_.empty();
+      if (batches_.empty() || batches_.front()->pending_writes > 0) {
+        return false;
       }
-      // Rest, only take work if the batch is full.
-      return !batches_.empty() && batches_.front()->size == max_batch_size_;
+      // First worker will take anything. Rest, only take work if the batch is
+      // full.
+      return num_working_ == 0 || batches_.front()->size == max_batch_size_;
     };
     mu_.Await(absl::Condition(&stopped_or_have_work));
     if (stopped_) {
@@ -65,10 +65,19 @@ void PredictionQueue::WorkerThread(int worker_id) {
     auto prediction = model_->Predict(current_batch->board_tensor);
     current_batch->move_p = std::move(prediction.move_p);
     current_batch->value = std::move(prediction.value);
+    // Submit() calls don't have a thread waiting, serve them from here.
+    for (const AsyncPart& part : current_batch->async_parts) {
+      FillResults(*current_batch, part.offset, part.requests, part.n);
+      if (part.state->pending_parts.fetch_sub(1, std::memory_order_acq_rel) ==
+          1) {
+        part.state->done();
+      }
+    }
     // Serve requests now that we got the numbers. That requires a lock again.
     mu_.Lock();
     current_batch->ready = true;
     --num_working_;
+    ReleaseRequests(current_batch, current_batch->async_parts.size());
   }
 }
 
@@ -83,88 +92,146 @@ std::shared_ptr<PredictionQueue::WorkBatch> PredictionQueue::CreateBatch(
 
   r->ready = false;
   r->size = 0;
+  r->pending_writes = 0;
+  r->async_parts.clear();
   // Should already be zero.
   CHECK_EQ(r->pending_requests, 0);
   return r;
 }
 
+std::shared_ptr<PredictionQueue::WorkBatch> PredictionQueue::AddToBatch(
+    Request* requests, int n, const std::shared_ptr<AsyncState>& async,
+    int* offset, int* batch_n) {
+  std::shared_ptr<WorkBatch> batch;
+  {
+    absl::MutexLock lock(&mu_);
+    if (batches_.empty() || batches_.back()->size == max_batch_size_) {
+      auto can_make_batch = [this]() -> bool {
+        return batches_.size() < kMaxPendingBatches;
+      };
+      mu_.Await(absl::Condition(&can_make_batch));
+      // Need a new batch (possibly by taking from freelist_).
+      batches_.push_back(CreateBatch(*requests[0].board));
+    }
+    // Now we know there is some space in the last batch.
+    batch = batches_.back();
+    *offset = batch->size;
+    // The batch can be most 'max_batch_size_' in size.
+    *batch_n = std::min(n, max_batch_size_ - *offset);
+    batch->size += *batch_n;
+    ++batch->pending_requests;
+    ++batch->pending_writes;
+    if (async != nullptr) {
+      async->pending_parts.fetch_add(1, std::memory_order_relaxed);
+      batch->async_parts.push_back(
+          AsyncPart{requests, *batch_n, *offset, async});
+    }
+  }
+  CHECK_GT(*batch_n, 0);
+  CHECK_GE(*offset, 0);
+  // Write input to our slots without holding the lock. The batch can't be
+  // evaluated or reused before we're done, since pending_writes is nonzero.
+  for (int i = 0; i < *batch_n; ++i) {
+    requests[i].board->ToTensor(&batch->board_tensor, *offset + i);
+  }
+  return batch;
+}
+
+void PredictionQueue::FillResults(const WorkBatch& batch, int offset,
+                                  Request* requests, int n) {
+  for (int i = 0; i < n; ++i) {
+    auto& request = requests[i];
+    request.result.policy.clear();
+    const std::vector<int> moves = request.board->GetValidMoves();
+    request.result.policy.reserve(moves.size());
+    double total = 0.0;
+    for (const int m : moves) {
+      const double v = batch.move_p.matrix<float>()(offset + i, m);
+      request.result.policy.emplace_back(m, v);
+      total += v;
+    }
+    if (total < 0.1) {
+      total += 1.0;
+      for (auto& move_p : request.result.policy) {
+        move_p.second = 1.0 / request.result.policy.size();
+      }
+    }
+    for (auto& move_p : request.result.policy) {
+      move_p.second /= total;
+    }
+    request.result.value = batch.value.flat<float>()(offset + i);
+  }
+}
+
+void PredictionQueue::ReleaseRequests(std::shared_ptr<WorkBatch> batch,
+                                      int num_requests) {
+  mu_.AssertHeld();
+  batch->pending_requests -= num_requests;
+  if (batch->pending_requests == 0) {
+    // This was the last request to be served from this batch, we can
+    // freelist this batch.
+    if (freelist_.size() < kFreelistMaxSize) {
+      freelist_.push_back(std::move(batch));
+    }
+  }
+}
+
 void PredictionQueue::GetPredictions(Request* requests, int n) {
   while (n > 0) {
-    std::shared_ptr<WorkBatch> last_batch;
     int batch_n = -1;
     int offset = -1;
+    std::shared_ptr<WorkBatch> last_batch =
+        AddToBatch(requests, n, nullptr, &offset, &batch_n);
     {
       absl::MutexLock lock(&mu_);
-      if (batches_.empty() || batches_.back()->size == max_batch_size_) {
-#if 1
-        auto can_make_batch = [this]() -> bool {
-          return batches_.size() < kMaxPendingBatches;
-        };
-        mu_.Await(absl::Condition(&can_make_batch));
-#endif
-        // Need a new batch (possibly by taking from freelist_).
-        batches_.push_back(CreateBatch(*requests[0].board));
-      }
-      // Now we know there is some space in the last batch.
-      last_batch = batches_.back();
-      offset = last_batch->size;
-      // The batch can be most 'max_batch_size_' in size.
-      batch_n = std::min(n, max_batch_size_ - offset);
-      last_batch->size += batch_n;
-      ++last_batch->pending_requests;
-
-      // Write input in the tensor already.
-      for (int i = 0; i < batch_n; ++i) {
-        requests[i].board->ToTensor(&last_batch->board_tensor, offset + i);
-      }
+      --last_batch->pending_writes;
       // Wait for this batch to be ready.
       mu_.Await(absl::Condition(&last_batch->ready));
     }
-    CHECK_GT(batch_n, 0);
-    CHECK_GE(offset, 0);
-    CHECK_NE(last_batch, nullptr);
 
     // Batch ready, dispense results:
-    for (int i = 0; i < batch_n; ++i) {
-      auto& request = requests[i];
-      request.result.policy.clear();
-      const std::vector<int> moves = request.board->GetValidMoves();
-      request.result.policy.reserve(moves.size());
-      double total = 0.0;
-      for (const int m : moves) {
-        const double v = last_batch->move_p.matrix<float>()(offset + i, m);
-        request.result.policy.emplace_back(m, v);
-        total += v;
-      }
-      if (total < 0.1) {
-        total += 1.0;
-        for (auto& move_p : request.result.policy) {
-          move_p.second = 1.0 / request.result.policy.size();
-        }
-      }
-      for (auto& move_p : request.result.policy) {
-        move_p.second /= total;
-      }
-      request.result.value = last_batch->value.flat<float>()(i);
-    }
+    FillResults(*last_batch, offset, requests, batch_n);
 
     // Now we can try making a new request.
     n -= batch_n;
     requests += batch_n;
 
     // Potentially freelist last_batch.
-    {
-      absl::MutexLock lock(&mu_);
-      --last_batch->pending_requests;
-      if (last_batch->pending_requests == 0) {
-        // This was the last request to be served from this batch, we can
-        // freelist this batch.
-        if (freelist_.size() < kFreelistMaxSize) {
-          freelist_.push_back(std::move(last_batch));
-        }
-      }
+    absl::MutexLock lock(&mu_);
+    ReleaseRequests(std::move(last_batch), 1);
+  }
+}
+
+void PredictionQueue::Submit(Request* requests, int n,
+                             std::function<void()> done) {
+  CHECK_GT(n, 0);
+  auto state = std::make_shared<AsyncState>();
+  state->done = std::move(done);
+  // Keep one part for ourselves, so that 'done' can't be called before all
+  // parts have been added.
+  state->pending_parts.store(1, std::memory_order_relaxed);
+  while (n > 0) {
+    int batch_n = -1;
+    int offset = -1;
+    std::shared_ptr<WorkBatch> last_batch =
+        AddToBatch(requests, n, state, &offset, &batch_n);
+    n -= batch_n;
+    requests += batch_n;
+    if (n == 0) {
+      // Drop our part while the last batch still waits for our writes. Its
+      // part is then still pending, so the worker serving it calls 'done'.
+      state->pending_parts.fetch_sub(1, std::memory_order_relaxed);
     }
+    absl::MutexLock lock(&mu_);
+    --last_batch->pending_writes;
   }
 }
 
+std::future<void> PredictionQueue::Submit(Request* requests, int n) {
+  auto promise = std::make_shared<std::promise<void>>();
+  std::future<void> future = promise->get_future();
+  Submit(requests, n, [promise] { promise->set_value(); });
+  return future;
+}
+
 }  // namespace generic
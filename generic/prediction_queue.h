@@ -4,6 +4,8 @@
 #include <atomic>
 #include <cstdint>
 #include <deque>
+#include <functional>
+#include <future>
 #include <memory>
 #include <thread>
 #include <vector>
@@ -30,6 +32,25 @@ class PredictionQueue {
   // Blocks.
   void GetPredictions(Request* requests, int n);
 
+  // Asynchronous version of GetPredictions(). Queues 'requests' for
+  // evaluation and returns once their input has been written to a batch.
+  // 'done' is called after the results of all 'n' requests have been filled
+  // in, so 'requests' (and the boards) must stay alive until then. 'n' must
+  // be positive.
+  //
+  // 'done' always runs on an internal worker thread, never inside Submit(),
+  // even if the results are ready before Submit() returns. So the caller may
+  // hold locks that 'done' takes. It delays other requests in the same
+  // batch, so it should be cheap, e.g. signal the thread that owns the
+  // requests. It must not call GetPredictions() or Submit().
+  //
+  // This still blocks if too many batches are already waiting for the model.
+  void Submit(Request* requests, int n, std::function<void()> done);
+
+  // Same as above, but the returned future becomes ready when the results
+  // are available.
+  std::future<void> Submit(Request* requests, int n);
+
   int64_t num_predictions() const {
     return pred_count_.load(std::memory_order_relaxed);
   }
@@ -44,6 +65,20 @@ class PredictionQueue {
   }
 
  private:
+  // State shared by the parts of a single Submit() call, which may span
+  // multiple batches.
+  struct AsyncState {
+    std::atomic<int> pending_parts{0};
+    std::function<void()> done;
+  };
+
+  struct AsyncPart {
+    Request* requests;
+    int n;
+    int offset;
+    std::shared_ptr<AsyncState> state;
+  };
+
   struct WorkBatch {
     explicit WorkBatch(int n, const Board& first_board) {
       tensorflow::TensorShape shape;
@@ -53,9 +88,15 @@ class PredictionQueue {
     tensorflow::Tensor board_tensor;
     tensorflow::Tensor move_p;
     tensorflow::Tensor value;
+    // Number of slots reserved by requests.
     int size = 0;
+    // Requests that have reserved slots but are still writing their input.
+    // The batch can only be evaluated once this drops to zero.
+    int pending_writes = 0;
     bool ready = false;
     int pending_requests = 0;
+    // Parts of Submit() calls in this batch. These are served by the worker.
+    std::vector<AsyncPart> async_parts;
   };
 
   void WorkerThread(int worker_id);
@@ -63,6 +104,24 @@ class PredictionQueue {
   std::shared_ptr<WorkBatch> CreateBatch(const Board& first_board)
       EXCLUSIVE_LOCKS_REQUIRED(mu_);
 
+  // Reserves slots for (at most) the first 'n' requests in the newest batch,
+  // and writes their input to it. Stores the number of slots in '*batch_n'
+  // and the first slot in '*offset'. The caller must decrement
+  // pending_writes of the returned batch. If 'async' is non-null, the
+  // requests are added as a part of that Submit() call.
+  std::shared_ptr<WorkBatch> AddToBatch(
+      Request* requests, int n, const std::shared_ptr<AsyncState>& async,
+      int* offset, int* batch_n) LOCKS_EXCLUDED(mu_);
+
+  // Fills results for 'n' requests from slots starting at 'offset'.
+  static void FillResults(const WorkBatch& batch, int offset,
+                          Request* requests, int n);
+
+  // Marks 'num_requests' requests of 'batch' as served, freelisting the
+  // batch if it was the last one.
+  void ReleaseRequests(std::shared_ptr<WorkBatch> batch, int num_requests)
+      EXCLUSIVE_LOCKS_REQUIRED(mu_);
+
   Model* const model_;
   const int max_batch_size_;
 
@@ -0,0 +1,138 @@
+#include "generic/prediction_queue.h"
+
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "absl/synchronization/mutex.h"
+#include "absl/synchronization/notification.h"
+#include "gtest/gtest.h"
+
+namespace generic {
+namespace {
+
+// A board which only knows its id. Its moves are 0 and 1.
+class FakeBoard : public Board {
+ public:
+  explicit FakeBoard(int id) : id_(id) {}
+
+  std::vector<int> GetValidMoves() const override { return {0, 1}; }
+  std::unique_ptr<Board> Clone() const override {
+    return std::make_unique<FakeBoard>(id_);
+  }
+  std::unique_ptr<Board> Move(int move) const override {
+    return std::make_unique<FakeBoard>(2 * id_ + move);
+  }
+  BoardFP fingerprint() const override { return id_; }
+  bool is_over() const override { return false; }
+  int result() const override { return 0; }
+  int turn() const override { return 0; }
+  void ToTensor(tensorflow::Tensor* t, int i) const override {
+    t->matrix<float>()(i, 0) = id_;
+  }
+  void GetTensorShape(int batch_size,
+                      tensorflow::TensorShape* out) const override {
+    *out = tensorflow::TensorShape({batch_size, 1});
+  }
+  int num_possible_moves() const override { return 2; }
+
+ private:
+  const int id_;
+};
+
+// Predicts value id / 1000 for every board, and policy 1/4 and 3/4.
+class FakeModel : public Model {
+ public:
+  Prediction Predict(const tensorflow::Tensor& batch) override {
+    const int n = batch.dim_size(0);
+    Prediction pred;
+    pred.move_p =
+        tensorflow::Tensor(tensorflow::DT_FLOAT, tensorflow::TensorShape({n, 2}));
+    pred.value =
+        tensorflow::Tensor(tensorflow::DT_FLOAT, tensorflow::TensorShape({n}));
+    for (int i = 0; i < n; ++i) {
+      pred.move_p.matrix<float>()(i, 0) = 0.25;
+      pred.move_p.matrix<float>()(i, 1) = 0.75;
+      pred.value.flat<float>()(i) = batch.matrix<float>()(i, 0) / 1000;
+    }
+    return pred;
+  }
+};
+
+class PredictionQueueTest : public testing::Test {
+ protected:
+  // Requests for boards with ids 0 to n - 1.
+  std::vector<PredictionQueue::Request> MakeRequests(int n) {
+    std::vector<PredictionQueue::Request> requests(n);
+    for (int i = 0; i < n; ++i) {
+      boards_.push_back(std::make_unique<FakeBoard>(i));
+      requests[i].board = boards_.back().get();
+    }
+    return requests;
+  }
+
+  static void ExpectResults(const std::vector<PredictionQueue::Request>& r) {
+    for (int i = 0; i < r.size(); ++i) {
+      EXPECT_FLOAT_EQ(r[i].result.value, i / 1000.0);
+      ASSERT_EQ(r[i].result.policy.size(), 2);
+      EXPECT_FLOAT_EQ(r[i].result.policy[0].second, 0.25);
+      EXPECT_FLOAT_EQ(r[i].result.policy[1].second, 0.75);
+    }
+  }
+
+  FakeModel model_;
+  std::vector<std::unique_ptr<FakeBoard>> boards_;
+};
+
+TEST_F(PredictionQueueTest, GetPredictions) {
+  PredictionQueue queue(&model_, 16);
+  // Spans several batches.
+  auto requests = MakeRequests(40);
+  queue.GetPredictions(requests.data(), requests.size());
+  ExpectResults(requests);
+  EXPECT_EQ(queue.num_predictions(), 40);
+}
+
+TEST_F(PredictionQueueTest, SubmitWithCallback) {
+  PredictionQueue queue(&model_, 16);
+  auto requests = MakeRequests(40);
+  absl::Notification done;
+  queue.Submit(requests.data(), requests.size(), [&done] { done.Notify(); });
+  done.WaitForNotification();
+  ExpectResults(requests);
+}
+
+TEST_F(PredictionQueueTest, SubmitWithFuture) {
+  PredictionQueue queue(&model_, 16);
+  auto requests = MakeRequests(5);
+  queue.Submit(requests.data(), requests.size()).wait();
+  ExpectResults(requests);
+}
+
+TEST_F(PredictionQueueTest, DoneNeverRunsInsideSubmit) {
+  PredictionQueue queue(&model_, 4);
+  // The model is fast, so the results are often ready before Submit()
+  // returns. 'done' must still not run on this thread, which holds 'mu'.
+  for (int i = 0; i < 200; ++i) {
+    auto requests = MakeRequests(1 + i % 8);
+    absl::Mutex mu;
+    absl::Notification done;
+    std::thread::id done_thread;
+    {
+      absl::MutexLock lock(&mu);
+      queue.Submit(requests.data(), requests.size(), [&] {
+        {
+          absl::MutexLock lock(&mu);
+          done_thread = std::this_thread::get_id();
+        }
+        done.Notify();
+      });
+    }
+    done.WaitForNotification();
+    EXPECT_NE(done_thread, std::this_thread::get_id());
+    ExpectResults(requests);
+  }
+}
+
+}  // namespace
+}  // namespace generic
@@ -0,0 +1,205 @@
+#include "generic/puct.h"
+
+#include <immintrin.h>
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace generic {
+
+namespace {
+
+// Inputs of one action, unpacked from either layout.
+struct Action {
+  float prior;
+  int32_t num_taken;
+  int32_t num_virtual;
+  float total_value;
+};
+
+Action GetAction(const PuctStats& s, int i) {
+  return {s.prior[i], s.num_taken[i], s.num_virtual[i], s.total_value[i]};
+}
+
+Action GetAction(const CompactPuctStats& s, int i) {
+  const uint32_t visits = s.visits[i];
+  return {HalfToFloat(s.prior[i]), static_cast<int32_t>(visits & kTakenMask),
+          static_cast<int32_t>(visits >> kTakenBits), s.total_value[i]};
+}
+
+template <typename Stats>
+int PriorArgmax(const Stats& s) {
+  int best = 0;
+  float best_prior = GetAction(s, 0).prior;
+  for (int i = 1; i < s.n; ++i) {
+    const float prior = GetAction(s, i).prior;
+    if (prior > best_prior) {
+      best_prior = prior;
+      best = i;
+    }
+  }
+  return best;
+}
+
+template <typename Stats>
+int ScalarArgmax(const Stats& s, float c_puct) {
+  int32_t num_sum = 0;
+  for (int i = 0; i < s.n; ++i) {
+    const Action a = GetAction(s, i);
+    num_sum += a.num_taken + a.num_virtual;
+  }
+  if (num_sum == 0) {
+    return PriorArgmax(s);
+  }
+  const float c = c_puct * std::sqrt(static_cast<float>(num_sum));
+  float best_score = -std::numeric_limits<float>::infinity();
+  int best = 0;
+  for (int i = 0; i < s.n; ++i) {
+    const Action a = GetAction(s, i);
+    const float num_virtual = a.num_virtual;
+    const float num = static_cast<float>(a.num_taken + a.num_virtual);
+    // Reminder: virtual moves are counted as losses for both players.
+    const float q = num == 0 ? 0.0f : (a.total_value - num_virtual) / num;
+    const float score = q + c * a.prior / (1.0f + num);
+    if (score > best_score) {
+      best_score = score;
+      best = i;
+    }
+  }
+  return best;
+}
+
+#if defined(__AVX2__)
+
+// Eight actions, unpacked from either layout.
+struct Lanes {
+  __m256i num_taken;
+  __m256i num_virtual;
+  __m256 total_value;
+  __m256 prior;
+};
+
+// Loads actions [i, i + 8), which must all exist.
+Lanes LoadLanes(const PuctStats& s, int i) {
+  return {_mm256_loadu_si256(reinterpret_cast<const __m256i*>(s.num_taken + i)),
+          _mm256_loadu_si256(
+              reinterpret_cast<const __m256i*>(s.num_virtual + i)),
+          _mm256_loadu_ps(s.total_value + i), _mm256_loadu_ps(s.prior + i)};
+}
+
+#if defined(__F16C__)
+
+Lanes LoadLanes(const CompactPuctStats& s, int i) {
+  const __m256i visits =
+      _mm256_loadu_si256(reinterpret_cast<const __m256i*>(s.visits + i));
+  return {_mm256_and_si256(visits, _mm256_set1_epi32(kTakenMask)),
+          _mm256_srli_epi32(visits, kTakenBits),
+          _mm256_loadu_ps(s.total_value + i),
+          _mm256_cvtph_ps(
+              _mm_loadu_si128(reinterpret_cast<const __m128i*>(s.prior + i)))};
+}
+
+#endif  // __F16C__
+
+// Requires at least 8 actions. Instead of a partial last vector, this loads
+// the last 8 actions and ignores the lanes already seen.
+template <typename Stats>
+int Avx2Argmax(const Stats& s, float c_puct) {
+  const __m256i lane = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+  // Start of the vector for actions [i, i + 8), and its lanes at i or later.
+  const auto base = [&](int i) { return std::min(i, s.n - 8); };
+  const auto fresh = [&](int i) {
+    return _mm256_cmpgt_epi32(
+        _mm256_add_epi32(_mm256_set1_epi32(base(i)), lane),
+        _mm256_set1_epi32(i - 1));
+  };
+
+  __m256i sum = _mm256_setzero_si256();
+  for (int i = 0; i < s.n; i += 8) {
+    const Lanes l = LoadLanes(s, base(i));
+    sum = _mm256_add_epi32(
+        sum, _mm256_and_si256(fresh(i),
+                              _mm256_add_epi32(l.num_taken, l.num_virtual)));
+  }
+  __m128i sum4 = _mm_add_epi32(_mm256_castsi256_si128(sum),
+                               _mm256_extracti128_si256(sum, 1));
+  sum4 = _mm_add_epi32(sum4, _mm_shuffle_epi32(sum4, 0x4e));
+  sum4 = _mm_add_epi32(sum4, _mm_shuffle_epi32(sum4, 0xb1));
+  const int32_t num_sum = _mm_cvtsi128_si32(sum4);
+  if (num_sum == 0) {
+    return PriorArgmax(s);
+  }
+
+  const __m256 c =
+      _mm256_set1_ps(c_puct * std::sqrt(static_cast<float>(num_sum)));
+  const __m256 zero = _mm256_setzero_ps();
+  const __m256 one = _mm256_set1_ps(1.0f);
+  const __m256 minus_inf =
+      _mm256_set1_ps(-std::numeric_limits<float>::infinity());
+  __m256 best_score = minus_inf;
+  __m256i best_index = _mm256_setzero_si256();
+  for (int i = 0; i < s.n; i += 8) {
+    const Lanes l = LoadLanes(s, base(i));
+    const __m256 num_virtual = _mm256_cvtepi32_ps(l.num_virtual);
+    const __m256 num =
+        _mm256_cvtepi32_ps(_mm256_add_epi32(l.num_taken, l.num_virtual));
+    // 0/0 lanes are NaN, masked to zero.
+    const __m256 q = _mm256_andnot_ps(
+        _mm256_cmp_ps(num, zero, _CMP_EQ_OQ),
+        _mm256_div_ps(_mm256_sub_ps(l.total_value, num_virtual), num));
+    const __m256 u =
+        _mm256_div_ps(_mm256_mul_ps(c, l.prior), _mm256_add_ps(one, num));
+    const __m256 score = _mm256_blendv_ps(minus_inf, _mm256_add_ps(q, u),
+                                          _mm256_castsi256_ps(fresh(i)));
+    // Keeps the first best index per lane, like the scalar loop.
+    const __m256 better = _mm256_cmp_ps(score, best_score, _CMP_GT_OQ);
+    best_score = _mm256_blendv_ps(best_score, score, better);
+    best_index = _mm256_blendv_epi8(
+        best_index, _mm256_add_epi32(_mm256_set1_epi32(base(i)), lane),
+        _mm256_castps_si256(better));
+  }
+
+  // Lowest index among the lanes with the highest score.
+  __m256 max = _mm256_max_ps(best_score,
+                             _mm256_permute2f128_ps(best_score, best_score, 1));
+  max = _mm256_max_ps(max, _mm256_permute_ps(max, 0x4e));
+  max = _mm256_max_ps(max, _mm256_permute_ps(max, 0xb1));
+  __m256i index = _mm256_blendv_epi8(
+      _mm256_set1_epi32(std::numeric_limits<int32_t>::max()), best_index,
+      _mm256_castps_si256(_mm256_cmp_ps(best_score, max, _CMP_EQ_OQ)));
+  index = _mm256_min_epi32(index, _mm256_permute2x128_si256(index, index, 1));
+  index = _mm256_min_epi32(index, _mm256_shuffle_epi32(index, 0x4e));
+  index = _mm256_min_epi32(index, _mm256_shuffle_epi32(index, 0xb1));
+  return _mm256_cvtsi256_si32(index);
+}
+
+#endif  // __AVX2__
+
+}  // namespace
+
+int PuctArgmax(const PuctStats& s, float c_puct) {
+#if defined(__AVX2__)
+  return s.n < 8 ? ScalarArgmax(s, c_puct) : Avx2Argmax(s, c_puct);
+#else
+  return ScalarArgmax(s, c_puct);
+#endif
+}
+
+int PuctArgmax(const CompactPuctStats& s, float c_puct) {
+#if defined(__AVX2__) && defined(__F16C__)
+  return s.n < 8 ? ScalarArgmax(s, c_puct) : Avx2Argmax(s, c_puct);
+#else
+  return ScalarArgmax(s, c_puct);
+#endif
+}
+
+int PuctArgmaxScalar(const PuctStats& s, float c_puct) {
+  return ScalarArgmax(s, c_puct);
+}
+
+int PuctArgmaxScalar(const CompactPuctStats& s, float c_puct) {
+  return ScalarArgmax(s, c_puct);
+}
+
+}  // namespace generic
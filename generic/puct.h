@@ -0,0 +1,111 @@
+#ifndef _GENERIC_PUCT_H_
+#define _GENERIC_PUCT_H_
+
+#if defined(__F16C__)
+#include <immintrin.h>
+#endif
+
+#include <cstdint>
+#include <cstring>
+
+namespace generic {
+
+// Search statistics for the actions of one MCTS node, as parallel arrays.
+struct PuctStats {
+  const float* prior;
+  const int32_t* num_taken;
+  // Iterations still in flight through the action, counted as losses.
+  const int32_t* num_virtual;
+  // Sum of results, for the player to move in the node.
+  const float* total_value;
+  int n;
+};
+
+// Packing of num_taken and num_virtual into one 32-bit word, for
+// CompactPuctStats: num_taken in the low kTakenBits bits and num_virtual in
+// the rest.
+constexpr int kTakenBits = 25;
+constexpr uint32_t kTakenMask = (uint32_t{1} << kTakenBits) - 1;
+constexpr uint32_t kOneVirtual = uint32_t{1} << kTakenBits;
+constexpr uint32_t kMaxVirtual = (~uint32_t{0}) >> kTakenBits;
+
+// Same as PuctStats, with priors as IEEE half-precision floats and the two
+// counts packed as above. Together with the total value this is 10 bytes per
+// action instead of 16.
+struct CompactPuctStats {
+  const uint16_t* prior;
+  const uint32_t* visits;
+  const float* total_value;
+  int n;
+};
+
+// Conversions between float and IEEE half, rounding to nearest even.
+inline uint16_t FloatToHalf(float f) {
+#if defined(__F16C__)
+  return _cvtss_sh(f, _MM_FROUND_TO_NEAREST_INT);
+#else
+  uint32_t x;
+  std::memcpy(&x, &f, sizeof(x));
+  const uint16_t sign = (x >> 16) & 0x8000;
+  x &= 0x7fffffff;
+  if (x >= 0x47800000) {
+    // Too large, infinity or NaN.
+    return sign | (x > 0x7f800000 ? 0x7e00 : 0x7c00);
+  }
+  if (x < 0x38800000) {
+    // Subnormal in half precision: the mantissa is |f| * 2^24.
+    float a;
+    std::memcpy(&a, &x, sizeof(a));
+    return sign | static_cast<uint16_t>(__builtin_rintf(a * 16777216.0f));
+  }
+  // Rebias the exponent from 127 to 15 and round off 13 mantissa bits. A
+  // carry out of the mantissa correctly bumps the exponent.
+  x += 0xfff + ((x >> 13) & 1);
+  return sign | static_cast<uint16_t>((x - 0x38000000) >> 13);
+#endif
+}
+
+inline float HalfToFloat(uint16_t h) {
+#if defined(__F16C__)
+  return _cvtsh_ss(h);
+#else
+  const uint32_t sign = static_cast<uint32_t>(h & 0x8000) << 16;
+  const uint32_t exp = (h >> 10) & 0x1f;
+  const uint32_t mantissa = h & 0x3ff;
+  uint32_t x;
+  if (exp == 0) {
+    // Zero or subnormal.
+    const float f = mantissa * (1.0f / 16777216.0f);
+    std::memcpy(&x, &f, sizeof(x));
+    x |= sign;
+  } else if (exp == 31) {
+    x = sign | 0x7f800000 | (mantissa << 13);
+  } else {
+    x = sign | ((exp + 112) << 23) | (mantissa << 13);
+  }
+  float f;
+  std::memcpy(&f, &x, sizeof(f));
+  return f;
+#endif
+}
+
+// Returns the index of the action maximizing
+//
+//   Q + c_puct * prior * sqrt(N) / (1 + num),
+//
+// where num = num_taken + num_virtual, Q = (total_value - num_virtual) / num
+// (0 for unvisited actions) and N is the sum of num over all actions. If N is
+// zero, this is the action with the highest prior. Ties go to the lowest
+// index. 'n' must be positive.
+//
+// Uses AVX2 when compiled with it (and F16C for the compact version).
+int PuctArgmax(const PuctStats& s, float c_puct);
+int PuctArgmax(const CompactPuctStats& s, float c_puct);
+
+// Portable versions of the above, for tests and benchmarks.
+int PuctArgmaxScalar(const PuctStats& s, float c_puct);
+int PuctArgmaxScalar(const CompactPuctStats& s, float c_puct);
+
+}  // namespace generic
+
+#endif
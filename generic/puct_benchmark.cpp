@@ -0,0 +1,141 @@
+// Compares PUCT child selection over the old array-of-structs action layout
+// with the structure-of-arrays versions in puct.h. Build with -mavx2 -mf16c
+// (or -march=native) to get the vectorized versions.
+#include <cmath>
+#include <iostream>
+#include <random>
+#include <vector>
+
+#include "absl/time/clock.h"
+#include "absl/time/time.h"
+#include "generic/puct.h"
+
+namespace generic {
+namespace {
+
+// Average number of legal moves in chess.
+constexpr int kNumActions = 35;
+constexpr int kNumNodes = 1024;
+constexpr int kRounds = 2000;
+
+// Action layout before the structure-of-arrays change.
+struct Action {
+  int move = 0;
+  float prior = 0;
+  int num_virtual = 0;
+  int num_taken = 0;
+  double total_value = 0;
+  void* state = nullptr;
+};
+
+int AosPickAction(const std::vector<Action>& actions) {
+  int num_sum = 0;
+  for (const Action& a : actions) {
+    num_sum += a.num_taken + a.num_virtual;
+  }
+  const double num_sum_sqrt = sqrt(num_sum);
+  double best_score = -10000;
+  int best = -1;
+  for (int i = 0; i < actions.size(); ++i) {
+    const Action& action = actions[i];
+    double score;
+    if (num_sum == 0) {
+      score = action.prior;
+    } else {
+      const int num = action.num_taken + action.num_virtual;
+      const double mean_value =
+          num == 0 ? 0 : (action.total_value - action.num_virtual) / num;
+      score = mean_value + action.prior * num_sum_sqrt / (1.0 + num);
+    }
+    if (score > best_score) {
+      best_score = score;
+      best = i;
+    }
+  }
+  return best;
+}
+
+struct SoaNode {
+  std::vector<float> prior;
+  std::vector<int32_t> num_taken;
+  std::vector<int32_t> num_virtual;
+  std::vector<float> total_value;
+
+  PuctStats stats() const {
+    return {prior.data(), num_taken.data(), num_virtual.data(),
+            total_value.data(), static_cast<int>(prior.size())};
+  }
+};
+
+struct CompactNode {
+  std::vector<uint16_t> prior;
+  std::vector<uint32_t> visits;
+  std::vector<float> total_value;
+
+  CompactPuctStats stats() const {
+    return {prior.data(), visits.data(), total_value.data(),
+            static_cast<int>(prior.size())};
+  }
+};
+
+template <typename F>
+void Benchmark(const char* name, int num_nodes, const F& pick) {
+  absl::Time start = absl::Now();
+  int64_t sum = 0;
+  for (int round = 0; round < kRounds; ++round) {
+    for (int i = 0; i < num_nodes; ++i) {
+      sum += pick(i);
+    }
+  }
+  absl::Time end = absl::Now();
+  const double ns = absl::ToDoubleNanoseconds(end - start) /
+                    (double(kRounds) * num_nodes);
+  std::cout << name << ": " << ns << " ns/pick (checksum " << sum << ")\n";
+}
+
+void Go() {
+#ifndef __AVX2__
+  std::cout << "Warning: built without AVX2, PuctArgmax is scalar.\n";
+#endif
+  std::mt19937 rand;
+  std::uniform_real_distribution<float> unit(0.0, 1.0);
+  std::uniform_int_distribution<int> visits(0, 100);
+  std::vector<std::vector<Action>> aos(kNumNodes);
+  std::vector<SoaNode> soa(kNumNodes);
+  std::vector<CompactNode> compact(kNumNodes);
+  for (int i = 0; i < kNumNodes; ++i) {
+    for (int j = 0; j < kNumActions; ++j) {
+      Action a;
+      a.move = j;
+      a.prior = unit(rand);
+      a.num_taken = visits(rand);
+      a.total_value = a.num_taken * (2 * unit(rand) - 1);
+      aos[i].push_back(a);
+      soa[i].prior.push_back(a.prior);
+      soa[i].num_taken.push_back(a.num_taken);
+      soa[i].num_virtual.push_back(a.num_virtual);
+      soa[i].total_value.push_back(a.total_value);
+      compact[i].prior.push_back(FloatToHalf(a.prior));
+      compact[i].visits.push_back(a.num_taken);
+      compact[i].total_value.push_back(a.total_value);
+    }
+  }
+  Benchmark("aos", kNumNodes, [&](int i) { return AosPickAction(aos[i]); });
+  Benchmark("soa scalar", kNumNodes,
+            [&](int i) { return PuctArgmaxScalar(soa[i].stats(), 1.0); });
+  Benchmark("soa", kNumNodes,
+            [&](int i) { return PuctArgmax(soa[i].stats(), 1.0); });
+  Benchmark("compact scalar", kNumNodes, [&](int i) {
+    return PuctArgmaxScalar(compact[i].stats(), 1.0);
+  });
+  Benchmark("compact", kNumNodes,
+            [&](int i) { return PuctArgmax(compact[i].stats(), 1.0); });
+}
+
+}  // namespace
+}  // namespace generic
+
+int main() {
+  generic::Go();
+  return 0;
+}
@@ -0,0 +1,137 @@
+#include "generic/puct.h"
+
+#include <cmath>
+#include <random>
+#include <vector>
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+namespace generic {
+namespace {
+
+struct Actions {
+  std::vector<float> prior;
+  std::vector<int32_t> num_taken;
+  std::vector<int32_t> num_virtual;
+  std::vector<float> total_value;
+
+  PuctStats stats() const {
+    return {prior.data(), num_taken.data(), num_virtual.data(),
+            total_value.data(), static_cast<int>(prior.size())};
+  }
+};
+
+struct CompactActions {
+  std::vector<uint16_t> prior;
+  std::vector<uint32_t> visits;
+  std::vector<float> total_value;
+
+  explicit CompactActions(const Actions& a) : total_value(a.total_value) {
+    for (int i = 0; i < a.prior.size(); ++i) {
+      prior.push_back(FloatToHalf(a.prior[i]));
+      visits.push_back(a.num_taken[i] + a.num_virtual[i] * kOneVirtual);
+    }
+  }
+
+  CompactPuctStats stats() const {
+    return {prior.data(), visits.data(), total_value.data(),
+            static_cast<int>(prior.size())};
+  }
+};
+
+Actions RandomActions(std::mt19937& rand, int n, int max_visits) {
+  Actions a;
+  std::uniform_real_distribution<float> unit(0.0, 1.0);
+  std::uniform_int_distribution<int32_t> visits(0, max_visits);
+  for (int i = 0; i < n; ++i) {
+    a.prior.push_back(unit(rand));
+    a.num_taken.push_back(visits(rand));
+    a.num_virtual.push_back(visits(rand) % 3);
+    a.total_value.push_back(a.num_taken.back() * (2 * unit(rand) - 1));
+  }
+  return a;
+}
+
+TEST(PuctTest, UnvisitedPicksHighestPrior) {
+  Actions a;
+  a.prior = {0.1, 0.5, 0.2, 0.5};
+  a.num_taken = a.num_virtual = {0, 0, 0, 0};
+  a.total_value = {0, 0, 0, 0};
+  EXPECT_EQ(PuctArgmax(a.stats(), 1.0), 1);
+  EXPECT_EQ(PuctArgmaxScalar(a.stats(), 1.0), 1);
+}
+
+TEST(PuctTest, VirtualLossesCountAsLosses) {
+  Actions a;
+  a.prior = {0.5, 0.5};
+  a.num_taken = {10, 10};
+  a.num_virtual = {5, 0};
+  a.total_value = {5, 0};
+  EXPECT_EQ(PuctArgmax(a.stats(), 1.0), 1);
+  a.num_virtual = {0, 0};
+  EXPECT_EQ(PuctArgmax(a.stats(), 1.0), 0);
+}
+
+TEST(PuctTest, MatchesScalar) {
+  std::mt19937 rand(1);
+  for (int n = 1; n <= 70; ++n) {
+    for (int max_visits : {0, 1, 10, 1000}) {
+      for (int rep = 0; rep < 20; ++rep) {
+        const Actions a = RandomActions(rand, n, max_visits);
+        EXPECT_EQ(PuctArgmax(a.stats(), 1.5), PuctArgmaxScalar(a.stats(), 1.5))
+            << "n=" << n << " max_visits=" << max_visits;
+      }
+    }
+  }
+}
+
+TEST(PuctTest, CompactMatchesScalar) {
+  std::mt19937 rand(2);
+  for (int n = 1; n <= 70; ++n) {
+    for (int max_visits : {0, 1, 10, 1000}) {
+      for (int rep = 0; rep < 20; ++rep) {
+        const CompactActions a(RandomActions(rand, n, max_visits));
+        EXPECT_EQ(PuctArgmax(a.stats(), 1.5), PuctArgmaxScalar(a.stats(), 1.5))
+            << "n=" << n << " max_visits=" << max_visits;
+      }
+    }
+  }
+}
+
+TEST(PuctTest, CompactUnpacksCounts) {
+  Actions a;
+  a.prior = {0.5, 0.5};
+  a.num_taken = {10, 10};
+  a.num_virtual = {5, 0};
+  a.total_value = {5, 0};
+  CompactActions c(a);
+  EXPECT_EQ(PuctArgmax(c.stats(), 1.0), 1);
+  EXPECT_EQ(PuctArgmaxScalar(c.stats(), 1.0), 1);
+  c.visits = {10, 10 + 5 * kOneVirtual};
+  EXPECT_EQ(PuctArgmax(c.stats(), 1.0), 0);
+  // Large visit counts must not leak into num_virtual.
+  c.visits = {kTakenMask - 100, kTakenMask - 100};
+  c.total_value = {1000, 0};
+  EXPECT_EQ(PuctArgmax(c.stats(), 1.0), 0);
+}
+
+TEST(PuctTest, HalfRoundTrip) {
+  for (float f : {0.0f, 1.0f, -2.5f, 0.125f, 65504.0f, 6.1035156e-05f,
+                  5.9604645e-08f}) {
+    EXPECT_EQ(HalfToFloat(FloatToHalf(f)), f) << f;
+  }
+  std::mt19937 rand(3);
+  std::uniform_real_distribution<float> unit(0.0, 1.0);
+  for (int i = 0; i < 1000; ++i) {
+    const float f = unit(rand);
+    EXPECT_NEAR(HalfToFloat(FloatToHalf(f)), f, f / 2048);
+  }
+  // Ties round to even.
+  EXPECT_EQ(HalfToFloat(FloatToHalf(1.0f + 1.0f / 2048)), 1.0f);
+  EXPECT_EQ(HalfToFloat(FloatToHalf(1.0f + 3.0f / 2048)), 1.0f + 2.0f / 1024);
+  EXPECT_TRUE(std::isinf(HalfToFloat(FloatToHalf(1e6f))));
+}
+
+}  // namespace
+}  // namespace generic
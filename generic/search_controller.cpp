@@ -0,0 +1,100 @@
+#include "generic/search_controller.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace generic {
+
+namespace {
+
+// Kept off the clock for communication and move overhead.
+constexpr absl::Duration kMoveOverhead = absl::Milliseconds(30);
+// Number of moves assumed to be left when the time control doesn't say.
+constexpr int kDefaultMovesToGo = 30;
+// The most a single move may take, as a multiple of its target time.
+constexpr int kMaxTimeFactor = 3;
+
+// Entropy of the distribution given by 'visits', divided by its maximum.
+// Returns 1 (most uncertain) if there are no visits.
+double NormalizedEntropy(absl::Span<const int> visits) {
+  int64_t total = 0;
+  for (int v : visits) {
+    total += v;
+  }
+  if (total == 0 || visits.size() < 2) {
+    return 1.0;
+  }
+  double entropy = 0;
+  for (int v : visits) {
+    if (v > 0) {
+      const double p = static_cast<double>(v) / total;
+      entropy -= p * std::log(p);
+    }
+  }
+  return entropy / std::log(static_cast<double>(visits.size()));
+}
+
+}  // namespace
+
+SearchController::SearchController(const SearchLimits& limits,
+                                   absl::Time start)
+    : limits_(limits),
+      start_(start),
+      target_time_(limits.move_time),
+      max_time_(limits.move_time) {
+  if (limits.time_left != absl::InfiniteDuration()) {
+    const absl::Duration left =
+        std::max(absl::ZeroDuration(), limits.time_left - kMoveOverhead);
+    const int moves =
+        limits.moves_to_go > 0 ? limits.moves_to_go : kDefaultMovesToGo;
+    const absl::Duration target = left / moves + limits.increment * 3 / 4;
+    const absl::Duration max = std::min(target * kMaxTimeFactor, left);
+    target_time_ = std::min({target_time_, target, max});
+    max_time_ = std::min(max_time_, max);
+  }
+}
+
+bool SearchController::ShouldStop(absl::Span<const int> visits,
+                                  int64_t iterations, absl::Time now) const {
+  if (iterations < 1) {
+    return false;
+  }
+  if (visits.size() <= 1) {
+    // Nothing to choose from.
+    return true;
+  }
+  const absl::Duration elapsed = now - start_;
+  const absl::Duration time =
+      std::min(max_time_, target_time_ * (0.5 + NormalizedEntropy(visits)));
+  if (elapsed >= time) {
+    return true;
+  }
+
+  double iterations_left = std::numeric_limits<double>::infinity();
+  if (limits_.iterations > 0) {
+    iterations_left = limits_.iterations - iterations;
+  }
+  if (time != absl::InfiniteDuration() && elapsed > absl::ZeroDuration()) {
+    iterations_left =
+        std::min(iterations_left,
+                 iterations * absl::FDivDuration(time - elapsed, elapsed));
+  }
+  if (iterations_left <= 0) {
+    return true;
+  }
+
+  int best = 0;
+  int second = 0;
+  for (int v : visits) {
+    if (v > best) {
+      second = best;
+      best = v;
+    } else if (v > second) {
+      second = v;
+    }
+  }
+  return best - second > iterations_left;
+}
+
+}  // namespace generic
@@ -0,0 +1,65 @@
+#ifndef _GENERIC_SEARCH_CONTROLLER_H_
+#define _GENERIC_SEARCH_CONTROLLER_H_
+
+#include <cstdint>
+
+#include "absl/time/clock.h"
+#include "absl/time/time.h"
+#include "absl/types/span.h"
+
+namespace generic {
+
+// Budget for a single search. Limits which are not set are unlimited, but at
+// least one of them should be set.
+struct SearchLimits {
+  // Number of new iterations, or 0 for no limit.
+  int64_t iterations = 0;
+  // Fixed time for the search, like UCI "movetime".
+  absl::Duration move_time = absl::InfiniteDuration();
+  // Clock of the player to move, like UCI "wtime"/"btime", "winc"/"binc" and
+  // "movestogo". With 'moves_to_go' zero, 'time_left' is for the rest of the
+  // game.
+  absl::Duration time_left = absl::InfiniteDuration();
+  absl::Duration increment = absl::ZeroDuration();
+  int moves_to_go = 0;
+};
+
+// Decides when to stop a search, based on the visit counts of the root
+// actions.
+//
+// Besides stopping when the budget runs out, the search stops as soon as the
+// second most visited action can't catch up with the most visited one in the
+// iterations left, assuming that they continue at the same rate. With a
+// clock, the time for each move is split evenly over the remaining moves, and
+// then scaled from 0.5x to 1.5x by the normalized entropy of the root visits,
+// so that uncertain positions get more time. The scaled time is capped by
+// max_time().
+//
+// This class is thread-compatible. ShouldStop() is const, so several search
+// threads can share one controller.
+class SearchController {
+ public:
+  explicit SearchController(const SearchLimits& limits,
+                            absl::Time start = absl::Now());
+
+  // Returns true if the search should stop. 'visits' are the visit counts of
+  // the root actions and 'iterations' the number of iterations completed
+  // since the start. Never stops before the first iteration.
+  bool ShouldStop(absl::Span<const int> visits, int64_t iterations,
+                  absl::Time now = absl::Now()) const;
+
+  // Time to spend on a position of average uncertainty.
+  absl::Duration target_time() const { return target_time_; }
+  // Time after which the search always stops.
+  absl::Duration max_time() const { return max_time_; }
+
+ private:
+  const SearchLimits limits_;
+  const absl::Time start_;
+  absl::Duration target_time_;
+  absl::Duration max_time_;
+};
+
+}  // namespace generic
+
+#endif
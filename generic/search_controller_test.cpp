@@ -0,0 +1,90 @@
+#include "generic/search_controller.h"
+
+#include <vector>
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+namespace generic {
+namespace {
+
+const absl::Time kStart = absl::UnixEpoch();
+
+TEST(SearchControllerTest, StopsAtIterationLimit) {
+  SearchLimits limits;
+  limits.iterations = 100;
+  SearchController c(limits, kStart);
+  EXPECT_FALSE(c.ShouldStop({30, 30, 30}, 90, kStart));
+  EXPECT_TRUE(c.ShouldStop({34, 33, 33}, 100, kStart));
+}
+
+TEST(SearchControllerTest, StopsWhenBestCannotBeCaught) {
+  SearchLimits limits;
+  limits.iterations = 100;
+  SearchController c(limits, kStart);
+  // 30 iterations left.
+  EXPECT_FALSE(c.ShouldStop({40, 30}, 70, kStart));
+  EXPECT_FALSE(c.ShouldStop({50, 20}, 70, kStart));
+  EXPECT_TRUE(c.ShouldStop({60, 10}, 70, kStart));
+}
+
+TEST(SearchControllerTest, SingleActionStopsAfterFirstIteration) {
+  SearchLimits limits;
+  limits.iterations = 100;
+  SearchController c(limits, kStart);
+  EXPECT_FALSE(c.ShouldStop({0}, 0, kStart));
+  EXPECT_TRUE(c.ShouldStop({1}, 1, kStart));
+}
+
+TEST(SearchControllerTest, MoveTime) {
+  SearchLimits limits;
+  limits.move_time = absl::Seconds(1);
+  SearchController c(limits, kStart);
+  EXPECT_EQ(c.max_time(), absl::Seconds(1));
+  EXPECT_FALSE(c.ShouldStop({50, 50}, 100, kStart + absl::Milliseconds(900)));
+  EXPECT_TRUE(c.ShouldStop({50, 50}, 100, kStart + absl::Seconds(1)));
+}
+
+TEST(SearchControllerTest, ClockSplitsTimeOverMoves) {
+  SearchLimits limits;
+  limits.time_left = absl::Seconds(10) + absl::Milliseconds(30);
+  limits.increment = absl::Seconds(1);
+  limits.moves_to_go = 10;
+  SearchController c(limits, kStart);
+  EXPECT_EQ(c.target_time(), absl::Milliseconds(1750));
+  EXPECT_EQ(c.max_time(), absl::Milliseconds(5250));
+
+  // Never more than what is left.
+  limits.moves_to_go = 1;
+  SearchController last(limits, kStart);
+  EXPECT_EQ(last.max_time(), absl::Seconds(10));
+}
+
+TEST(SearchControllerTest, UncertainPositionsGetMoreTime) {
+  SearchLimits limits;
+  limits.move_time = absl::Seconds(10);
+  limits.time_left = absl::Seconds(30) + absl::Milliseconds(30);
+  SearchController c(limits, kStart);
+  ASSERT_EQ(c.target_time(), absl::Seconds(1));
+  const absl::Time now = kStart + absl::Milliseconds(1200);
+  // Equal visits over all actions: maximum entropy, 1.5s.
+  EXPECT_FALSE(c.ShouldStop({50, 50}, 100, now));
+  // Two of many actions: low entropy, less than 1s. The top two are tied, so
+  // this isn't the early termination.
+  std::vector<int> visits(100, 0);
+  visits[0] = visits[1] = 50;
+  EXPECT_TRUE(c.ShouldStop(visits, 100, now));
+}
+
+TEST(SearchControllerTest, UsesIterationRateForTime) {
+  SearchLimits limits;
+  limits.move_time = absl::Seconds(1);
+  SearchController c(limits, kStart);
+  // 100 iterations in 0.8s; about 25 more fit in the remaining 0.2s.
+  const absl::Time now = kStart + absl::Milliseconds(800);
+  EXPECT_FALSE(c.ShouldStop({60, 40}, 100, now));
+  EXPECT_TRUE(c.ShouldStop({70, 30}, 100, now));
+}
+
+}  // namespace
+}  // namespace generic
@@ -0,0 +1,65 @@
+#include "util/arena.h"
+
+namespace util {
+
+Arena::Arena(size_t block_size) : block_size_(block_size) {}
+
+Arena::~Arena() { Reset(0); }
+
+void* Arena::AllocateSlow(size_t size, size_t align) {
+  if (size + align > block_size_ / 4) {
+    // Big allocations get their own block, so that they don't waste the rest
+    // of the current one.
+    large_blocks_.push_back(
+        Block{std::unique_ptr<char[]>(new char[size + align]), size + align});
+    bytes_reserved_ += size + align;
+    const uintptr_t p =
+        reinterpret_cast<uintptr_t>(large_blocks_.back().data.get());
+    return reinterpret_cast<void*>((p + align - 1) & ~(align - 1));
+  }
+  if (next_block_ == blocks_.size()) {
+    blocks_.push_back(
+        Block{std::unique_ptr<char[]>(new char[block_size_]), block_size_});
+    bytes_reserved_ += block_size_;
+  }
+  Block& block = blocks_[next_block_++];
+  ptr_ = block.data.get();
+  end_ = ptr_ + block.size;
+  // Always fits now.
+  bytes_used_ -= size;
+  return Allocate(size, align);
+}
+
+void Arena::Reset(size_t max_retained_bytes) {
+  for (auto it = destructors_.rbegin(); it != destructors_.rend(); ++it) {
+    it->destroy(it->object);
+  }
+  destructors_.clear();
+  for (const Block& block : large_blocks_) {
+    bytes_reserved_ -= block.size;
+  }
+  large_blocks_.clear();
+  while (!blocks_.empty() && bytes_reserved_ > max_retained_bytes) {
+    bytes_reserved_ -= blocks_.back().size;
+    blocks_.pop_back();
+  }
+  next_block_ = 0;
+  ptr_ = nullptr;
+  end_ = nullptr;
+  bytes_used_ = 0;
+}
+
+void Arena::Swap(Arena* other) {
+  using std::swap;
+  swap(block_size_, other->block_size_);
+  swap(blocks_, other->blocks_);
+  swap(next_block_, other->next_block_);
+  swap(large_blocks_, other->large_blocks_);
+  swap(ptr_, other->ptr_);
+  swap(end_, other->end_);
+  swap(destructors_, other->destructors_);
+  swap(bytes_used_, other->bytes_used_);
+  swap(bytes_reserved_, other->bytes_reserved_);
+}
+
+}  // namespace util
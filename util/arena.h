@@ -0,0 +1,107 @@
+#ifndef _UTIL_ARENA_H_
+#define _UTIL_ARENA_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace util {
+
+// Bump-pointer allocator for objects which share a lifetime, such as the nodes
+// of a search tree. Objects can't be freed one by one: Reset() releases
+// everything at once, and keeps the memory blocks for reuse so that the next
+// tree doesn't have to go to malloc again.
+//
+// This class is thread-compatible.
+class Arena {
+ public:
+  static constexpr size_t kDefaultBlockSize = 1 << 20;
+
+  explicit Arena(size_t block_size = kDefaultBlockSize);
+  ~Arena();
+
+  Arena(const Arena&) = delete;
+  Arena& operator=(const Arena&) = delete;
+
+  // Constructs a T in the arena. Unless T is trivially destructible, its
+  // destructor is run by Reset().
+  template <typename T, typename... Args>
+  T* New(Args&&... args) {
+    T* t = new (Allocate(sizeof(T), alignof(T))) T(std::forward<Args>(args)...);
+    if constexpr (!std::is_trivially_destructible_v<T>) {
+      destructors_.push_back(
+          {t, [](void* p) { static_cast<T*>(p)->~T(); }});
+    }
+    return t;
+  }
+
+  // Contiguous array of 'n' value-initialized T's.
+  template <typename T>
+  T* NewArray(size_t n) {
+    static_assert(std::is_trivially_destructible_v<T>,
+                  "Arena arrays are never destructed");
+    T* arr = static_cast<T*>(Allocate(n * sizeof(T), alignof(T)));
+    for (size_t i = 0; i < n; ++i) {
+      new (&arr[i]) T();
+    }
+    return arr;
+  }
+
+  // Destroys all objects. Memory blocks are kept for reuse, up to
+  // 'max_retained_bytes' of them.
+  void Reset(size_t max_retained_bytes = SIZE_MAX);
+
+  // Exchanges all objects and blocks with 'other'. Pointers to objects stay
+  // valid, but are now owned by 'other'.
+  void Swap(Arena* other);
+
+  // Bytes handed out since the last Reset().
+  size_t bytes_used() const { return bytes_used_; }
+  // Bytes currently held by the arena, including retained blocks.
+  size_t bytes_reserved() const { return bytes_reserved_; }
+
+ private:
+  struct Block {
+    std::unique_ptr<char[]> data;
+    size_t size;
+  };
+  struct Destructor {
+    void* object;
+    void (*destroy)(void*);
+  };
+
+  void* Allocate(size_t size, size_t align) {
+    bytes_used_ += size;
+    const uintptr_t p =
+        (reinterpret_cast<uintptr_t>(ptr_) + align - 1) & ~(align - 1);
+    if (ptr_ == nullptr || p + size > reinterpret_cast<uintptr_t>(end_)) {
+      return AllocateSlow(size, align);
+    }
+    ptr_ = reinterpret_cast<char*>(p + size);
+    return reinterpret_cast<void*>(p);
+  }
+
+  void* AllocateSlow(size_t size, size_t align);
+
+  size_t block_size_;
+  // Blocks [0, next_block_) are in use, the rest are retained for reuse.
+  std::vector<Block> blocks_;
+  size_t next_block_ = 0;
+  // Allocations which don't fit in a block. Freed on Reset().
+  std::vector<Block> large_blocks_;
+  // Free space in the current block.
+  char* ptr_ = nullptr;
+  char* end_ = nullptr;
+
+  std::vector<Destructor> destructors_;
+  size_t bytes_used_ = 0;
+  size_t bytes_reserved_ = 0;
+};
+
+}  // namespace util
+
+#endif
@@ -0,0 +1,91 @@
+#include "util/arena.h"
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+namespace util {
+namespace {
+
+TEST(ArenaTest, AllocatesAligned) {
+  Arena arena(1024);
+  std::vector<char*> chars;
+  for (int i = 0; i < 1000; ++i) {
+    char* c = arena.New<char>(i);
+    double* d = arena.New<double>(i);
+    EXPECT_EQ(reinterpret_cast<uintptr_t>(d) % alignof(double), 0);
+    EXPECT_EQ(*d, i);
+    chars.push_back(c);
+  }
+  for (int i = 0; i < 1000; ++i) {
+    EXPECT_EQ(*chars[i], static_cast<char>(i));
+  }
+}
+
+TEST(ArenaTest, ArraysAreZeroed) {
+  Arena arena(1024);
+  for (int n : {0, 1, 7, 100, 1000}) {
+    int* arr = arena.NewArray<int>(n);
+    for (int i = 0; i < n; ++i) {
+      EXPECT_EQ(arr[i], 0);
+      arr[i] = 1;
+    }
+  }
+}
+
+TEST(ArenaTest, ResetRunsDestructorsAndReusesMemory) {
+  Arena arena(1024);
+  auto counter = std::make_shared<int>(0);
+  for (int i = 0; i < 100; ++i) {
+    arena.New<std::shared_ptr<int>>(counter);
+  }
+  EXPECT_EQ(counter.use_count(), 101);
+  const size_t reserved = arena.bytes_reserved();
+  EXPECT_GT(arena.bytes_used(), 0);
+  arena.Reset();
+  EXPECT_EQ(counter.use_count(), 1);
+  EXPECT_EQ(arena.bytes_used(), 0);
+  EXPECT_EQ(arena.bytes_reserved(), reserved);
+
+  // Same allocations again shouldn't need any new blocks.
+  for (int i = 0; i < 100; ++i) {
+    arena.New<std::shared_ptr<int>>(counter);
+  }
+  EXPECT_EQ(arena.bytes_reserved(), reserved);
+
+  arena.Reset(/*max_retained_bytes=*/0);
+  EXPECT_EQ(arena.bytes_reserved(), 0);
+}
+
+TEST(ArenaTest, LargeAllocations) {
+  Arena arena(1024);
+  char* small = arena.NewArray<char>(10);
+  int64_t* large = arena.NewArray<int64_t>(1000);
+  large[999] = 1;
+  // Still allocating from the first block.
+  EXPECT_EQ(arena.NewArray<char>(10), small + 10);
+  arena.Reset();
+  EXPECT_EQ(arena.bytes_reserved(), 1024);
+}
+
+TEST(ArenaTest, Swap) {
+  Arena a(1024);
+  Arena b(1024);
+  auto counter = std::make_shared<int>(0);
+  int* x = a.New<int>(5);
+  a.New<std::shared_ptr<int>>(counter);
+  a.Swap(&b);
+  EXPECT_EQ(a.bytes_used(), 0);
+  EXPECT_GT(b.bytes_used(), 0);
+  a.Reset();
+  EXPECT_EQ(*x, 5);
+  EXPECT_EQ(counter.use_count(), 2);
+  b.Reset();
+  EXPECT_EQ(counter.use_count(), 1);
+}
+
+}  // namespace
+}  // namespace util
@@ -0,0 +1,42 @@
+#ifndef _UTIL_MAPPED_FILE_H_
+#define _UTIL_MAPPED_FILE_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+#include "absl/strings/string_view.h"
+
+namespace util {
+
+// Read-only memory mapping of a whole file. Pages are loaded by the OS on
+// first access and shared between processes mapping the same file, so large
+// lookup tables cost neither load time nor private memory.
+//
+// This class is thread-safe.
+class MappedFile {
+ public:
+  // Returns null if the file can't be opened or mapped.
+  static std::unique_ptr<MappedFile> Open(const std::string& path);
+  ~MappedFile();
+
+  MappedFile(const MappedFile&) = delete;
+  MappedFile& operator=(const MappedFile&) = delete;
+
+  const uint8_t* data() const { return data_; }
+  size_t size() const { return size_; }
+  absl::string_view contents() const {
+    return absl::string_view(reinterpret_cast<const char*>(data_), size_);
+  }
+
+ private:
+  MappedFile(const uint8_t* data, size_t size) : data_(data), size_(size) {}
+
+  const uint8_t* const data_;
+  const size_t size_;
+};
+
+}  // namespace util
+
+#endif
@@ -0,0 +1,46 @@
+#include "util/mapped_file.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <string>
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+namespace util {
+namespace {
+
+std::string TempPath(const std::string& name) {
+  const char* dir = getenv("TEST_TMPDIR");
+  return std::string(dir != nullptr ? dir : "/tmp") + "/" + name;
+}
+
+TEST(MappedFileTest, MapsContents) {
+  const std::string path = TempPath("mapped_file_test");
+  const std::string contents = std::string("abc\0def", 7) + "xyz";
+  std::ofstream(path, std::ios::binary) << contents;
+  auto file = MappedFile::Open(path);
+  ASSERT_NE(file, nullptr);
+  EXPECT_EQ(file->size(), contents.size());
+  EXPECT_EQ(file->contents(), contents);
+  EXPECT_EQ(file->data()[8], 'y');
+  std::remove(path.c_str());
+}
+
+TEST(MappedFileTest, EmptyFile) {
+  const std::string path = TempPath("mapped_file_test_empty");
+  std::ofstream(path, std::ios::binary);
+  auto file = MappedFile::Open(path);
+  ASSERT_NE(file, nullptr);
+  EXPECT_EQ(file->size(), 0);
+  EXPECT_EQ(file->contents(), "");
+  std::remove(path.c_str());
+}
+
+TEST(MappedFileTest, MissingFile) {
+  EXPECT_EQ(MappedFile::Open(TempPath("no_such_file_here")), nullptr);
+}
+
+}  // namespace
+}  // namespace util